@@ -0,0 +1,635 @@
+// fsl_adjoint.h - Reverse mode automatic differentiation for bootstrap and present value
+/*
+A tape records every operation on var as a node with edges (parent, partial
+derivative). One backward sweep from an output accumulates its adjoint
+into every node, so the gradient with respect to all inputs costs a small
+multiple of the forward evaluation no matter how many inputs there are.
+
+Nodes and edges live in two contiguous arrays that keep their capacity
+across clear() and rewind(), so repeated risk runs do not allocate.
+
+Root solves are not taped. If f_k solves PV_k(θ, f_k) = 0 then the
+implicit function theorem gives df_k/dθ = -(∂PV_k/∂θ)/(∂PV_k/∂f_k), so
+bootstrap records each forward as one node with edges to the cash flows
+of its instrument and the earlier forwards. Present value on a curve of
+var forwards is also recorded as one node using the same partials as
+fsl_risk.h. Build instruments with C = var<X> from quotes on the tape,
+bootstrap, price, then call gradient to get dPV/dquote for every quote.
+
+A tape is not thread safe. Use one tape per thread.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fsl_bootstrap.h"
+#include "fsl_dual.h"
+#include "fsl_instrument.h"
+#include "fsl_pwflat.h"
+
+namespace fsl {
+	template<class X>
+	struct var;
+}
+
+namespace std {
+	// NaN of var is used for curves with no extrapolated forward.
+	template<class X>
+	class numeric_limits<fsl::var<X>> : public numeric_limits<X> {
+	public:
+		static constexpr fsl::var<X> quiet_NaN() noexcept
+		{
+			return fsl::var<X>(numeric_limits<X>::quiet_NaN());
+		}
+		static constexpr fsl::var<X> epsilon() noexcept
+		{
+			return fsl::var<X>(numeric_limits<X>::epsilon());
+		}
+		static constexpr fsl::var<X> infinity() noexcept
+		{
+			return fsl::var<X>(numeric_limits<X>::infinity());
+		}
+	};
+}
+
+namespace fsl {
+
+	template<class X = double>
+	class tape {
+		std::vector<size_t> node_; // node i has edges [node_[i], node_[i + 1])
+		std::vector<std::pair<size_t, X>> edge_; // parent and partial derivative
+	public:
+		tape()
+			: node_{ 0 }
+		{ }
+		tape(const tape&) = delete;
+		tape& operator=(const tape&) = delete;
+
+		// Number of nodes.
+		size_t size() const
+		{
+			return node_.size() - 1;
+		}
+		// Add an edge to the next node.
+		void edge(size_t i, X d)
+		{
+			assert(i < size());
+			edge_.emplace_back(i, d);
+		}
+		// Finish a node with the edges added since the last node and return its index.
+		size_t node()
+		{
+			node_.push_back(edge_.size());
+
+			return size() - 1;
+		}
+
+		// Drop nodes recorded after mark, e.g., price many books on one taped curve.
+		size_t mark() const
+		{
+			return size();
+		}
+		void rewind(size_t mark)
+		{
+			assert(mark <= size());
+			node_.resize(mark + 1);
+			edge_.resize(node_.back());
+		}
+		void clear()
+		{
+			rewind(0);
+		}
+
+		// Adjoints of every node with respect to node y.
+		void adjoint(size_t y, std::vector<X>& a) const
+		{
+			a.assign(size(), X(0));
+			a[y] = X(1);
+			for (size_t k = y + 1; k-- > 0; ) {
+				const X ak = a[k];
+				if (ak == 0) {
+					continue;
+				}
+				for (size_t e = node_[k]; e < node_[k + 1]; ++e) {
+					a[edge_[e].first] += edge_[e].second * ak;
+				}
+			}
+		}
+	};
+
+	template<class X = double>
+	struct var {
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		X v; // value
+		tape<X>* t; // null for constants
+		size_t i; // node on tape
+
+		constexpr var(X v = X(0))
+			: v(v), t(nullptr), i(npos)
+		{ }
+		template<class Y>
+			requires std::is_arithmetic_v<Y>
+		constexpr var(Y y)
+			: var(X(y))
+		{ }
+		// Independent variable recorded on tape.
+		var(tape<X>& t, X v)
+			: v(v), t(&t), i(t.node())
+		{ }
+		// Node i on tape.
+		var(X v, tape<X>* t, size_t i)
+			: v(v), t(t), i(i)
+		{ }
+
+		bool active() const
+		{
+			return t != nullptr;
+		}
+
+		var& operator+=(const var& y);
+		var& operator-=(const var& y);
+		var& operator*=(const var& y);
+		var& operator/=(const var& y);
+	};
+
+	template<class X>
+	constexpr X value(const var<X>& x)
+	{
+		return x.v;
+	}
+
+	// Derivatives of y with respect to each node on its tape.
+	template<class X>
+	inline std::vector<X> gradient(const var<X>& y)
+	{
+		std::vector<X> a;
+		if (y.active()) {
+			y.t->adjoint(y.i, a);
+		}
+
+		return a;
+	}
+	// Derivative of y with respect to x given the adjoints from gradient.
+	template<class X>
+	inline X derivative(const std::vector<X>& a, const var<X>& x)
+	{
+		return x.active() && x.i < a.size() ? a[x.i] : X(0);
+	}
+
+	template<class X>
+	inline var<X> unary(const var<X>& x, X v, X dx)
+	{
+		if (!x.active()) {
+			return var<X>(v);
+		}
+		x.t->edge(x.i, dx);
+
+		return var<X>(v, x.t, x.t->node());
+	}
+	template<class X>
+	inline var<X> binary(const var<X>& x, X dx, const var<X>& y, X dy, X v)
+	{
+		tape<X>* t = x.active() ? x.t : y.t;
+		if (!t) {
+			return var<X>(v);
+		}
+		assert(!x.active() || !y.active() || x.t == y.t);
+		if (x.active()) {
+			t->edge(x.i, dx);
+		}
+		if (y.active()) {
+			t->edge(y.i, dy);
+		}
+
+		return var<X>(v, t, t->node());
+	}
+
+	template<class X>
+	inline var<X> operator-(const var<X>& x)
+	{
+		return unary(x, -x.v, X(-1));
+	}
+	template<class X>
+	inline var<X> operator+(const var<X>& x, const var<X>& y)
+	{
+		return binary(x, X(1), y, X(1), x.v + y.v);
+	}
+	template<class X>
+	inline var<X> operator-(const var<X>& x, const var<X>& y)
+	{
+		return binary(x, X(1), y, X(-1), x.v - y.v);
+	}
+	template<class X>
+	inline var<X> operator*(const var<X>& x, const var<X>& y)
+	{
+		return binary(x, y.v, y, x.v, x.v * y.v);
+	}
+	template<class X>
+	inline var<X> operator/(const var<X>& x, const var<X>& y)
+	{
+		const X v = x.v / y.v;
+
+		return binary(x, 1 / y.v, y, -v / y.v, v);
+	}
+
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator+(const var<X>& x, Y y)
+	{
+		return unary(x, x.v + y, X(1));
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator+(Y y, const var<X>& x)
+	{
+		return x + y;
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator-(const var<X>& x, Y y)
+	{
+		return unary(x, x.v - y, X(1));
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator-(Y y, const var<X>& x)
+	{
+		return unary(x, y - x.v, X(-1));
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator*(const var<X>& x, Y y)
+	{
+		return unary(x, x.v * y, X(y));
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator*(Y y, const var<X>& x)
+	{
+		return x * y;
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator/(const var<X>& x, Y y)
+	{
+		return unary(x, x.v / y, 1 / X(y));
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	inline var<X> operator/(Y y, const var<X>& x)
+	{
+		const X v = y / x.v;
+
+		return unary(x, v, -v / x.v);
+	}
+
+	template<class X>
+	inline var<X>& var<X>::operator+=(const var<X>& y)
+	{
+		return *this = *this + y;
+	}
+	template<class X>
+	inline var<X>& var<X>::operator-=(const var<X>& y)
+	{
+		return *this = *this - y;
+	}
+	template<class X>
+	inline var<X>& var<X>::operator*=(const var<X>& y)
+	{
+		return *this = *this * y;
+	}
+	template<class X>
+	inline var<X>& var<X>::operator/=(const var<X>& y)
+	{
+		return *this = *this / y;
+	}
+
+	// Comparisons use the value.
+	template<class X, class Y>
+	constexpr bool operator<(const var<X>& x, const Y& y)
+	{
+		return x.v < value(y);
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator<(const Y& y, const var<X>& x)
+	{
+		return y < x.v;
+	}
+	template<class X, class Y>
+	constexpr bool operator<=(const var<X>& x, const Y& y)
+	{
+		return x.v <= value(y);
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator<=(const Y& y, const var<X>& x)
+	{
+		return y <= x.v;
+	}
+	template<class X, class Y>
+	constexpr bool operator>(const var<X>& x, const Y& y)
+	{
+		return x.v > value(y);
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator>(const Y& y, const var<X>& x)
+	{
+		return y > x.v;
+	}
+	template<class X, class Y>
+	constexpr bool operator>=(const var<X>& x, const Y& y)
+	{
+		return x.v >= value(y);
+	}
+	template<class X, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator>=(const Y& y, const var<X>& x)
+	{
+		return y >= x.v;
+	}
+	template<class X, class Y>
+	constexpr bool operator==(const var<X>& x, const Y& y)
+	{
+		return x.v == value(y);
+	}
+	template<class X, class Y>
+	constexpr bool operator!=(const var<X>& x, const Y& y)
+	{
+		return x.v != value(y);
+	}
+
+	template<class X>
+	inline var<X> exp(const var<X>& x)
+	{
+		const X ex = std::exp(x.v);
+
+		return unary(x, ex, ex);
+	}
+	template<class X>
+	inline var<X> log(const var<X>& x)
+	{
+		return unary(x, std::log(x.v), 1 / x.v);
+	}
+	template<class X>
+	inline var<X> sqrt(const var<X>& x)
+	{
+		const X sx = std::sqrt(x.v);
+
+		return unary(x, sx, 1 / (2 * sx));
+	}
+	template<class X>
+	inline bool isnan(const var<X>& x)
+	{
+		return std::isnan(x.v);
+	}
+
+	// Present value of cash flows and its partial derivatives dc with respect to each
+	// cash flow amount and df with respect to each forward, where df[n] is for the
+	// extrapolated forward _f.
+	template<class U, class C, class F, class X>
+	inline X present_value(const instrument<U, C>& uc, size_t n, const U* t, const F* f, const F& _f, X* dc, X* df)
+	{
+		thread_local std::vector<X> I, P; // integral to start of segment, partial segment sums
+		I.resize(n + 1);
+		P.assign(n + 1, X(0));
+		std::fill(df, df + n + 1, X(0)); // sum of discounted cash flows in each segment
+		I[0] = 0;
+		for (size_t j = 0; j < n; ++j) {
+			I[j + 1] = I[j] + value(f[j]) * (t[j] - (j ? t[j - 1] : U(0)));
+		}
+
+		X pv = 0;
+		for (size_t l = 0; l < uc.size(); ++l) {
+			const auto& [u, c] = uc[l];
+			if (u < 0) {
+				throw std::invalid_argument("present_value: cash flow times must be non-negative");
+			}
+			const size_t k = std::lower_bound(t, t + n, u) - t;
+			const U t0 = k ? t[k - 1] : U(0);
+			const X D = std::exp(-(I[k] + value(k < n ? f[k] : _f) * (u - t0)));
+			const X cD = value(c) * D;
+			pv += cD;
+			dc[l] = D;
+			df[k] += cD;
+			P[k] += cD * (u - t0);
+		}
+		// dD(u)/df_j = -D(u) (t_j - t_{j-1}) if u is past segment j, -D(u) (u - t_{j-1}) if u is in it
+		X S = 0;
+		for (size_t j = n + 1; j-- > 0; ) {
+			const X B = df[j];
+			df[j] = -(P[j] + (j < n ? t[j] - (j ? t[j - 1] : U(0)) : U(0)) * S);
+			S += B;
+		}
+
+		return pv;
+	}
+
+	// Present value on a curve of var forwards recorded as one node.
+	template<class U, class C, class X>
+	inline var<X> present_value(const instrument<U, C>& uc, const pwflat::curve_view<U, var<X>>& f)
+	{
+		const size_t n = f.size();
+		const var<X>* r = f.rate();
+		const var<X> _f = f.extrapolate();
+		thread_local std::vector<X> dc, df;
+		dc.resize(uc.size());
+		df.resize(n + 1);
+		const X pv = present_value(uc, n, f.time(), r, _f, dc.data(), df.data());
+
+		tape<X>* t = _f.t;
+		for (size_t j = 0; !t && j < n; ++j) {
+			t = r[j].t;
+		}
+		for (size_t l = 0; !t && l < uc.size(); ++l) {
+			if constexpr (std::is_same_v<C, var<X>>) {
+				t = uc[l].second.t;
+			}
+		}
+		if (!t) {
+			return var<X>(pv);
+		}
+		if constexpr (std::is_same_v<C, var<X>>) {
+			for (size_t l = 0; l < uc.size(); ++l) {
+				if (uc[l].second.active()) {
+					t->edge(uc[l].second.i, dc[l]);
+				}
+			}
+		}
+		for (size_t j = 0; j <= n; ++j) {
+			const var<X>& fj = j < n ? r[j] : _f;
+			if (fj.active() && df[j] != 0) {
+				t->edge(fj.i, df[j]);
+			}
+		}
+
+		return var<X>(pv, t, t->node());
+	}
+
+	// Bootstrap instruments with cash flows on a tape into var forwards.
+	// Forward values are identical to bootstrap of the cash flow values.
+	template<class U = double, class X = double>
+	inline void bootstrap(size_t n, const instrument<U, var<X>>* const* uc, U* t, var<X>* f)
+	{
+		std::vector<X> f_(n); // forward values
+		std::vector<X> dc, df;
+		instrument<U, X> uc_;
+		for (size_t k = 0; k < n; ++k) {
+			if (uc[k] == nullptr) {
+				throw std::runtime_error("Null instrument pointer in bootstrap");
+			}
+			const instrument<U, var<X>>& ck = *uc[k];
+			uc_.resize(ck.size());
+			for (size_t l = 0; l < ck.size(); ++l) {
+				uc_[l] = { ck[l].first, ck[l].second.v };
+			}
+			std::tie(t[k], f_[k]) = bootstrap0(uc_, pwflat::curve_view<U, X>(k, t, f_.data()));
+
+			tape<X>* tk = nullptr;
+			for (size_t l = 0; !tk && l < ck.size(); ++l) {
+				tk = ck[l].second.t;
+			}
+			for (size_t j = 0; !tk && j < k; ++j) {
+				tk = f[j].t;
+			}
+			if (!tk) {
+				f[k] = var<X>(f_[k]);
+				continue;
+			}
+
+			// df_k/dθ = -(∂PV_k/∂θ)/(∂PV_k/∂f_k) where f_k is the extrapolated forward
+			dc.resize(ck.size());
+			df.resize(k + 1);
+			present_value(uc_, k, t, f_.data(), f_[k], dc.data(), df.data());
+			const X dk = df[k];
+			for (size_t l = 0; l < ck.size(); ++l) {
+				if (ck[l].second.active()) {
+					tk->edge(ck[l].second.i, -dc[l] / dk);
+				}
+			}
+			for (size_t j = 0; j < k; ++j) {
+				if (f[j].active() && df[j] != 0) {
+					tk->edge(f[j].i, -df[j] / dk);
+				}
+			}
+			f[k] = var<X>(f_[k], tk, tk->node());
+		}
+	}
+
+	template<class U = double, class X = double>
+	inline pwflat::curve<U, var<X>> bootstrap(const std::vector<const instrument<U, var<X>>*>& uc)
+	{
+		std::vector<U> t(uc.size());
+		std::vector<var<X>> f(uc.size());
+		bootstrap(uc.size(), uc.data(), t.data(), f.data());
+
+		return pwflat::curve<U, var<X>>(t.size(), t.data(), f.data());
+	}
+
+#ifdef _DEBUG
+	inline int test_adjoint()
+	{
+		{
+			tape<> tp;
+			var<> x(tp, 0.3), y(tp, 0.7);
+			var<> z = exp(x * y) + log(y) * sqrt(x) - x / y + 2 * x - 1;
+			const auto f = [](double x, double y) { return std::exp(x * y) + std::log(y) * std::sqrt(x) - x / y + 2 * x - 1; };
+			assert(z.v == f(0.3, 0.7));
+			auto a = gradient(z);
+			const double h = 1e-6;
+			assert(fabs(derivative(a, x) - (f(0.3 + h, 0.7) - f(0.3 - h, 0.7)) / (2 * h)) < 1e-8);
+			assert(fabs(derivative(a, y) - (f(0.3, 0.7 + h) - f(0.3, 0.7 - h)) / (2 * h)) < 1e-8);
+			assert(derivative(a, var<>(1.)) == 0);
+
+			const size_t m = tp.mark();
+			var<> w = x * x;
+			assert(derivative(gradient(w), x) == 0.6);
+			tp.rewind(m);
+			assert(tp.size() == m);
+			tp.clear();
+			assert(tp.size() == 0);
+		}
+		{
+			// zero coupon bonds have closed form forwards f_k = log(D_{k-1}/D_k)
+			tape<> tp;
+			var<> D1(tp, 0.97), D2(tp, 0.93);
+			zero_coupon_bond<double, var<>> z1(1, D1), z2(2, D2);
+			auto f = bootstrap<double, double>({ &z1, &z2 });
+			assert(fabs(f.rate()[1].v - std::log(0.97 / 0.93)) < 1e-8);
+			auto a = gradient(f.rate()[1]);
+			assert(fabs(derivative(a, D1) - 1 / 0.97) < 1e-6);
+			assert(fabs(derivative(a, D2) + 1 / 0.93) < 1e-6);
+		}
+		{
+			// book PV gradient with respect to quotes matches bump and rebuild
+			std::vector<double> q = { 0.97, 0.035, 0.04, 0.045 };
+			const auto curve = [&q](tape<>* tp, std::vector<var<>>& v) {
+				v.clear();
+				for (double qi : q) {
+					v.push_back(tp ? var<>(*tp, qi) : var<>(qi));
+				}
+				zero_coupon_bond<double, var<>> z1(1, v[0]);
+				interest_rate_swap<double, var<>> s2(2, v[1], frequency::semiannually), s3(3, v[2]), s5(5, v[3]);
+				return bootstrap<double, double>({ &z1, &s2, &s3, &s5 });
+			};
+			std::vector<interest_rate_swap<>> book;
+			for (int i = 1; i <= 20; ++i) {
+				book.emplace_back(0.25 * i, 0.03 + 0.0005 * i, frequency::quarterly);
+			}
+			const auto pv = [&book](const pwflat::curve_view<double, var<>>& f) {
+				var<> p = 0;
+				for (size_t i = 0; i < book.size(); ++i) {
+					p += (i % 3 ? 1. : -2.) * present_value(book[i], f);
+				}
+				return p;
+			};
+
+			tape<> tp;
+			std::vector<var<>> v;
+			auto f = curve(&tp, v);
+			{
+				// forwards match double bootstrap
+				zero_coupon_bond<> z1(1, q[0]);
+				interest_rate_swap<> s2(2, q[1], frequency::semiannually), s3(3, q[2]), s5(5, q[3]);
+				auto g = bootstrap<>({ &z1, &s2, &s3, &s5 });
+				for (size_t j = 0; j < g.size(); ++j) {
+					assert(f.rate()[j].v == g.rate()[j]);
+				}
+				assert(fabs(pv(f).v - [&]() {
+					double p = 0;
+					for (size_t i = 0; i < book.size(); ++i) {
+						p += (i % 3 ? 1. : -2.) * present_value(book[i], g);
+					}
+					return p;
+				}()) < 1e-6);
+			}
+			const size_t m = tp.mark();
+			auto a = gradient(pv(f));
+			tp.rewind(m);
+
+			const double h = 1e-5;
+			for (size_t i = 0; i < 4; ++i) {
+				std::vector<var<>> w;
+				const double qi = q[i];
+				q[i] = qi + h;
+				const double pu = pv(curve(nullptr, w)).v;
+				q[i] = qi - h;
+				const double pd = pv(curve(nullptr, w)).v;
+				q[i] = qi;
+				const double d = (pu - pd) / (2 * h);
+				assert(fabs(derivative(a, v[i]) - d) < 1e-3 * (1 + fabs(d)));
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
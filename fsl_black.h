@@ -1,21 +1,32 @@
 // fsl_black.h - Header file for the Fischer Black model.
+// Kernels compute in real_t of their argument types so integral arguments are promoted to double.
 #pragma once
 #include <cassert>
 #include <cmath>
 #include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "fsl_dual.h"
 #include "fsl_normal.h"
+#include "fsl_root1d_batch.h"
+#include "fsl_root1d_telemetry.h"
 
 namespace fsl {
 
 	// Factor out code independent of Excel.
 	// F = f exp(sZ - s^2/2) <= k if and only if Z <= (log(k/f) + s^2/2)/s
-	inline double black_moneyness(double f, double s, double k)
+	// For X = float rounding of k/f gives an absolute error in s z of about 2e-7.
+	template<class F, class S, class K, class X = real_t<F, S, K>>
+	inline X black_moneyness(F f_, S s_, K k_)
 	{
+		const X f(f_), s(s_), k(k_);
+		using std::log;
+
 		if (f <= 0 || s <= 0 || k <= 0) {
-			return std::numeric_limits<double>::quiet_NaN(); // Use NaN for errors
+			return X(std::numeric_limits<double>::quiet_NaN()); // Use NaN for errors
 		}
 
-		return (std::log(k / f) + s * s / 2) / s;
+		return (log(k / f) + s * s / 2) / s;
 	}
 	inline int test_black_moneyness()
 	{
@@ -49,14 +60,22 @@ namespace fsl {
 	}
 
 	// E[max(k - F, 0)] = k P(Z <= z) - f P(Z + s <= z)
-	inline double black_put_value(double f, double s, double k)
+	// For X = float the absolute error is less than 5e-7 f when 0.5 f <= k <= 2 f and 0.01 <= s <= 1.
+	template<class F, class S, class K, class X = real_t<F, S, K>>
+	inline X black_put_value(F f_, S s_, K k_)
 	{
-		double z = fsl::black_moneyness(f, s, k);
+		const X f(f_), s(s_), k(k_);
+		X z = fsl::black_moneyness(f, s, k);
 
 		return k * fsl::normal_cdf(z) - f * fsl::normal_cdf(z - s);
 	}
 	inline int test_black_put_value()
 	{
+		{
+			// integral arguments are promoted
+			assert(black_put_value(100, 1, 100) == black_put_value(100., 1., 100.));
+			assert(black_put_value(100, .1, 100) == black_put_value(100., .1, 100.));
+		}
 		{
 			double data[][4] = {
 				// f, s, k, p 
@@ -74,9 +93,12 @@ namespace fsl {
 
 	// (d/df) E[max(k - F, 0)] = E[-1(F <= k) dF/df]
 	// dF/df = exp(s Z - s^2/2).
-	inline double black_put_delta(double f, double s, double k)
+	// For X = float the absolute error is less than 2e-6.
+	template<class F, class S, class K, class X = real_t<F, S, K>>
+	inline X black_put_delta(F f_, S s_, K k_)
 	{
-		double z = fsl::black_moneyness(f, s, k);
+		const X f(f_), s(s_), k(k_);
+		X z = fsl::black_moneyness(f, s, k);
 
 		return -fsl::normal_cdf(z - s);
 	}
@@ -107,9 +129,12 @@ namespace fsl {
 
 	// (d/df)^2 E[max(k - F, 0)] = normal_pdf(z - s)/(fs)
 	// dF/df = exp(s Z - s^2/2).
-	inline double black_put_gamma(double f, double s, double k)
+	// For X = float the absolute error is less than 2e-6/(f s).
+	template<class F, class S, class K, class X = real_t<F, S, K>>
+	inline X black_put_gamma(F f_, S s_, K k_)
 	{
-		double z = fsl::black_moneyness(f, s, k);
+		const X f(f_), s(s_), k(k_);
+		X z = fsl::black_moneyness(f, s, k);
 
 		return fsl::normal_pdf(z - s)/(f*s);
 	}
@@ -139,9 +164,12 @@ namespace fsl {
 	}
 
 	// (d/ds) E[max(k - F, 0)] = f normal_pdf(z - s)
-	inline double black_put_vega(double f, double s, double k)
+	// For X = float the absolute error is less than 2e-6 f.
+	template<class F, class S, class K, class X = real_t<F, S, K>>
+	inline X black_put_vega(F f_, S s_, K k_)
 	{
-		double z = fsl::black_moneyness(f, s, k);
+		const X f(f_), s(s_), k(k_);
+		X z = fsl::black_moneyness(f, s, k);
 
 		return f * fsl::normal_pdf(z - s);
 	}
@@ -166,12 +194,91 @@ namespace fsl {
 		return 0;
 	}
 
+	// Put values of n options for scenario grids.
+	// Cumulative normals are computed in X and everything else in Y. With X = Y = float
+	// both erf calls and the moneyness are single precision. With X = float and Y = double
+	// only the erf calls are, so the log(k/f) near the money and the cancellation in
+	// k N(z) - f N(z - s) keep double precision.
+	// For f = 100, 0.5 f <= k <= 2 f, and 0.01 <= s <= 1 the maximum absolute error
+	// relative to double is less than 5e-7 f for float and 2e-7 f for mixed.
+	template<class X = double, class Y = X>
+	inline void black_put_value(size_t n, const Y* f, const Y* s, const Y* k, Y* p)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			const Y z = fsl::black_moneyness(f[i], s[i], k[i]);
+			p[i] = k[i] * Y(fsl::normal_cdf(X(z))) - f[i] * Y(fsl::normal_cdf(X(z - s[i])));
+		}
+	}
+	inline int test_black_put_value_float()
+	{
+		{
+			std::vector<double> f, s, k;
+			for (double k_ = 50; k_ <= 200; k_ *= 1.05) {
+				for (double s_ = 0.01; s_ <= 1; s_ += 0.03) {
+					f.push_back(100);
+					s.push_back(s_);
+					k.push_back(k_);
+				}
+			}
+			const size_t n = f.size();
+			std::vector<float> f_(f.begin(), f.end()), s_(s.begin(), s.end()), k_(k.begin(), k.end());
+			std::vector<double> p(n), pm(n);
+			std::vector<float> pf(n);
+			black_put_value(n, f.data(), s.data(), k.data(), p.data());
+			black_put_value<float, double>(n, f.data(), s.data(), k.data(), pm.data());
+			black_put_value(n, f_.data(), s_.data(), k_.data(), pf.data());
+			for (size_t i = 0; i < n; ++i) {
+				assert(p[i] == black_put_value(f[i], s[i], k[i]));
+				assert(fabs(pm[i] - p[i]) < 2e-7 * f[i]);
+				assert(fabs(pf[i] - p[i]) < 5e-7 * f[i]);
+				assert(fabs(black_put_delta(f_[i], s_[i], k_[i]) - black_put_delta(f[i], s[i], k[i])) < 2e-6);
+				assert(fabs(black_put_gamma(f_[i], s_[i], k_[i]) - black_put_gamma(f[i], s[i], k[i])) < 2e-6 / (f[i] * s[i]));
+				assert(fabs(black_put_vega(f_[i], s_[i], k_[i]) - black_put_vega(f[i], s[i], k[i])) < 2e-6 * f[i]);
+			}
+		}
+
+		return 0;
+	}
+
+	// Put value and derivatives with respect to f, s, and k in one evaluation.
+	inline dual<double, 3> black_put_greeks(double f, double s, double k)
+	{
+		using D = dual<double, 3>;
+
+		return black_put_value(D::variable(f, 0), D::variable(s, 1), D::variable(k, 2));
+	}
+	inline int test_black_put_greeks()
+	{
+		{
+			double data[][3] = {
+				{100, .1, 100},
+				{100, .2, 90},
+				{100, .3, 120},
+			};
+			for (auto [f, s, k] : data) {
+				auto g = black_put_greeks(f, s, k);
+				assert(g.v == black_put_value(f, s, k));
+				assert(fabs(g.d[0] - black_put_delta(f, s, k)) < 1e-14);
+				assert(fabs(g.d[1] - black_put_vega(f, s, k)) < 1e-12);
+				// dp/dk = P(F <= k)
+				assert(fabs(g.d[2] - normal_cdf(black_moneyness(f, s, k))) < 1e-14);
+			}
+		}
+
+		return 0;
+	}
+
 	// Black implied volatility for put option.
+	// Use Newton-Raphson and fall back to Brent's method if it does not converge.
 	inline double black_put_implied(double f, double p, double k, double s = 0.1, double eps = 1e-8, unsigned iter = 100)
 	{
+		const double s0 = s;
+		const unsigned iter0 = iter;
+		root1d::telemetry_scope ts(FSL_ROOT1D_SITE("black_put_implied"));
 		do {
 			// Newton-Raphson method.
 			double s_ = s - (black_put_value(f, s, k) - p) / black_put_vega(f, s, k);
+			ts.evaluations += 2; // value and vega
 			if (s_ <= 0) {
 				s_ = s / 2;
 			}
@@ -182,8 +289,48 @@ namespace fsl {
 			s = s_;
 		} while (--iter);
 
+		size_t n = iter0 - iter + (iter != 0);
+		if (iter == 0 || std::isnan(s)) {
+			// Brent's method is recorded as part of this call.
+			const auto v = [f, p, k, &ts](double s) { ++ts.evaluations; return black_put_value(f, s, k) - p; };
+			auto ab = root1d::expand(v, s0, s0 / 2, 0., infinity<double>);
+			auto [s_, y_, n_] = root1d::brent(ab, eps, iter0).solve(v);
+			s = s_;
+			n += n_;
+		}
+		if (ts.on()) {
+			ts.record(n, s, black_put_value(f, s, k) - p);
+		}
+
 		return s;
 	}
+	// Black implied volatilities of n put options solved in lockstep.
+	// Problems Newton-Raphson does not solve fall back to black_put_implied.
+	inline double* black_put_implied(size_t n, const double* f, const double* p, const double* k, double* s,
+		double s0 = 0.1, double eps = 1e-8, unsigned iter = 100)
+	{
+		const auto v = [=](size_t m, const size_t* i, const double* x, double* y) {
+			for (size_t j = 0; j < m; ++j) {
+				y[j] = black_put_value(f[i[j]], x[j], k[i[j]]) - p[i[j]];
+			}
+		};
+		const auto dv = [=](size_t m, const size_t* i, const double* x, double* y) {
+			for (size_t j = 0; j < m; ++j) {
+				y[j] = black_put_vega(f[i[j]], x[j], k[i[j]]);
+			}
+		};
+		std::vector<double> s_(n, s0);
+		if (root1d::batch_newton<>(eps, iter).solve(v, dv, n, s_.data(), s, nullptr, nullptr, 0.) < n) {
+			for (size_t i = 0; i < n; ++i) {
+				if (std::isnan(s[i])) {
+					s[i] = black_put_implied(f[i], p[i], k[i], s0, eps, iter);
+				}
+			}
+		}
+
+		return s;
+	}
+
 	inline int test_black_put_implied()
 	{
 		{
@@ -199,6 +346,45 @@ namespace fsl {
 				assert(fabs(s - s_) < 1e-7); // Check if implied volatility matches input
 			}
 		}
+		{
+			// Newton-Raphson overshoots for deep out of the money puts.
+			double f = 100, s = 0.5, k = 20;
+			double p = black_put_value(f, s, k);
+			double s_ = black_put_implied(f, p, k, 0.1, 1e-8, 100);
+			assert(fabs(s - s_) < 1e-7);
+		}
+		{
+			double f[] = { 100, 100, 100, 100, 100 };
+			double k[] = { 20, 90, 100, 110, 200 };
+			double s[] = { .5, .1, .2, .3, .4 };
+			double p[5], s_[5];
+			for (int i = 0; i < 5; ++i) {
+				p[i] = black_put_value(f[i], s[i], k[i]);
+			}
+			black_put_implied(5, f, p, k, s_);
+			for (int i = 0; i < 5; ++i) {
+				assert(fabs(s[i] - s_[i]) < 1e-7);
+			}
+		}
+		{
+			// telemetry counts value and vega as two evaluations and records the Brent fallback once
+			const bool enabled = root1d::telemetry::enabled.exchange(true);
+			black_put_implied(100, black_put_value(100., .2, 100.), 100);
+			const root1d::telemetry* site = nullptr;
+			for (auto q = root1d::telemetry::first(); q; q = q->next()) {
+				if (std::string_view(q->name) == "black_put_implied") {
+					site = q;
+				}
+				assert(std::string_view(q->name) != "black_put_implied.brent");
+			}
+			assert(site);
+			const uint64_t c = site->calls, n = site->iterations, e = site->evaluations;
+			black_put_implied(100, black_put_value(100., .2, 100.), 100);
+			assert(site->calls == c + 1 && site->evaluations - e == 2 * (site->iterations - n));
+			black_put_implied(100, black_put_value(100., .5, 20.), 20);
+			assert(site->calls == c + 2 && site->iterations - n > 100 + 3 && site->evaluations - e > 200 + 6);
+			root1d::telemetry::enabled = enabled;
+		}
 
 		return 0;
 	}
@@ -1,8 +1,14 @@
 // fsl_bootstrap.h - Bootstrap a piecewise flat forward curve.
 #pragma once
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
 #include "fsl_instrument.h"
 #include "fsl_pwflat.h"
-#include "fsl_root1d.h"
+#include "fsl_root1d_telemetry.h"
 
 namespace fsl {
 
@@ -46,25 +52,119 @@ namespace fsl {
 		}
 
 		const auto pv = [&uc, &f](F _f) { return present_value(uc, extrapolate(f, _f)); };
-		f_ = std::get<0>(root1d::secant(f_, f_ + 0.01, eps, iter).solve(pv));
+		// Bracket the root and use Brent's method, falling back to secant if no bracket is found.
+		auto ab = root1d::expand(pv, f_, F(0.01));
+		if (is_nan(ab.first)) {
+			f_ = std::get<0>(root1d::solve(FSL_ROOT1D_SITE("bootstrap0.secant"), root1d::secant(f_, f_ + 0.01, eps, iter), pv));
+		}
+		else {
+			f_ = std::get<0>(root1d::solve(FSL_ROOT1D_SITE("bootstrap0"), root1d::brent<F, C>(ab, eps, iter), pv));
+		}
 
 		return { u_, f_ };
 	}
 
+	// Bootstrap n instruments into preallocated time and forward arrays.
 	template<class U = double, class C = double, class T = double, class F = double>
-	inline pwflat::curve<T,F> bootstrap(const std::vector<const instrument<U,C>*>& uc)
+	inline void bootstrap(size_t n, const instrument<U, C>* const* uc, T* t, F* f)
 	{
-		pwflat::curve<T, F> f;
-
- 		// call bootstrap0 for each instrument
-		for (size_t i = 0; i < uc.size(); ++i) {
+		for (size_t i = 0; i < n; ++i) {
 			if (uc[i] == nullptr) {
 				throw std::runtime_error("Null instrument pointer in bootstrap");
 			}
-			f.push_back(bootstrap0(*uc[i], f));
+			std::tie(t[i], f[i]) = bootstrap0(*uc[i], pwflat::curve_view<T, F>(i, t, f));
+		}
+	}
+
+	template<class U = double, class C = double, class T = double, class F = double>
+	inline pwflat::curve<T,F> bootstrap(const std::vector<const instrument<U,C>*>& uc)
+	{
+		std::vector<T> t(uc.size());
+		std::vector<F> f(uc.size());
+		bootstrap(uc.size(), uc.data(), t.data(), f.data());
+
+		return pwflat::curve<T, F>(t.size(), t.data(), f.data());
+	}
+
+	// Bootstrap many independent curves concurrently. Scaling with the number of threads has not been measured.
+	// Curve i uses a fixed slice of one contiguous arena so results do not depend on scheduling.
+	template<class U = double, class C = double, class T = double, class F = double>
+	class curve_batch {
+		std::vector<size_t> offset_; // curve i is [offset_[i], offset_[i + 1])
+		std::vector<T> t_;
+		std::vector<F> f_;
+		std::vector<std::string> error_;
+	public:
+		curve_batch(const std::vector<std::vector<const instrument<U, C>*>>& uc)
+			: offset_(uc.size() + 1), error_(uc.size())
+		{
+			for (size_t i = 0; i < uc.size(); ++i) {
+				offset_[i + 1] = offset_[i] + uc[i].size();
+			}
+			t_.resize(offset_.back());
+			f_.resize(offset_.back());
+
+			std::vector<size_t> idx(uc.size());
+			std::iota(idx.begin(), idx.end(), size_t(0));
+			std::for_each(std::execution::par, idx.begin(), idx.end(), [&](size_t i) {
+				try {
+					bootstrap(uc[i].size(), uc[i].data(), t_.data() + offset_[i], f_.data() + offset_[i]);
+				}
+				catch (const std::exception& ex) {
+					error_[i] = ex.what();
+				}
+			});
+		}
+
+		size_t size() const
+		{
+			return error_.size();
+		}
+		// Empty if curve i was built, otherwise the reason it failed.
+		const std::string& error(size_t i) const
+		{
+			return error_[i];
+		}
+		// Curve i, empty if it failed.
+		pwflat::curve_view<T, F> operator[](size_t i) const
+		{
+			if (!error_[i].empty()) {
+				return pwflat::curve_view<T, F>(NaN<F>);
+			}
+
+			return pwflat::curve_view<T, F>(offset_[i + 1] - offset_[i], t_.data() + offset_[i], f_.data() + offset_[i]);
+		}
+	};
+#ifdef _DEBUG
+	inline int test_curve_batch()
+	{
+		zero_coupon_bond<> z1(1, 0.97), z2(2, 0.93);
+		interest_rate_swap<> s3(3, 0.035);
+		std::vector<interest_rate_swap<>> s5;
+		for (int b = -50; b <= 50; ++b) {
+			s5.emplace_back(5, 0.04 + b * 0.0001);
+		}
+		std::vector<std::vector<const instrument<>*>> uc;
+		for (const auto& s : s5) {
+			uc.push_back({ &z1, &z2, &s3, &s });
+		}
+		uc.push_back({ &z2, &z1 }); // not increasing
+		curve_batch<> cb(uc);
+		assert(cb.size() == uc.size());
+		for (size_t i = 0; i + 1 < uc.size(); ++i) {
+			assert(cb.error(i).empty());
+			auto f = bootstrap<>(uc[i]);
+			auto g = cb[i];
+			assert(g.size() == f.size());
+			for (size_t j = 0; j < f.size(); ++j) {
+				assert(g.time()[j] == f.time()[j] && g.rate()[j] == f.rate()[j]);
+			}
 		}
+		assert(!cb.error(uc.size() - 1).empty());
+		assert(cb[uc.size() - 1].size() == 0);
 
-		return f;
+		return 0;
 	}
+#endif // _DEBUG
 
 } // namespace fsl
\ No newline at end of file
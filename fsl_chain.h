@@ -0,0 +1,426 @@
+// fsl_chain.h - Option chains stored as columns
+/*
+An option chain holds put and call quotes for many expiries in aligned
+columns: strike, put bid/ask/mid, and call bid/ask/mid with rows sorted by
+expiry then strike. Each expiry has a forward f and discount D. Views of an
+expiry are pointers into the columns so pricers read them without copying.
+
+Quotes are cleaned by clearing a mask byte per row. Filters are written as
+straight line loops over the columns so the compiler can vectorize them.
+With mid prices p and c at strikes k_0 < ... < k_{n-1}, no arbitrage requires
+
+	0 <= p_{i+1} - p_i <= D (k_{i+1} - k_i)  (monotone puts)
+	0 <= c_i - c_{i+1} <= D (k_{i+1} - k_i)  (monotone calls)
+	slopes of p and c are increasing         (convexity)
+	c - p = D (f - k)                        (put-call parity)
+
+Monotone and convexity tests see the same mask so a bad quote cannot hide
+behind a good neighbour that was cleared first. A strike is cleared when it
+is in a failed test and its neighbours pass the tests that would join them
+if it were removed, so the bad quote of a failed pair is cleared rather than
+always the right strike. Tests involving rows that were already cleared are
+skipped. Parity allows the half spreads of both quotes. Each filter tests
+neighbours in the original order, so one pass may not remove every
+violation. compact() removes cleared rows so views only see clean quotes.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "fsl_black.h"
+#include "fsl_dispersion.h"
+
+namespace fsl {
+
+	// One expiry of an option chain.
+	template<class X = double>
+	struct option_chain_view {
+		X t; // expiry
+		X f; // forward
+		X D; // discount
+		size_t n; // number of strikes
+		const X* k; // strikes
+		const X* p; // put mid prices
+		const X* c; // call mid prices
+		const uint8_t* mask; // nonzero if usable
+
+		// Variance swap chain of clean undiscounted prices with put/call separator z.
+		// Mid prices are divided by D into p_ and c_ that must outlive the result.
+		vswap_chain<X> vswap(X x0, X z, X* p_, X* c_) const
+		{
+			for (size_t i = 0; i < n; ++i) {
+				p_[i] = p[i] / D;
+				c_[i] = c[i] / D;
+			}
+
+			return vswap_chain<X>{ x0, z, n, k, p_, c_ };
+		}
+		// Variance swap chain pointing at the mid prices. Requires D = 1.
+		vswap_chain<X> vswap(X x0, X z) const
+		{
+			if (D != 1) {
+				throw std::invalid_argument("option_chain_view: vswap needs undiscounted prices, pass buffers when D != 1");
+			}
+
+			return vswap_chain<X>{ x0, z, n, k, p, c };
+		}
+		// Black implied vols from undiscounted put prices. Masked strikes are NaN.
+		X* implied(X* s) const
+		{
+			std::vector<X> f_, p_, k_;
+			for (size_t i = 0; i < n; ++i) {
+				if (mask[i]) {
+					f_.push_back(f);
+					p_.push_back(p[i] / D);
+					k_.push_back(k[i]);
+				}
+			}
+			std::vector<X> s_(k_.size());
+			black_put_implied(s_.size(), f_.data(), p_.data(), k_.data(), s_.data());
+			for (size_t i = 0, j = 0; i < n; ++i) {
+				s[i] = mask[i] ? s_[j++] : NaN<X>;
+			}
+
+			return s;
+		}
+	};
+
+	template<class X = double>
+	class option_chain {
+		std::vector<X> t_, f_, D_; // expiry, forward, and discount
+		std::vector<size_t> off_; // rows of expiry j are off_[j] to off_[j + 1]
+		std::vector<X> k_, pb_, pa_, p_, cb_, ca_, c_; // columns
+		std::vector<uint8_t> mask_;
+
+		template<class F>
+		void each(bool parallel, const F& f)
+		{
+			std::vector<size_t> j(size());
+			std::iota(j.begin(), j.end(), size_t(0));
+			if (parallel) {
+				std::for_each(std::execution::par, j.begin(), j.end(), f);
+			}
+			else {
+				std::for_each(j.begin(), j.end(), f);
+			}
+		}
+	public:
+		option_chain()
+			: off_{ 0 }
+		{ }
+
+		// Number of expiries.
+		size_t size() const
+		{
+			return t_.size();
+		}
+		// Number of rows.
+		size_t rows() const
+		{
+			return k_.size();
+		}
+		// Number of usable rows.
+		size_t count() const
+		{
+			return std::count_if(mask_.begin(), mask_.end(), [](uint8_t m) { return m != 0; });
+		}
+
+		// Add expiry t with forward f, discount D, n increasing strikes k, and put and call bid/ask quotes.
+		// Missing quotes are NaN or 0.
+		option_chain& add(X t, X f, X D, size_t n, const X* k, const X* pb, const X* pa, const X* cb, const X* ca)
+		{
+			if (size() && !(t > t_.back())) {
+				throw std::invalid_argument("option_chain: expiries must be increasing");
+			}
+			if (!(f > 0) || !(D > 0)) {
+				throw std::invalid_argument("option_chain: forward and discount must be positive");
+			}
+			if (!std::is_sorted(k, k + n) || std::adjacent_find(k, k + n) != k + n) {
+				throw std::invalid_argument("option_chain: strikes must be strictly increasing");
+			}
+			t_.push_back(t);
+			f_.push_back(f);
+			D_.push_back(D);
+			off_.push_back(off_.back() + n);
+			k_.insert(k_.end(), k, k + n);
+			pb_.insert(pb_.end(), pb, pb + n);
+			pa_.insert(pa_.end(), pa, pa + n);
+			cb_.insert(cb_.end(), cb, cb + n);
+			ca_.insert(ca_.end(), ca, ca + n);
+			for (size_t i = 0; i < n; ++i) {
+				p_.push_back((pb[i] + pa[i]) / 2);
+				c_.push_back((cb[i] + ca[i]) / 2);
+			}
+			mask_.insert(mask_.end(), n, uint8_t(1));
+
+			return *this;
+		}
+		// Add expiry with mid prices only.
+		option_chain& add(X t, X f, X D, size_t n, const X* k, const X* p, const X* c)
+		{
+			return add(t, f, D, n, k, p, p, c, c);
+		}
+
+		option_chain_view<X> operator[](size_t j) const
+		{
+			const size_t o = off_[j];
+
+			return option_chain_view<X>{ t_[j], f_[j], D_[j], off_[j + 1] - o,
+				k_.data() + o, p_.data() + o, c_.data() + o, mask_.data() + o };
+		}
+
+		// Clear rows with missing, non-positive, or crossed quotes.
+		option_chain& mask_quotes()
+		{
+			const size_t n = rows();
+			uint8_t* m = mask_.data();
+			for (size_t i = 0; i < n; ++i) {
+				// NaN compares false
+				m[i] &= (pb_[i] > 0) & (pb_[i] <= pa_[i]) & (cb_[i] > 0) & (cb_[i] <= ca_[i]);
+			}
+
+			return *this;
+		}
+		// Clear strikes where puts or calls are not monotone with bounded slope.
+		option_chain& mask_monotone(bool parallel = true)
+		{
+			return mask_arbitrage(true, false, parallel);
+		}
+		// Clear strikes where put or call prices are not convex.
+		option_chain& mask_convex(bool parallel = true)
+		{
+			return mask_arbitrage(false, true, parallel);
+		}
+		// Monotone and convexity tests against the mask on entry.
+		// A strike is cleared if it fails a test and removing it passes the tests between its neighbours.
+		option_chain& mask_arbitrage(bool monotone = true, bool convex = true, bool parallel = true)
+		{
+			each(parallel, [this, monotone, convex](size_t j) {
+				const size_t o = off_[j], n = off_[j + 1] - o;
+				const X D = D_[j];
+				const X* k = k_.data() + o;
+				const X* p = p_.data() + o;
+				const X* c = c_.data() + o;
+				uint8_t* m = mask_.data() + o;
+				const std::vector<uint8_t> m0(m, m + n);
+				// i - 1 wraps for i = 0
+				const auto in = [&](size_t i) { return i < n && m0[i]; };
+				const auto pair = [&](size_t a, size_t b) {
+					if (!monotone || !in(a) || !in(b)) {
+						return true;
+					}
+					const X dk = D * (k[b] - k[a]);
+					const X dp = p[b] - p[a];
+					const X dc = c[a] - c[b];
+
+					return dp >= 0 && dp <= dk && dc >= 0 && dc <= dk;
+				};
+				const auto triple = [&](size_t a, size_t b, size_t d) {
+					if (!convex || !in(a) || !in(b) || !in(d)) {
+						return true;
+					}
+					// (p1 - p0)/(k1 - k0) <= (p2 - p1)/(k2 - k1) without division
+					const X k0 = k[b] - k[a], k1 = k[d] - k[b];
+
+					return (p[b] - p[a]) * k1 <= (p[d] - p[b]) * k0 && (c[b] - c[a]) * k1 <= (c[d] - c[b]) * k0;
+				};
+				for (size_t i = 0; i < n; ++i) {
+					const bool fails = !pair(i - 1, i) || !pair(i, i + 1)
+						|| !triple(i - 2, i - 1, i) || !triple(i - 1, i, i + 1) || !triple(i, i + 1, i + 2);
+					const bool fixed = pair(i - 1, i + 1) && triple(i - 2, i - 1, i + 1) && triple(i - 1, i + 1, i + 2);
+					m[i] &= !(fails && fixed);
+				}
+			});
+
+			return *this;
+		}
+		// Clear strikes where |c - p - D(f - k)| exceeds the half spreads plus tol.
+		option_chain& mask_parity(X tol = 0, bool parallel = true)
+		{
+			each(parallel, [this, tol](size_t j) {
+				const size_t o = off_[j], n = off_[j + 1] - o;
+				const X D = D_[j], f = f_[j];
+				for (size_t i = o; i < o + n; ++i) {
+					const X e = c_[i] - p_[i] - D * (f - k_[i]);
+					const X s = (pa_[i] - pb_[i] + ca_[i] - cb_[i]) / 2 + tol + 64 * epsilon<X> * D * f; // rounding
+					mask_[i] &= (e <= s) & (-e <= s);
+				}
+			});
+
+			return *this;
+		}
+		// Apply all filters.
+		option_chain& clean(X tol = 0, bool parallel = true)
+		{
+			return mask_quotes().mask_arbitrage(true, true, parallel).mask_parity(tol, parallel);
+		}
+
+		// Remove cleared rows and expiries with no rows left.
+		option_chain& compact()
+		{
+			size_t r = 0, e = 0; // rows and expiries kept
+			for (size_t j = 0; j < size(); ++j) {
+				const size_t r0 = r;
+				for (size_t i = off_[j]; i < off_[j + 1]; ++i) {
+					if (mask_[i]) {
+						k_[r] = k_[i];
+						pb_[r] = pb_[i];
+						pa_[r] = pa_[i];
+						p_[r] = p_[i];
+						cb_[r] = cb_[i];
+						ca_[r] = ca_[i];
+						c_[r] = c_[i];
+						++r;
+					}
+				}
+				if (r > r0) {
+					t_[e] = t_[j];
+					f_[e] = f_[j];
+					D_[e] = D_[j];
+					off_[e + 1] = r;
+					++e;
+				}
+			}
+			for (auto* v : { &k_, &pb_, &pa_, &p_, &cb_, &ca_, &c_ }) {
+				v->resize(r);
+			}
+			mask_.assign(r, uint8_t(1));
+			t_.resize(e);
+			f_.resize(e);
+			D_.resize(e);
+			off_.resize(e + 1);
+
+			return *this;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_option_chain()
+	{
+		const double f = 100, D = 0.95, s = 0.2;
+		std::vector<double> k, p, c;
+		for (double k_ = 60; k_ <= 140; k_ += 5) {
+			k.push_back(k_);
+			p.push_back(D * black_put_value(f, s, k_));
+			c.push_back(p.back() + D * (f - k_));
+		}
+		const size_t n = k.size();
+		{
+			option_chain<> oc;
+			oc.add(0.5, f, D, n, k.data(), p.data(), c.data());
+			oc.add(1, f, D, n, k.data(), p.data(), c.data());
+			assert(oc.size() == 2 && oc.rows() == 2 * n);
+			oc.clean();
+			assert(oc.count() == 2 * n);
+			auto v = oc[1];
+			assert(v.t == 1 && v.n == n && v.k == oc[0].k + n);
+			std::vector<double> s_(n);
+			v.implied(s_.data());
+			for (size_t i = 0; i < n; ++i) {
+				assert(fabs(s_[i] - s) < 1e-7);
+			}
+		}
+		{
+			// bad quotes
+			auto p_ = p, c_ = c;
+			p_[1] = 0; // missing
+			c_[3] = NaN<double>; // missing
+			p_[6] = p_[5] / 2; // not monotone
+			p_[10] += 0.5; // not convex
+			c_[13] += 0.5; // not convex and not parity
+			option_chain<> oc;
+			oc.add(1, f, D, n, k.data(), p_.data(), c_.data());
+			oc.mask_quotes();
+			assert(oc.count() == n - 2);
+			oc.mask_monotone();
+			assert(!oc[0].mask[6]);
+			oc.mask_convex();
+			assert(!oc[0].mask[10] && !oc[0].mask[13]);
+			std::vector<double> s_(n);
+			oc[0].implied(s_.data());
+			assert(is_nan(s_[6]) && fabs(s_[7] - s) < 1e-7);
+			oc.compact();
+			assert(oc.rows() == oc.count() && oc[0].n == oc.rows());
+			assert(std::find(oc[0].k, oc[0].k + oc[0].n, k[6]) == oc[0].k + oc[0].n);
+
+			// upward spike in both puts and calls keeps parity but not monotone or convex
+			for (size_t i : { size_t(0), size_t(6), size_t(12), n - 1 }) {
+				auto p_ = p, c_ = c;
+				p_[i] += 3;
+				c_[i] += 3;
+				option_chain<> sc;
+				sc.add(1, f, D, n, k.data(), p_.data(), c_.data());
+				sc.clean();
+				assert(sc.count() == n - 1 && !sc[0].mask[i]);
+				sc.compact();
+				assert(sc.clean().count() == n - 1);
+			}
+			// downward spike
+			for (size_t i : { size_t(6), size_t(12), n - 1 }) {
+				auto p_ = p, c_ = c;
+				p_[i] -= 2;
+				c_[i] -= 2;
+				option_chain<> sc;
+				sc.add(1, f, D, n, k.data(), p_.data(), c_.data());
+				sc.clean();
+				assert(sc.count() == n - 1 && !sc[0].mask[i]);
+			}
+
+			// parity with spread
+			option_chain<> pc;
+			std::vector<double> pb(n), pa(n), cb(n), ca(n);
+			for (size_t i = 0; i < n; ++i) {
+				pb[i] = p[i] - 0.1;
+				pa[i] = p[i] + 0.1;
+				cb[i] = c[i] - 0.1;
+				ca[i] = c[i] + 0.1;
+			}
+			cb[4] += 0.3;
+			ca[4] += 0.3;
+			pc.add(1, f, D, n, k.data(), pb.data(), pa.data(), cb.data(), ca.data());
+			pc.mask_parity();
+			assert(pc.count() == n - 1 && !pc[0].mask[4]);
+			pc.compact();
+			pc.mask_parity(0.5);
+			assert(pc.count() == n - 1);
+		}
+		{
+			// variance swap from a clean undiscounted chain
+			option_chain<> oc;
+			std::vector<double> k_, p_, c_;
+			for (double x = 20; x <= 400; x += 1) {
+				k_.push_back(x);
+				p_.push_back(black_put_value(f, s, x));
+				c_.push_back(p_.back() + f - x);
+			}
+			oc.add(1, f, 1, k_.size(), k_.data(), p_.data(), c_.data());
+			auto v = oc.compact()[0];
+			assert(v.n == k_.size());
+			auto vc = v.vswap(f, f);
+			assert(fabs(par_variance(1., vc.x0, vc.z, vc.n, vc.k, vc.p, vc.c) - s * s) < 1e-4);
+
+			// discounted mids are undiscounted into buffers
+			const double D = 0.95;
+			for (size_t i = 0; i < k_.size(); ++i) {
+				p_[i] *= D;
+				c_[i] *= D;
+			}
+			option_chain<> od;
+			od.add(1, f, D, k_.size(), k_.data(), p_.data(), c_.data());
+			auto w = od.compact()[0];
+			assert(throws<std::invalid_argument>([&] { w.vswap(f, f); }));
+			std::vector<double> p(w.n), c(w.n);
+			auto wc = w.vswap(f, f, p.data(), c.data());
+			assert(fabs(par_variance(1., wc.x0, wc.z, wc.n, wc.k, wc.p, wc.c) - s * s) < 1e-4);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -0,0 +1,298 @@
+// fsl_chebyshev.h - Chebyshev interpolation for fast approximate pricing
+/*
+A smooth function on [a, b] is approximated by p(x) = sum_{k < n} c_k T_k(t)
+where t = (2x - a - b)/(b - a) and T_k(cos θ) = cos(kθ). Interpolating at the
+Chebyshev points t_j = cos(π(j + 1/2)/n) gives
+
+	c_k = (2/n) sum_j f(x_j) cos(πk(j + 1/2)/n), with c_0 halved.
+
+Coefficients of analytic functions decay geometrically so the size of the
+last coefficients estimates the error. Evaluation uses Clenshaw's recurrence
+
+	b_k = c_k + 2t b_{k+1} - b_{k+2}, p = c_0 + t b_1 - b_2
+
+with no calls to cos. The tensor version on [a, b] x [c, d] runs the
+recurrence in y to produce each coefficient in x on the fly, so evaluation
+costs n m multiply-adds and no transcendental functions. On a grid the
+recurrence in y is shared so each point costs n multiply-adds.
+
+A proxy pays off when the function is expensive, e.g., implied volatility
+or numerical pricers. Black itself costs about as much as a 32 x 24 proxy.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+#include "fsl_black.h"
+
+namespace fsl {
+
+	// Clenshaw recurrence for sum_{k < n} c[k * stride] T_k(t).
+	template<class X = double>
+	constexpr X clenshaw(size_t n, const X* c, X t, size_t stride = 1)
+	{
+		X b1 = 0, b2 = 0;
+		for (size_t k = n; k-- > 1; ) {
+			const X b = c[k * stride] + 2 * t * b1 - b2;
+			b2 = b1;
+			b1 = b;
+		}
+
+		return n ? c[0] + t * b1 - b2 : X(0);
+	}
+#ifdef _DEBUG
+	static_assert(clenshaw<double>(0, nullptr, 0.5) == 0);
+	static_assert([]() { double c[] = { 1, 2, 3 }; return clenshaw<double>(3, c, 0.5); }() == 1 + 2 * 0.5 + 3 * (2 * 0.25 - 1));
+#endif // _DEBUG
+
+	// Chebyshev coefficients of n values at Chebyshev points of the first kind.
+	// The values may be overwritten by the coefficients.
+	template<class X = double>
+	inline void chebyshev_transform(size_t n, const X* f, X* c, size_t stride = 1)
+	{
+		std::vector<X> f_(n);
+		for (size_t j = 0; j < n; ++j) {
+			f_[j] = f[j * stride];
+		}
+		std::vector<X> cos_(2 * n); // cos(π i/(2n))
+		for (size_t i = 0; i < 2 * n; ++i) {
+			cos_[i] = std::cos(std::numbers::pi_v<X> * i / (2 * n));
+		}
+		for (size_t k = 0; k < n; ++k) {
+			X ck = 0;
+			for (size_t j = 0; j < n; ++j) {
+				// cos(πk(2j + 1)/(2n)) using periodicity and symmetry
+				const size_t i = (k * (2 * j + 1)) % (4 * n);
+				ck += f_[j] * (i < 2 * n ? cos_[i] : -cos_[i - 2 * n]);
+			}
+			c[k * stride] = (k ? 2 : 1) * ck / n;
+		}
+	}
+
+	template<class X = double>
+	class chebyshev {
+		X a_, b_;
+		std::vector<X> c_;
+	public:
+		// Interpolate f on [a, b] with n Chebyshev points.
+		template<class F>
+		chebyshev(const F& f, X a, X b, size_t n)
+			: a_(a), b_(b), c_(n)
+		{
+			if (!(a < b) || n == 0) {
+				throw std::invalid_argument("chebyshev: need a < b and n > 0");
+			}
+			std::vector<X> fx(n);
+			for (size_t j = 0; j < n; ++j) {
+				const X t = std::cos(std::numbers::pi_v<X> * (j + X(0.5)) / n);
+				fx[j] = f((a + b) / 2 + t * (b - a) / 2);
+			}
+			chebyshev_transform(n, fx.data(), c_.data());
+		}
+
+		size_t size() const
+		{
+			return c_.size();
+		}
+		const X* coefficients() const
+		{
+			return c_.data();
+		}
+		// Estimate of the maximum error from the last two coefficients.
+		X error() const
+		{
+			const size_t n = c_.size();
+
+			return std::fabs(c_[n - 1]) + (n > 1 ? std::fabs(c_[n - 2]) : X(0));
+		}
+
+		X operator()(X x) const
+		{
+			return clenshaw(c_.size(), c_.data(), (2 * x - a_ - b_) / (b_ - a_));
+		}
+		void operator()(size_t n, const X* x, X* y) const
+		{
+			for (size_t i = 0; i < n; ++i) {
+				y[i] = operator()(x[i]);
+			}
+		}
+	};
+
+	template<class X = double>
+	class chebyshev2 {
+		X x0_, x1_, y0_, y1_;
+		size_t n_, m_;
+		std::vector<X> c_; // c_[k * m + l] is the coefficient of T_k(s) T_l(t)
+	public:
+		// Interpolate f(x, y) on [a, b] x [c, d] with n x m Chebyshev points.
+		template<class F>
+		chebyshev2(const F& f, X a, X b, size_t n, X c, X d, size_t m)
+			: x0_(a), x1_(b), y0_(c), y1_(d), n_(n), m_(m), c_(n * m)
+		{
+			if (!(a < b) || !(c < d) || n == 0 || m == 0) {
+				throw std::invalid_argument("chebyshev2: need a < b, c < d, and n, m > 0");
+			}
+			std::vector<X> y(m);
+			for (size_t l = 0; l < m; ++l) {
+				y[l] = (c + d) / 2 + std::cos(std::numbers::pi_v<X> * (l + X(0.5)) / m) * (d - c) / 2;
+			}
+			for (size_t k = 0; k < n; ++k) {
+				const X x = (a + b) / 2 + std::cos(std::numbers::pi_v<X> * (k + X(0.5)) / n) * (b - a) / 2;
+				X* ck = c_.data() + k * m;
+				for (size_t l = 0; l < m; ++l) {
+					ck[l] = f(x, y[l]);
+				}
+				chebyshev_transform(m, ck, ck);
+			}
+			for (size_t l = 0; l < m; ++l) {
+				chebyshev_transform(n, c_.data() + l, c_.data() + l, m);
+			}
+		}
+
+		size_t rows() const
+		{
+			return n_;
+		}
+		size_t columns() const
+		{
+			return m_;
+		}
+		const X* coefficients() const
+		{
+			return c_.data();
+		}
+		// Estimate of the maximum error from the last two rows and columns of coefficients.
+		X error() const
+		{
+			X e = 0;
+			for (size_t k = 0; k < n_; ++k) {
+				for (size_t l = 0; l < m_; ++l) {
+					if (k + 2 >= n_ || l + 2 >= m_) {
+						e += std::fabs(c_[k * m_ + l]);
+					}
+				}
+			}
+
+			return e;
+		}
+
+		X operator()(X x, X y) const
+		{
+			const X s = (2 * x - x0_ - x1_) / (x1_ - x0_);
+			const X t = (2 * y - y0_ - y1_) / (y1_ - y0_);
+			X b1 = 0, b2 = 0;
+			for (size_t k = n_; k-- > 1; ) {
+				const X b = clenshaw(m_, c_.data() + k * m_, t) + 2 * s * b1 - b2;
+				b2 = b1;
+				b1 = b;
+			}
+
+			return clenshaw(m_, c_.data(), t) + s * b1 - b2;
+		}
+		void operator()(size_t n, const X* x, const X* y, X* z) const
+		{
+			for (size_t i = 0; i < n; ++i) {
+				z[i] = operator()(x[i], y[i]);
+			}
+		}
+		// Values on the grid x[i], y[j] in z[i * ny + j].
+		// Each y costs n m multiply-adds and each grid point only n.
+		void grid(size_t nx, const X* x, size_t ny, const X* y, X* z) const
+		{
+			std::vector<X> d(n_); // coefficients in x for fixed y
+			for (size_t j = 0; j < ny; ++j) {
+				const X t = (2 * y[j] - y0_ - y1_) / (y1_ - y0_);
+				for (size_t k = 0; k < n_; ++k) {
+					d[k] = clenshaw(m_, c_.data() + k * m_, t);
+				}
+				for (size_t i = 0; i < nx; ++i) {
+					z[i * ny + j] = clenshaw(n_, d.data(), (2 * x[i] - x0_ - x1_) / (x1_ - x0_));
+				}
+			}
+		}
+	};
+
+	// Black put proxy using black_put_value(f, s, k) = f black_put_value(1, s, k/f)
+	// for k/f in [k0, k1] and s in [s0, s1].
+	template<class X = double>
+	class black_put_proxy {
+		chebyshev2<X> p_;
+	public:
+		black_put_proxy(X k0, X k1, X s0, X s1, size_t n = 24, size_t m = 24)
+			: p_([](X x, X s) { return black_put_value(X(1), s, std::exp(x)); }, std::log(k0), std::log(k1), n, s0, s1, m)
+		{ }
+
+		// Error estimate for f = 1.
+		X error() const
+		{
+			return p_.error();
+		}
+		X operator()(X f, X s, X k) const
+		{
+			return f * p_(std::log(k / f), s);
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_chebyshev()
+	{
+		{
+			chebyshev<> p([](double x) { return std::exp(x); }, 0, 2, 20);
+			assert(p.size() == 20);
+			assert(p.error() < 1e-14);
+			for (double x = 0; x <= 2; x += 0.01) {
+				assert(fabs(p(x) - std::exp(x)) < 1e-14 * std::exp(x));
+			}
+			double x[] = { 0, 1, 2 }, y[3];
+			p(3, x, y);
+			assert(y[1] == p(1.));
+		}
+		{
+			// polynomials of degree less than n are exact
+			chebyshev<> p([](double x) { return x * x * x - x; }, -1, 3, 4);
+			assert(fabs(p.coefficients()[3] - 2) < 1e-14); // x = 2t + 1 and 8t^3 = 2 T_3(t) + 6 T_1(t)
+			assert(fabs(p(2.5) - (2.5 * 2.5 * 2.5 - 2.5)) < 1e-13);
+		}
+		{
+			chebyshev2<> p([](double x, double y) { return std::sin(x) * std::exp(y) + x * y; }, 0, 1, 16, -1, 1, 18);
+			assert(p.rows() == 16 && p.columns() == 18);
+			assert(p.error() < 1e-13);
+			for (double x = 0; x <= 1; x += 0.05) {
+				for (double y = -1; y <= 1; y += 0.05) {
+					assert(fabs(p(x, y) - (std::sin(x) * std::exp(y) + x * y)) < 1e-13);
+				}
+			}
+		}
+		{
+			black_put_proxy<> p(0.7, 1.4, 0.1, 0.6);
+			assert(p.error() < 1e-8);
+			std::vector<double> s;
+			for (double s_ = 0.1; s_ <= 0.6; s_ += 0.01) {
+				s.push_back(s_);
+			}
+			std::vector<double> x;
+			for (double k = 70; k <= 140; k += 1) {
+				x.push_back(std::log(k / 100));
+				for (double s_ : s) {
+					const double e = fabs(p(100, s_, k) - black_put_value(100., s_, k));
+					assert(e <= 100 * p.error());
+				}
+			}
+			// grid matches pointwise evaluation
+			chebyshev2<> q([](double x, double s) { return black_put_value(1., s, std::exp(x)); }, std::log(0.7), std::log(1.4), 24, 0.1, 0.6, 24);
+			std::vector<double> z(x.size() * s.size());
+			q.grid(x.size(), x.data(), s.size(), s.data(), z.data());
+			for (size_t i = 0; i < x.size(); ++i) {
+				for (size_t j = 0; j < s.size(); ++j) {
+					assert(fabs(z[i * s.size() + j] - q(x[i], s[j])) < 1e-15);
+				}
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -0,0 +1,312 @@
+// fsl_curve_fit.h - Least squares fit of a piecewise flat forward curve to instruments.
+/*
+Unlike bootstrap, knots t_j are chosen independently of the instruments, so
+quotes may overlap or be redundant. Forward rates f_j on (t_{j-1}, t_j] are
+chosen to minimize
+
+	sum_i w_i PV_i(f)^2 + s sum_j (f_j - f_{j-1})^2
+
+where instrument i has price 0 and the last forward is extrapolated.
+
+If cash flow u lies in segment k then D(u) = exp(-I_{k-1} - f_k (u - t_{k-1}))
+where I_j = sum_{l <= j} f_l (t_l - t_{l-1}), so
+
+	dD(u)/df_j = -D(u) (t_j - t_{j-1}) for j < k and -D(u) (u - t_{k-1}) for j = k.
+
+Cash flow segments are found once per fit and every Gauss-Newton iteration
+costs one exp per cash flow.
+
+Instrument i only depends on forwards up to the segment of its last cash
+flow. If there is no penalty and each segment holds the last cash flow of
+exactly one instrument then J is lower triangular after ordering instruments
+by maturity. Newton's method then solves J dx = -r by forward substitution
+in O(cash flows + n^2) per iteration instead of forming the normal equations
+in O(m n^2), and Levenberg-Marquardt is only used if it fails to converge.
+*/
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "fsl_instrument.h"
+#include "fsl_pwflat.h"
+#include "fsl_rootnd.h"
+#ifdef _DEBUG
+#include "fsl_bootstrap.h"
+#endif // _DEBUG
+
+namespace fsl {
+
+	template<class U = double, class C = double, class T = double, class F = double>
+	class curve_fit {
+		std::vector<T> t_; // knots
+		std::vector<F> f_; // forwards, kept for warm starts
+		// flattened cash flows
+		std::vector<size_t> i_; // instrument
+		std::vector<size_t> k_; // segment
+		std::vector<U> u_; // time
+		std::vector<C> c_; // amount
+		std::vector<F> I_; // integral of forward at knots
+		std::vector<F> S_; // Jacobian workspace
+		std::vector<F> J_, r_, dx_; // Newton workspace
+		rootnd::levenberg_marquardt<F> lm_;
+	public:
+		F smooth; // smoothness penalty weight
+		F error = NaN<F>; // sum of squared residuals of last fit
+		size_t iterations = 0; // iterations of last fit
+
+		// Fit forwards at increasing knots t starting from flat forward f0.
+		curve_fit(const std::vector<T>& t, F smooth = 0, F f0 = F(0.03))
+			: t_(t), f_(t.size(), f0), lm_(t.size(), t.size()), smooth(smooth)
+		{
+			if (t_.empty() || t_[0] <= 0 || !std::is_sorted(t_.begin(), t_.end(), std::less_equal<T>{})) {
+				throw std::invalid_argument("curve_fit: knots must be positive and strictly increasing");
+			}
+		}
+
+		// Fit instruments with price 0 given optional non-negative weights.
+		pwflat::curve<T, F> fit(const std::vector<const instrument<U, C>*>& uc, const std::vector<C>& w = {})
+		{
+			const size_t n = t_.size();
+			const size_t m = uc.size();
+			if (!w.empty() && w.size() != m) {
+				throw std::invalid_argument("curve_fit: number of weights must equal number of instruments");
+			}
+			const size_t mp = smooth > 0 ? n - 1 : 0; // penalty rows
+			if (m + mp < n) {
+				throw std::invalid_argument("curve_fit: need at least as many instruments as knots or a smoothness penalty");
+			}
+
+			i_.clear();
+			k_.clear();
+			u_.clear();
+			c_.clear();
+			for (size_t i = 0; i < m; ++i) {
+				if (uc[i] == nullptr) {
+					throw std::runtime_error("Null instrument pointer in curve_fit");
+				}
+				for (const auto& [u, c] : *uc[i]) {
+					i_.push_back(i);
+					// last segment is extrapolated
+					k_.push_back(std::min<size_t>(std::lower_bound(t_.begin(), t_.end(), u) - t_.begin(), n - 1));
+					u_.push_back(u);
+					c_.push_back(c);
+				}
+			}
+			std::vector<C> sw(m, C(1));
+			for (size_t i = 0; i < w.size(); ++i) {
+				if (!(w[i] >= 0)) {
+					throw std::invalid_argument("curve_fit: weights must be non-negative");
+				}
+				sw[i] = std::sqrt(w[i]);
+			}
+			const F ss = std::sqrt(smooth);
+			I_.resize(n);
+			S_.resize(m * n);
+
+			const auto integrals = [this, n](const F* f) {
+				F I = 0;
+				for (size_t j = 0; j < n; ++j) {
+					I += f[j] * (t_[j] - (j ? t_[j - 1] : T(0)));
+					I_[j] = I;
+				}
+			};
+			const auto discount = [this](size_t l, const F* f) {
+				const size_t k = k_[l];
+				const T tk_ = k ? t_[k - 1] : T(0);
+
+				return std::exp(-(k ? I_[k - 1] : F(0)) - f[k] * (u_[l] - tk_));
+			};
+			const auto r = [&](const F* f, F* r) {
+				integrals(f);
+				std::fill(r, r + m, F(0));
+				for (size_t l = 0; l < c_.size(); ++l) {
+					r[i_[l]] += c_[l] * discount(l, f);
+				}
+				for (size_t i = 0; i < m; ++i) {
+					r[i] *= sw[i];
+				}
+				for (size_t j = 0; j < mp; ++j) {
+					r[m + j] = ss * (f[j + 1] - f[j]);
+				}
+			};
+			const auto dr = [&](const F* f, F* J) {
+				integrals(f);
+				std::fill(J, J + (m + mp) * n, F(0));
+				// J_ij = (t_j - t_{j-1}) S_ij + partial segment terms where S_ij = sum_{k > j} cD
+				std::fill(S_.begin(), S_.end(), F(0));
+				for (size_t l = 0; l < c_.size(); ++l) {
+					const size_t k = k_[l];
+					const F cD = -sw[i_[l]] * c_[l] * discount(l, f);
+					J[i_[l] * n + k] += cD * (u_[l] - (k ? t_[k - 1] : T(0)));
+					S_[i_[l] * n + k] += cD;
+				}
+				for (size_t i = 0; i < m; ++i) {
+					F* Ji = J + i * n;
+					const F* Si = S_.data() + i * n;
+					F S = 0;
+					for (size_t j = n - 1; j-- > 0; ) {
+						S += Si[j + 1];
+						Ji[j] += S * (t_[j] - (j ? t_[j - 1] : T(0)));
+					}
+				}
+				for (size_t j = 0; j < mp; ++j) {
+					J[(m + j) * n + j] = -ss;
+					J[(m + j) * n + j + 1] = ss;
+				}
+			};
+
+			// instrument with its last cash flow in each segment if J is triangular
+			std::vector<size_t> row;
+			if (mp == 0 && m == n) {
+				std::vector<size_t> last(m, 0);
+				for (size_t l = 0; l < c_.size(); ++l) {
+					last[i_[l]] = std::max(last[i_[l]], k_[l]);
+				}
+				row.assign(n, m);
+				for (size_t i = 0; i < m && !row.empty(); ++i) {
+					if (row[last[i]] != m) {
+						row.clear(); // two instruments end in the same segment
+					}
+					else {
+						row[last[i]] = i;
+					}
+				}
+			}
+			if (!row.empty()) {
+				const F tol = sqrt_epsilon<F>;
+				const std::vector<F> f0 = f_;
+				J_.resize(n * n);
+				r_.resize(n);
+				dx_.resize(n);
+				r(f_.data(), r_.data());
+				size_t k = 0;
+				bool done = false;
+				while (!done && ++k < 100) {
+					dr(f_.data(), J_.data());
+					F dxmax = 0, xmax = 0;
+					bool finite = true;
+					for (size_t q = 0; q < n; ++q) {
+						const F* Jq = J_.data() + row[q] * n;
+						F s = -r_[row[q]];
+						for (size_t j = 0; j < q; ++j) {
+							s -= Jq[j] * dx_[j];
+						}
+						dx_[q] = s / Jq[q];
+						finite = finite && std::fabs(dx_[q]) < infinity<F>;
+						dxmax = std::max(dxmax, std::fabs(dx_[q]));
+						xmax = std::max(xmax, std::fabs(f_[q]));
+					}
+					if (!finite) {
+						break; // zero weight or diagonal
+					}
+					for (size_t j = 0; j < n; ++j) {
+						f_[j] += dx_[j];
+					}
+					r(f_.data(), r_.data());
+					done = dxmax <= tol * (xmax + tol);
+				}
+				if (done) {
+					error = 0;
+					for (const F& ri : r_) {
+						error += ri * ri;
+					}
+					iterations = k;
+
+					return pwflat::curve<T, F>(n, t_.data(), f_.data(), f_.back());
+				}
+				std::copy(f0.begin(), f0.end(), f_.begin());
+			}
+
+			if (lm_.m != m + mp) {
+				const F lambda = lm_.lambda;
+				lm_ = rootnd::levenberg_marquardt<F>(n, m + mp, sqrt_epsilon<F>, 100);
+				lm_.lambda = lambda;
+			}
+			auto [e, g, k] = lm_.solve(r, dr, f_.data());
+			error = e;
+			iterations = k;
+			if (is_nan(e)) {
+				throw std::runtime_error("curve_fit: failed to converge");
+			}
+
+			return pwflat::curve<T, F>(n, t_.data(), f_.data(), f_.back());
+		}
+	};
+#ifdef _DEBUG
+	inline int test_curve_fit()
+	{
+		zero_coupon_bond<> z1(1, 0.97), z2(2, 0.93);
+		interest_rate_swap<> s3(3, 0.035), s5(5, 0.04);
+		{
+			// exact fit with knots at maturities
+			std::vector<const instrument<>*> is{ &z1, &z2, &s3, &s5 };
+			curve_fit<> cf({ 1, 2, 3, 5 });
+			auto f = cf.fit(is);
+			assert(cf.error < 1e-20);
+			for (auto i : is) {
+				double pv = 0;
+				for (const auto& [u, c] : *i) {
+					pv += c * std::exp(-f.integral(u));
+				}
+				assert(fabs(pv) < 1e-10);
+			}
+			assert(fabs(f.forward(0.5) + std::log(0.97)) < 1e-10);
+
+			// warm start
+			auto f_ = cf.fit(is);
+			assert(cf.iterations <= 2);
+			for (size_t j = 0; j < f.size(); ++j) {
+				assert(fabs(f.rate()[j] - f_.rate()[j]) < 1e-12);
+			}
+		}
+		{
+			// one swap per knot is triangular and matches bootstrap
+			std::vector<interest_rate_swap<>> s;
+			std::vector<double> t;
+			for (int i = 1; i <= 40; ++i) {
+				t.push_back(0.25 * i);
+				s.emplace_back(t.back(), 0.02 + 0.0005 * i, frequency::quarterly);
+			}
+			std::vector<const instrument<>*> is;
+			for (const auto& si : s) {
+				is.push_back(&si);
+			}
+			curve_fit<> cf(t);
+			auto f = cf.fit(is);
+			assert(cf.iterations <= 8 && cf.error < 1e-20);
+			auto g = bootstrap<>(is);
+			for (size_t j = 0; j < t.size(); ++j) {
+				assert(fabs(f.rate()[j] - g.rate()[j]) < 1e-7);
+			}
+		}
+		{
+			// redundant inconsistent quotes
+			zero_coupon_bond<> z1_(1, 0.96);
+			std::vector<const instrument<>*> is{ &z1, &z1_, &z2 };
+			curve_fit<> cf({ 1, 2 });
+			auto f = cf.fit(is);
+			double D = std::exp(-f.integral(1));
+			assert(0.96 < D && D < 0.97);
+			// weights pull toward the first quote
+			cf.fit(is, { 100, 1, 1 });
+			auto g = cf.fit(is, { 100, 1, 1 });
+			assert(fabs(std::exp(-g.integral(1)) - 0.97) < fabs(D - 0.97));
+		}
+		{
+			// more knots than quotes with smoothness penalty
+			std::vector<const instrument<>*> is{ &z1, &s5 };
+			curve_fit<> cf({ 1, 2, 3, 4, 5 }, 1e-4);
+			auto f = cf.fit(is);
+			assert(cf.error < 1e-8);
+			for (size_t j = 1; j < f.size(); ++j) {
+				assert(fabs(f.rate()[j] - f.rate()[j - 1]) < 0.01);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
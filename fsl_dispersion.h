@@ -0,0 +1,189 @@
+// fsl_dispersion.h - Index and constituent par variance and implied correlation
+/*
+An index I = sum_i ω_i X_i has variance approximately
+
+	σ_I^2 = sum_i ω_i^2 σ_i^2 + ρ sum_{i != j} ω_i ω_j σ_i σ_j
+
+for a common correlation ρ, so the implied correlation is
+
+	ρ = (σ_I^2 - sum_i ω_i^2 σ_i^2) / ((sum_i ω_i σ_i)^2 - sum_i ω_i^2 σ_i^2).
+
+Variance swap weights only depend on the put/call separator and strikes,
+so they are computed once for each distinct grid and shared by every
+underlying quoted on that grid.
+*/
+#pragma once
+#include <algorithm>
+#include <execution>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "fsl_vswap.h"
+#ifdef _DEBUG
+#include "fsl_black.h"
+#endif // _DEBUG
+
+namespace fsl {
+
+	// Option chain of one underlying for par variance.
+	template<class X = double>
+	struct vswap_chain {
+		X x0; // initial price
+		X z; // put/call separator
+		size_t n; // number of strikes
+		const X* k; // strikes
+		const X* p; // put prices
+		const X* c; // call prices
+	};
+
+	// Implied correlation from index par variance, constituent weights, and constituent par variances.
+	template<class X = double>
+	inline X implied_correlation(X sI2, size_t n, const X* w, const X* s2)
+	{
+		X ws = 0; // sum ω_i σ_i
+		X w2s2 = 0; // sum ω_i^2 σ_i^2
+		for (size_t i = 0; i < n; ++i) {
+			X wsi = w[i] * std::sqrt(s2[i]);
+			ws += wsi;
+			w2s2 += wsi * wsi;
+		}
+
+		return (sI2 - w2s2) / (ws * ws - w2s2);
+	}
+#ifdef _DEBUG
+	inline int test_implied_correlation()
+	{
+		{
+			const double w[] = { .5, .5 };
+			const double s2[] = { .04, .09 };
+			// ρ = 1 gives (sum ω_i σ_i)^2
+			double sI = .5 * .2 + .5 * .3;
+			assert(fabs(implied_correlation(sI * sI, 2, w, s2) - 1) < 1e-14);
+			// ρ = 0 gives sum ω_i^2 σ_i^2
+			assert(fabs(implied_correlation(.25 * .04 + .25 * .09, 2, w, s2)) < 1e-14);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	template<class X = double>
+	class dispersion {
+		// Key is put/call separator followed by strikes.
+		std::map<std::vector<X>, std::vector<X>> weights_;
+	public:
+		X index; // index par variance
+		std::vector<X> constituent; // constituent par variances
+		X correlation; // implied correlation
+
+		dispersion()
+			: index(NaN<X>), correlation(NaN<X>)
+		{ }
+
+		// Number of distinct strike grids seen.
+		size_t grids() const
+		{
+			return weights_.size();
+		}
+
+		// Price index and constituent variance swaps over dt and compute implied correlation.
+		// Weights are cached across calls.
+		dispersion& price(X dt, const vswap_chain<X>& I, const std::vector<vswap_chain<X>>& S, const std::vector<X>& w)
+		{
+			if (S.size() != w.size()) {
+				throw std::invalid_argument("dispersion: number of constituents and weights must be equal");
+			}
+
+			// Collect chains and distinct grids.
+			std::vector<const vswap_chain<X>*> chain(1 + S.size());
+			chain[0] = &I;
+			std::transform(S.begin(), S.end(), chain.begin() + 1, [](const auto& s) { return &s; });
+
+			std::vector<std::pair<const std::vector<X>, std::vector<X>>*> grid(chain.size());
+			std::vector<std::pair<const std::vector<X>, std::vector<X>>*> fresh;
+			for (size_t i = 0; i < chain.size(); ++i) {
+				const auto& c = *chain[i];
+				if (c.n < 2 || !c.k || !c.p || !c.c) {
+					throw std::invalid_argument("dispersion: chains must have at least two strikes");
+				}
+				std::vector<X> key(1 + c.n);
+				key[0] = c.z;
+				std::copy(c.k, c.k + c.n, key.begin() + 1);
+				auto [it, ins] = weights_.try_emplace(std::move(key));
+				grid[i] = &*it;
+				if (ins) {
+					fresh.push_back(grid[i]);
+				}
+			}
+
+			// Weights for new grids.
+			std::for_each(std::execution::par, fresh.begin(), fresh.end(), [](auto* g) {
+				const auto& key = g->first;
+				const size_t n = key.size() - 1;
+				g->second.resize(n);
+				// x0 = z since the weights do not depend on x0
+				if (!std::is_sorted(key.begin() + 1, key.end())
+					|| !vswap_weights(key[0], key[0], n, key.data() + 1, g->second.data())) {
+					g->second.clear();
+				}
+			});
+
+			// Par variances.
+			std::vector<X> s2(chain.size());
+			std::vector<size_t> idx(chain.size());
+			std::iota(idx.begin(), idx.end(), size_t(0));
+			std::for_each(std::execution::par, idx.begin(), idx.end(), [&](size_t i) {
+				const auto& c = *chain[i];
+				const auto& wi = grid[i]->second;
+				if (wi.empty() || !is_increasing(c.p, c.p + c.n) || !is_decreasing(c.c, c.c + c.n)) {
+					s2[i] = NaN<X>;
+				}
+				else {
+					s2[i] = par_variance(dt, c.x0, c.z, c.n, c.k, wi.data(), c.p, c.c);
+				}
+			});
+
+			index = s2[0];
+			constituent.assign(s2.begin() + 1, s2.end());
+			correlation = implied_correlation(index, w.size(), w.data(), constituent.data());
+
+			return *this;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_dispersion()
+	{
+		// Flat forward Black prices on a common grid.
+		const auto chain = [](double f, double s, std::vector<double>& k, std::vector<double>& p, std::vector<double>& c) {
+			for (double ki = 50; ki <= 200; ki += 1) {
+				k.push_back(ki);
+				p.push_back(black_put_value(f, s, ki));
+				c.push_back(p.back() + f - ki);
+			}
+		};
+		std::vector<double> k[3], p[3], c[3];
+		chain(100, .2, k[0], p[0], c[0]);
+		chain(100, .25, k[1], p[1], c[1]);
+		chain(100, .3, k[2], p[2], c[2]);
+
+		std::vector<vswap_chain<>> S = {
+			{ 100, 100, k[1].size(), k[1].data(), p[1].data(), c[1].data() },
+			{ 100, 100, k[2].size(), k[2].data(), p[2].data(), c[2].data() },
+		};
+		vswap_chain<> I{ 100, 100, k[0].size(), k[0].data(), p[0].data(), c[0].data() };
+		dispersion<> d;
+		d.price(1, I, S, { .5, .5 });
+		assert(d.grids() == 1);
+		assert(fabs(d.index - .04) < 1e-3);
+		assert(fabs(d.constituent[0] - .0625) < 1e-3);
+		assert(fabs(d.constituent[1] - .09) < 1e-3);
+		assert(d.index == par_variance(1., 100., 100., k[0].size(), k[0].data(), p[0].data(), c[0].data()));
+		// .04 = .25 .0625 + .25 .09 + 2 ρ .25 .25 .3
+		assert(fabs(d.correlation - (.04 - .25 * .0625 - .25 * .09) / (2 * .25 * .25 * .3)) < 2e-2);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
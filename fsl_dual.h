@@ -0,0 +1,336 @@
+// fsl_dual.h - Forward mode automatic differentiation with dual numbers
+/*
+A dual number x + sum_i x_i ε_i with ε_i ε_j = 0 carries the value and N
+directional derivatives through every operation, so one evaluation of a
+function templated on its scalar type gives its gradient. The derivative
+array has a fixed size and each operation is a loop over it the compiler
+vectorizes.
+
+Nesting gives second order. If x = dual<dual<X, N>, N>::variable(X::variable(x0, i), i)
+then y = f(x) has y.v.v = f, y.v.d[i] = df/dx_i, and y.d[j].d[i] = d^2f/dx_i dx_j.
+
+Math functions are found by argument dependent lookup so generic code should
+call them unqualified after `using std::exp;` etc.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <array>
+#include <numbers>
+#include <type_traits>
+
+namespace fsl {
+
+	template<class X = double, size_t N = 1>
+	struct dual {
+		X v; // value
+		std::array<X, N> d; // derivatives
+
+		constexpr dual(X v = X(0))
+			: v(v), d{}
+		{ }
+		template<class Y>
+			requires std::is_arithmetic_v<Y>
+		constexpr dual(Y y)
+			: v(X(y)), d{}
+		{ }
+		// Independent variable i with value v.
+		static constexpr dual variable(X v, size_t i)
+		{
+			dual x(v);
+			x.d[i] = X(1);
+
+			return x;
+		}
+
+		constexpr dual operator-() const
+		{
+			dual x(-v);
+			for (size_t i = 0; i < N; ++i) {
+				x.d[i] = -d[i];
+			}
+
+			return x;
+		}
+		constexpr dual& operator+=(const dual& y)
+		{
+			v += y.v;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] += y.d[i];
+			}
+
+			return *this;
+		}
+		constexpr dual& operator-=(const dual& y)
+		{
+			v -= y.v;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] -= y.d[i];
+			}
+
+			return *this;
+		}
+		// (u + u'ε)(v + v'ε) = uv + (u'v + uv')ε
+		constexpr dual& operator*=(const dual& y)
+		{
+			for (size_t i = 0; i < N; ++i) {
+				d[i] = d[i] * y.v + v * y.d[i];
+			}
+			v *= y.v;
+
+			return *this;
+		}
+		// (u + u'ε)/(v + v'ε) = u/v + (u'v - uv')/v^2 ε
+		constexpr dual& operator/=(const dual& y)
+		{
+			v /= y.v;
+			for (size_t i = 0; i < N; ++i) {
+				d[i] = (d[i] - v * y.d[i]) / y.v;
+			}
+
+			return *this;
+		}
+	};
+
+	// Value of possibly nested dual.
+	template<class X>
+	constexpr auto value(const X& x)
+	{
+		return x;
+	}
+	template<class X, size_t N>
+	constexpr auto value(const dual<X, N>& x)
+	{
+		return value(x.v);
+	}
+
+	template<class X, size_t N>
+	constexpr dual<X, N> operator+(dual<X, N> x, const dual<X, N>& y)
+	{
+		return x += y;
+	}
+	template<class X, size_t N>
+	constexpr dual<X, N> operator-(dual<X, N> x, const dual<X, N>& y)
+	{
+		return x -= y;
+	}
+	template<class X, size_t N>
+	constexpr dual<X, N> operator*(dual<X, N> x, const dual<X, N>& y)
+	{
+		return x *= y;
+	}
+	template<class X, size_t N>
+	constexpr dual<X, N> operator/(dual<X, N> x, const dual<X, N>& y)
+	{
+		return x /= y;
+	}
+
+	// Scalar operations do not need the product rule.
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator+(dual<X, N> x, Y y)
+	{
+		x.v += y;
+
+		return x;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator+(Y y, dual<X, N> x)
+	{
+		x.v += y;
+
+		return x;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator-(dual<X, N> x, Y y)
+	{
+		x.v -= y;
+
+		return x;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator-(Y y, const dual<X, N>& x)
+	{
+		return -x + y;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator*(dual<X, N> x, Y y)
+	{
+		x.v *= y;
+		for (size_t i = 0; i < N; ++i) {
+			x.d[i] *= y;
+		}
+
+		return x;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator*(Y y, const dual<X, N>& x)
+	{
+		return x * y;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator/(dual<X, N> x, Y y)
+	{
+		x.v /= y;
+		for (size_t i = 0; i < N; ++i) {
+			x.d[i] /= y;
+		}
+
+		return x;
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr dual<X, N> operator/(Y y, const dual<X, N>& x)
+	{
+		return dual<X, N>(y) / x;
+	}
+
+	// Comparisons use the value.
+	template<class X, size_t N, class Y>
+	constexpr bool operator<(const dual<X, N>& x, const Y& y)
+	{
+		return value(x) < value(y);
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator<(const Y& y, const dual<X, N>& x)
+	{
+		return y < value(x);
+	}
+	template<class X, size_t N, class Y>
+	constexpr bool operator<=(const dual<X, N>& x, const Y& y)
+	{
+		return value(x) <= value(y);
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator<=(const Y& y, const dual<X, N>& x)
+	{
+		return y <= value(x);
+	}
+	template<class X, size_t N, class Y>
+	constexpr bool operator>(const dual<X, N>& x, const Y& y)
+	{
+		return value(x) > value(y);
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator>(const Y& y, const dual<X, N>& x)
+	{
+		return y > value(x);
+	}
+	template<class X, size_t N, class Y>
+	constexpr bool operator>=(const dual<X, N>& x, const Y& y)
+	{
+		return value(x) >= value(y);
+	}
+	template<class X, size_t N, class Y>
+		requires std::is_arithmetic_v<Y>
+	constexpr bool operator>=(const Y& y, const dual<X, N>& x)
+	{
+		return y >= value(x);
+	}
+
+	// f(x + x'ε) = f(x) + f'(x) x'ε
+	template<class X, size_t N>
+	constexpr dual<X, N> chain(const dual<X, N>& x, const X& fx, const X& dfx)
+	{
+		dual<X, N> y(fx);
+		for (size_t i = 0; i < N; ++i) {
+			y.d[i] = dfx * x.d[i];
+		}
+
+		return y;
+	}
+
+	template<class X, size_t N>
+	inline dual<X, N> exp(const dual<X, N>& x)
+	{
+		using std::exp;
+		X ex = exp(x.v);
+
+		return chain(x, ex, ex);
+	}
+	template<class X, size_t N>
+	inline dual<X, N> log(const dual<X, N>& x)
+	{
+		using std::log;
+
+		return chain(x, log(x.v), 1 / x.v);
+	}
+	template<class X, size_t N>
+	inline dual<X, N> sqrt(const dual<X, N>& x)
+	{
+		using std::sqrt;
+		X sx = sqrt(x.v);
+
+		return chain(x, sx, 1 / (2 * sx));
+	}
+	template<class X, size_t N>
+	inline dual<X, N> erf(const dual<X, N>& x)
+	{
+		using std::erf;
+		using std::exp;
+
+		return chain(x, erf(x.v), std::numbers::inv_sqrtpi_v<decltype(value(x))> * 2 * exp(-x.v * x.v));
+	}
+	template<class X, size_t N>
+	inline dual<X, N> fabs(const dual<X, N>& x)
+	{
+		return x < 0 ? -x : x;
+	}
+	template<class X, size_t N>
+	inline bool isnan(const dual<X, N>& x)
+	{
+		return std::isnan(value(x));
+	}
+#ifdef _DEBUG
+	inline int test_dual()
+	{
+		using D = dual<double, 2>;
+		{
+			constexpr D x = D::variable(3, 0);
+			constexpr D y = D::variable(2, 1);
+			constexpr D z = x * y + x / y - 1;
+			static_assert(z.v == 6 + 1.5 - 1);
+			static_assert(z.d[0] == 2 + 0.5); // y + 1/y
+			static_assert(z.d[1] == 3 - 0.75); // x - x/y^2
+			static_assert((2 - x).d[0] == -1);
+			static_assert((2 / y).d[1] == -0.5);
+			static_assert(x > y && 2 < x && !(x <= 2));
+		}
+		{
+			D x = D::variable(0.3, 0);
+			D y = D::variable(0.7, 1);
+			D z = exp(x * y) + log(y) * sqrt(x) - erf(x);
+			const double h = 1e-6;
+			const auto f = [](double x, double y) { return std::exp(x * y) + std::log(y) * std::sqrt(x) - std::erf(x); };
+			assert(z.v == f(0.3, 0.7));
+			assert(std::fabs(z.d[0] - (f(0.3 + h, 0.7) - f(0.3 - h, 0.7)) / (2 * h)) < 1e-8);
+			assert(std::fabs(z.d[1] - (f(0.3, 0.7 + h) - f(0.3, 0.7 - h)) / (2 * h)) < 1e-8);
+		}
+		{
+			// second order
+			using H = dual<D, 2>;
+			H x = H::variable(D::variable(0.3, 0), 0);
+			H y = H::variable(D::variable(0.7, 1), 1);
+			H z = exp(x * y);
+			const double e = std::exp(0.21);
+			assert(z.v.v == e);
+			assert(std::fabs(z.d[0].d[0] - 0.49 * e) < 1e-14); // y^2 e^{xy}
+			assert(std::fabs(z.d[0].d[1] - (1 + 0.21) * e) < 1e-14); // (1 + xy) e^{xy}
+			assert(z.d[0].d[1] == z.d[1].d[0]);
+			assert(std::fabs(z.d[1].d[1] - 0.09 * e) < 1e-14); // x^2 e^{xy}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
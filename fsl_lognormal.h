@@ -0,0 +1,483 @@
+// fsl_lognormal.h - Monte Carlo for lognormal forward paths
+/*
+Simulate the forward F_j = F(t_j) at t_j = j t/n, j = 1, ..., n,
+
+	F_j = f exp(σ B_j - σ^2 t_j/2)
+
+where B is standard Brownian motion. B_n = sqrt(t) Z is drawn first and
+the earlier values are filled in backward by the Brownian bridge
+
+	B_j = (j/(j + 1)) B_{j+1} + sqrt(Δt j/(j + 1)) Z_j.
+
+Variance reduction:
+
+	Antithetic: each sample is the average of the payoff on B and -B.
+	Control variate: the put max(k - F_n, 0) has known mean black_put_value(f, σ sqrt(t), k).
+		The coefficient β = Cov(V, C)/Var(C) is estimated from the same paths.
+	Stratified: path i has B_n = sqrt(t) Φ^{-1}((s + U)/S) with s = i mod S.
+		Most of the variance of payoffs on lognormal paths comes from B_n.
+
+With strata the estimate is (1/S) sum_s (V̄_s - β (C̄_s - E[C])) where β pools the
+within-stratum covariances and the variance is n sum_s Var_s(V - β C)/(S^2 n_s).
+
+Greeks come from the same paths as the value. Since F_j is proportional to f,
+
+	delta = E[sum_j ∂V/∂F_j F_j/f]  (pathwise)
+	vega = E[sum_j ∂V/∂F_j F_j (B_j - σ t_j)]  (pathwise)
+	gamma = E[delta_pw (B_1/(f σ Δt) - 1/f)]  (likelihood ratio)
+
+where B_1/(f σ Δt) is the score of the density of F_1 with respect to f.
+Applying the likelihood ratio to the pathwise delta instead of the payoff
+keeps gamma finite for kinked payoffs with much lower variance.
+
+Paths run in rounds of parallel batches. With a tolerance or time budget the
+value simulation stops after the first round that meets it, so the number of
+paths is set by the payoff instead of the worst case. The estimate after each
+round is kept as a convergence trace.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <execution>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "fsl_black.h"
+#include "fsl_monte.h"
+
+namespace fsl {
+
+	struct lognormal_monte {
+		double f = 100; // initial forward
+		double sigma = 0.2; // volatility
+		double t = 1; // time to expiry in years
+		size_t steps = 1; // number of fixings
+		bool antithetic = false; // average each path with its reflection
+		bool control = false; // use the put at expiry as a control variate
+		double k = 100; // control put strike
+		size_t strata = 1; // strata for the terminal Brownian value
+		size_t batch = 1024; // paths per batch
+		size_t round = 64; // batches per parallel round
+		double tolerance = 0; // stop when the standard error of the value is at most tolerance
+		double seconds = std::numeric_limits<double>::infinity(); // time budget for the value
+
+		// Undiscounted payoff given fixings F_1, ..., F_n.
+		using payoff = std::function<double(size_t, const double*)>;
+		// Undiscounted payoff given fixings that also sets its gradient dF.
+		using payoff_gradient = std::function<double(size_t, const double*, double*)>;
+
+		struct result {
+			size_t n = 0; // number of samples
+			double mean = 0; // estimated value
+			double variance = 0; // n times the variance of the estimate
+			double beta = 0; // control variate coefficient
+			std::vector<monte_point> trace; // estimate after each round
+			double error() const
+			{
+				return n ? std::sqrt(variance / n) : 0;
+			}
+			// Normal confidence interval with coverage p.
+			std::pair<double, double> interval(double p = 0.95) const
+			{
+				const double z = normal_quantile((1 + p) / 2);
+
+				return { mean - z * error(), mean + z * error() };
+			}
+		};
+
+		// Brownian values B_1, ..., B_n with B_n = sqrt(t) Φ^{-1}(u).
+		template<class G>
+		void brownian(G& g, double u, double* B) const
+		{
+			std::normal_distribution<double> Z;
+			const double dt = t / steps;
+			B[steps - 1] = std::sqrt(t) * normal_quantile(u);
+			for (size_t j = steps - 1; j > 0; --j) {
+				const double r = double(j) / (j + 1);
+				B[j - 1] = r * B[j] + std::sqrt(dt * r) * Z(g);
+			}
+		}
+
+		// Fixings F_j = f exp(σ B_j - σ^2 t_j/2).
+		const double* fixings(const double* B, double* F) const
+		{
+			const double dt = t / steps;
+			for (size_t j = 0; j < steps; ++j) {
+				F[j] = f * std::exp(sigma * B[j] - sigma * sigma * (j + 1) * dt / 2);
+			}
+
+			return F;
+		}
+
+		// Payoff and control on the fixings of B.
+		std::pair<double, double> sample(const payoff& v, const double* B, double* F) const
+		{
+			fixings(B, F);
+
+			return { v(steps, F), std::max(k - F[steps - 1], 0.) };
+		}
+
+		// Undiscounted value and pathwise greeks.
+		struct greeks {
+			result value, delta, gamma, vega;
+		};
+
+		// Simulate at most paths in parallel batches. Batch b uses a generator seeded by (seed, b)
+		// and batches are merged in order so results do not depend on the number of threads.
+		// Stop after the first round with standard error at most tolerance or past the time budget
+		// once every stratum has at least two paths.
+		result simulate(const payoff& v, size_t paths, uint64_t seed = 0) const
+		{
+			check(paths);
+			const auto start = std::chrono::steady_clock::now();
+			const size_t nb = (paths + batch - 1) / batch;
+			std::vector<control_variate> cv(strata);
+			std::vector<monte_point> trace;
+			result res;
+			for (size_t b0 = 0; b0 < nb; b0 += round) {
+				batches(b0, std::min(b0 + round, nb), paths, seed, cv, [&](double* B, double* F, control_variate& c) {
+					auto [x, y] = sample(v, B, F);
+					if (antithetic) {
+						reflect(B);
+						auto [x_, y_] = sample(v, B, F);
+						x = (x + x_) / 2;
+						y = (y + y_) / 2;
+					}
+					c.add(x, y);
+				});
+				// Strata are not comparable until each has a variance.
+				if (std::any_of(cv.begin(), cv.end(), [](const auto& c) { return c.size() < 2; })) {
+					continue;
+				}
+				res = estimate(cv);
+				const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				trace.push_back({ res.n, res.mean, res.error(), dt });
+				if (res.error() <= tolerance || dt >= seconds) {
+					break;
+				}
+			}
+			res.trace = std::move(trace);
+
+			return res;
+		}
+
+		// Value, pathwise delta and vega, and likelihood ratio gamma from the same paths.
+		// dv sets dF[j] to the derivative of the payoff with respect to F_j and returns the payoff.
+		// The control variate is not used.
+		greeks simulate(const payoff_gradient& dv, size_t paths, uint64_t seed = 0) const
+		{
+			check(paths);
+			std::vector<greek_accumulator> ga(strata);
+			batches(0, (paths + batch - 1) / batch, paths, seed, ga, [&](double* B, double* F, greek_accumulator& a) {
+				std::vector<double>& dF = a.dF;
+				dF.resize(steps);
+				auto x = sample(dv, B, F, dF.data());
+				if (antithetic) {
+					reflect(B);
+					auto x_ = sample(dv, B, F, dF.data());
+					for (size_t q = 0; q < 4; ++q) {
+						x[q] = (x[q] + x_[q]) / 2;
+					}
+				}
+				for (size_t q = 0; q < 4; ++q) {
+					a.w[q].add(x[q]);
+				}
+			});
+
+			greeks res;
+			result* r[] = { &res.value, &res.delta, &res.gamma, &res.vega };
+			std::vector<welford> w(strata);
+			for (size_t q = 0; q < 4; ++q) {
+				for (size_t s = 0; s < strata; ++s) {
+					w[s] = ga[s].w[q];
+				}
+				*r[q] = estimate(w);
+			}
+
+			return res;
+		}
+
+	private:
+		// Every stratum needs two paths to estimate its variance.
+		void check(size_t paths) const
+		{
+			if (paths < 2 * strata) {
+				throw std::invalid_argument("lognormal_monte: need at least two paths per stratum");
+			}
+		}
+
+		struct greek_accumulator {
+			welford w[4]; // value, delta, gamma, vega
+			std::vector<double> dF; // payoff gradient scratch
+			greek_accumulator& merge(const greek_accumulator& a)
+			{
+				for (size_t q = 0; q < 4; ++q) {
+					w[q].merge(a.w[q]);
+				}
+
+				return *this;
+			}
+		};
+
+		void reflect(double* B) const
+		{
+			for (size_t j = 0; j < steps; ++j) {
+				B[j] = -B[j];
+			}
+		}
+
+		// Value, delta, gamma, and vega samples on the fixings of B.
+		// dF_j/df = F_j/f, dF_j/dσ = F_j (B_j - σ t_j), and the score of the first
+		// fixing for f is B_1/(f σ Δt) so gamma = E[delta (score - 1/f)].
+		std::array<double, 4> sample(const payoff_gradient& dv, const double* B, double* F, double* dF) const
+		{
+			const double dt = t / steps;
+			std::array<double, 4> x;
+			x[0] = dv(steps, fixings(B, F), dF);
+			double delta = 0, vega = 0;
+			for (size_t j = 0; j < steps; ++j) {
+				delta += dF[j] * F[j];
+				vega += dF[j] * F[j] * (B[j] - sigma * (j + 1) * dt);
+			}
+			x[1] = delta / f;
+			x[2] = x[1] * (B[0] / (sigma * dt) - 1) / f;
+			x[3] = vega;
+
+			return x;
+		}
+
+		// Accumulate batches [b0, b1) of the first paths into acc[s] for stratum s.
+		// Batches run in parallel rounds with separate accumulators merged in batch order.
+		template<class A, class P>
+		void batches(size_t b0, size_t b1, size_t paths, uint64_t seed, std::vector<A>& acc, const P& path) const
+		{
+			if (steps == 0 || strata == 0 || batch == 0 || round == 0 || !(sigma > 0) || !(t > 0) || !(f > 0)) {
+				throw std::invalid_argument("lognormal_monte: steps, strata, batch, round, f, sigma, and t must be positive");
+			}
+			const size_t S = strata;
+			std::vector<A> ab(round * S);
+			std::vector<size_t> b_(round);
+			for (; b0 < b1; b0 += round) {
+				const size_t nr = std::min(round, b1 - b0);
+				for (size_t i = 0; i < nr; ++i) {
+					b_[i] = b0 + i;
+				}
+				std::fill(ab.begin(), ab.end(), A{});
+				std::for_each(std::execution::par, b_.begin(), b_.begin() + nr, [&](size_t b) {
+					std::seed_seq ss{ seed, static_cast<uint64_t>(b) };
+					std::mt19937_64 g(ss);
+					std::uniform_real_distribution<double> U;
+					std::vector<double> B(steps), F(steps);
+					A* a = ab.data() + (b - b0) * S;
+					const size_t i1 = std::min((b + 1) * batch, paths);
+					for (size_t i = b * batch; i < i1; ++i) {
+						const size_t s = i % S;
+						double u;
+						do {
+							u = (s + U(g)) / S;
+						} while (u <= 0 || u >= 1);
+						brownian(g, u, B.data());
+						path(B.data(), F.data(), a[s]);
+					}
+				});
+				for (size_t i = 0; i < nr * S; ++i) {
+					acc[i % S].merge(ab[i]);
+				}
+			}
+		}
+
+		// Combine strata with the control variate if used. Every stratum must have samples.
+		result estimate(const std::vector<control_variate>& cv) const
+		{
+			result res;
+			const double Ec = black_put_value(f, sigma * std::sqrt(t), k);
+			if (control) {
+				double sxc = 0, scc = 0;
+				for (const auto& c : cv) {
+					sxc += c.size() * c.covariance();
+					scc += c.size() * c.control_variance();
+				}
+				res.beta = scc > 0 ? sxc / scc : 0;
+			}
+			double var = 0;
+			for (const auto& c : cv) {
+				res.n += c.size();
+				res.mean += c.mean(Ec, res.beta) / strata;
+				var += c.variance(res.beta) / (double(strata) * strata * c.size());
+			}
+			res.variance = res.n * var;
+
+			return res;
+		}
+		result estimate(const std::vector<welford>& w) const
+		{
+			result res;
+			double var = 0;
+			for (const auto& c : w) {
+				res.n += c.size();
+				res.mean += c.mean() / strata;
+				var += c.variance() / (double(strata) * strata * c.size());
+			}
+			res.variance = res.n * var;
+
+			return res;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_lognormal_monte()
+	{
+		const auto put = [](size_t n, const double* F) { return std::max(100 - F[n - 1], 0.); };
+		const auto asian = [](size_t n, const double* F) {
+			double a = 0;
+			for (size_t j = 0; j < n; ++j) {
+				a += F[j];
+			}
+			return std::max(100 - a / n, 0.);
+		};
+		{
+			// the put is its own control
+			lognormal_monte m;
+			m.steps = 4;
+			m.control = true;
+			auto r = m.simulate(put, 10'000, 1);
+			assert(r.n == 10'000);
+			assert(std::fabs(r.beta - 1) < 1e-12);
+			assert(std::fabs(r.mean - black_put_value(100., 0.2, 100.)) < 1e-12);
+		}
+		{
+			lognormal_monte m;
+			const double p = black_put_value(100., 0.2, 100.);
+			auto r = m.simulate(put, 100'000, 1);
+			assert(std::fabs(r.mean - p) < 4 * r.error());
+			m.strata = 64;
+			auto rs = m.simulate(put, 100'000, 1);
+			assert(std::fabs(rs.mean - p) < 4 * rs.error());
+			assert(rs.variance < r.variance / 50);
+		}
+		{
+			// arithmetic Asian put with monthly fixings
+			lognormal_monte m;
+			m.steps = 12;
+			auto r = m.simulate(asian, 100'000, 1);
+			m.antithetic = true;
+			auto ra = m.simulate(asian, 100'000, 2);
+			assert(ra.variance < r.variance / 2);
+			m.control = true;
+			auto rc = m.simulate(asian, 100'000, 3);
+			assert(rc.variance < ra.variance / 1.5);
+			m.strata = 64;
+			auto rs = m.simulate(asian, 100'000, 4);
+			assert(rs.variance < r.variance / 5);
+			assert(std::fabs(r.mean - rs.mean) < 4 * std::hypot(r.error(), rs.error()));
+			assert(std::fabs(rc.mean - rs.mean) < 4 * std::hypot(rc.error(), rs.error()));
+
+			// same seed, same result
+			auto rs_ = m.simulate(asian, 100'000, 4);
+			assert(rs_.mean == rs.mean && rs_.variance == rs.variance);
+		}
+		{
+			// stop once the standard error reaches the target
+			lognormal_monte m;
+			m.steps = 12;
+			m.antithetic = true;
+			m.control = true;
+			m.strata = 64;
+			m.batch = 256;
+			m.round = 8;
+			m.tolerance = 0.005;
+			auto r = m.simulate(asian, 10'000'000, 7);
+			assert(r.error() <= m.tolerance);
+			assert(r.n < 1'000'000 && r.n % (m.batch * m.round) == 0);
+			assert(r.trace.size() == r.n / (m.batch * m.round));
+			assert(r.trace.back().n == r.n && r.trace.back().mean == r.mean);
+			assert(r.trace.size() == 1 || r.trace.front().error > m.tolerance);
+
+			// the same number of paths without a target gives the same estimate
+			m.tolerance = 0;
+			auto r_ = m.simulate(asian, r.n, 7);
+			assert(r_.n == r.n && r_.mean == r.mean && r_.variance == r.variance);
+
+			// time budget
+			m.seconds = 0;
+			assert(m.simulate(asian, 10'000'000, 7).trace.size() == 1);
+		}
+		{
+			// too few paths for the strata
+			lognormal_monte m;
+			m.strata = 100;
+			assert(throws<std::invalid_argument>([&] { m.simulate(put, 150); }));
+			assert(m.simulate(put, 200).n == 200);
+		}
+		{
+			// no early stop before every stratum has two paths
+			lognormal_monte m;
+			m.strata = 1024;
+			m.batch = 256;
+			m.round = 4;
+			m.tolerance = 1e-9;
+			auto res = m.simulate(put, 8192);
+			assert(res.n == 8192);
+			assert(res.trace.size() == 7);
+			assert(res.trace[0].n == 2048);
+			m.tolerance = 1;
+			res = m.simulate(put, 8192);
+			assert(res.n == 2048);
+			assert(res.trace.size() == 1);
+		}
+		{
+			// greeks of a put against closed form
+			const auto dput = [](size_t n, const double* F, double* dF) {
+				std::fill(dF, dF + n, 0.);
+				dF[n - 1] = F[n - 1] < 100 ? -1 : 0;
+				return std::max(100 - F[n - 1], 0.);
+			};
+			lognormal_monte m;
+			m.antithetic = true;
+			m.strata = 16;
+			auto g = m.simulate(dput, 100'000, 5);
+			const double s = 0.2;
+			assert(std::fabs(g.value.mean - black_put_value(100., s, 100.)) < 4 * g.value.error());
+			assert(std::fabs(g.delta.mean - black_put_delta(100., s, 100.)) < 4 * g.delta.error());
+			assert(std::fabs(g.gamma.mean - black_put_gamma(100., s, 100.)) < 4 * g.gamma.error());
+			assert(std::fabs(g.vega.mean - black_put_vega(100., s, 100.)) < 4 * g.vega.error());
+			auto [lo, hi] = g.delta.interval(0.99);
+			assert(lo < g.delta.mean && g.delta.mean < hi);
+
+			// path dependent greeks agree with bumped reruns on common random numbers
+			const auto dasian = [](size_t n, const double* F, double* dF) {
+				double a = 0;
+				for (size_t j = 0; j < n; ++j) {
+					a += F[j];
+				}
+				for (size_t j = 0; j < n; ++j) {
+					dF[j] = a < 100 * n ? -1. / n : 0;
+				}
+				return std::max(100 - a / n, 0.);
+			};
+			m.steps = 12;
+			auto ga = m.simulate(dasian, 100'000, 6);
+			const auto value = [&](double f, double sigma) {
+				lognormal_monte m_ = m;
+				m_.f = f;
+				m_.sigma = sigma;
+				return m_.simulate(asian, 100'000, 6).mean;
+			};
+			const double h = 0.5, e = 1e-4;
+			const double v0 = value(100, 0.2), vu = value(100 + h, 0.2), vd = value(100 - h, 0.2);
+			assert(std::fabs(ga.value.mean - v0) < 1e-12);
+			assert(std::fabs(ga.delta.mean - (vu - vd) / (2 * h)) < 1e-3);
+			assert(std::fabs(ga.vega.mean - (value(100, 0.2 + e) - value(100, 0.2 - e)) / (2 * e)) < 1e-2);
+			assert(std::fabs(ga.gamma.mean - (vu - 2 * v0 + vd) / (h * h)) < 4 * ga.gamma.error() + 2e-3);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -1,5 +1,6 @@
 // fsl_math.h - Constexpr math functions
 #pragma once
+#include <type_traits>
 
 namespace fsl {
 	template<class X>
@@ -9,6 +10,24 @@ namespace fsl {
 	template<class X>
 	constexpr X infinity = std::numeric_limits<X>::infinity();
 
+	// Type kernels compute in for arguments of types A..., with integral types promoted to double.
+	template<class... A>
+	using real_t = std::conditional_t<std::is_integral_v<std::common_type_t<A...>>, double, std::common_type_t<A...>>;
+
+	// True if f() throws E. Used by tests.
+	template<class E, class F>
+	inline bool throws(const F& f)
+	{
+		try {
+			f();
+		}
+		catch (const E&) {
+			return true;
+		}
+
+		return false;
+	}
+
 	template<class X>
 	constexpr bool is_nan(X x)
 	{
@@ -1,8 +1,19 @@
 // fsl_monte.h - Header file for Monte Carlo methods
 #pragma once
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
 #include <functional>
 #include <initializer_list>
+#include <limits>
+#include <random>
+#include <stdexcept>
 #include <tuple>
+#include <vector>
+#include "fsl_math.h"
 
 namespace fsl {
 
@@ -38,7 +49,347 @@ namespace fsl {
 
 		return { m, s2 - m * m };
 	}
+
+	// Antithetic estimate. f returns the variate at a draw and at its reflection,
+	// e.g. at Z and -Z, and their average is one sample.
+	// Return sample mean and variance of the average so the standard error is sqrt(variance/N).
+	inline std::pair<double, double> monte_antithetic(const std::function<std::pair<double, double>()>& f, int N)
+	{
+		return monte([&f]() { auto [x, x_] = f(); return (x + x_) / 2; }, N);
+	}
+
+	// Running mean and centered sum of squares of a variate.
+	// Welford, Technometrics, 1962. Accumulators from separate runs can be merged.
+	class welford {
+		size_t n_ = 0;
+		double m_ = 0; // mean
+		double s_ = 0; // centered sum of squares
+	public:
+		void add(double x)
+		{
+			++n_;
+			const double d = x - m_;
+			m_ += d / n_;
+			s_ += d * (x - m_);
+		}
+		welford& merge(const welford& w)
+		{
+			if (w.n_ == 0) {
+				return *this;
+			}
+			const double n = double(n_ + w.n_);
+			const double d = w.m_ - m_;
+			s_ += w.s_ + d * d * (double(n_) * w.n_ / n);
+			m_ += d * w.n_ / n;
+			n_ += w.n_;
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return n_;
+		}
+		double mean() const
+		{
+			return m_;
+		}
+		// Population variance.
+		double variance() const
+		{
+			return n_ ? s_ / n_ : 0;
+		}
+		// Standard error of the mean.
+		double error() const
+		{
+			return n_ ? std::sqrt(s_ / n_ / n_) : 0;
+		}
+	};
+
+	// Running means and centered sums of squares and cross products of a variate X
+	// and a control C with known mean. Accumulators from separate runs can be merged.
+	// Chan, Golub, and LeVeque, The American Statistician, 1983.
+	class control_variate {
+		size_t n_ = 0;
+		double mx = 0, mc = 0; // means
+		double sxx = 0, scc = 0, sxc = 0; // centered sums
+	public:
+		void add(double x, double c)
+		{
+			++n_;
+			const double dx = x - mx;
+			const double dc = c - mc;
+			mx += dx / n_;
+			mc += dc / n_;
+			sxx += dx * (x - mx);
+			scc += dc * (c - mc);
+			sxc += dx * (c - mc);
+		}
+		control_variate& merge(const control_variate& cv)
+		{
+			if (cv.n_ == 0) {
+				return *this;
+			}
+			const double n = double(n_ + cv.n_);
+			const double dx = cv.mx - mx;
+			const double dc = cv.mc - mc;
+			const double w = double(n_) * cv.n_ / n;
+			sxx += cv.sxx + dx * dx * w;
+			scc += cv.scc + dc * dc * w;
+			sxc += cv.sxc + dx * dc * w;
+			mx += dx * cv.n_ / n;
+			mc += dc * cv.n_ / n;
+			n_ += cv.n_;
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return n_;
+		}
+		double mean() const
+		{
+			return mx;
+		}
+		double control_mean() const
+		{
+			return mc;
+		}
+		// Population covariance of X and C.
+		double covariance() const
+		{
+			return n_ ? sxc / n_ : 0;
+		}
+		// Population variance of C.
+		double control_variance() const
+		{
+			return n_ ? scc / n_ : 0;
+		}
+		// Optimal coefficient Cov(X, C)/Var(C).
+		double beta() const
+		{
+			return scc > 0 ? sxc / scc : 0;
+		}
+		// Mean of X - b (C - E[C]).
+		double mean(double Ec, double b) const
+		{
+			return mx - b * (mc - Ec);
+		}
+		// Variance of X - b (C - E[C]).
+		double variance(double b) const
+		{
+			return n_ ? (sxx - 2 * b * sxc + b * b * scc) / n_ : 0;
+		}
+		double variance() const
+		{
+			return variance(beta());
+		}
+	};
+
+	// Control variate estimate of E[X]. f returns a sample of X and of a control C with E[C] = Ec.
+	// The coefficient is estimated from the same samples.
+	// Return mean and variance of X - beta (C - E[C]) so the standard error is sqrt(variance/N).
+	inline std::pair<double, double> monte_control(const std::function<std::pair<double, double>()>& f, double Ec, int N)
+	{
+		control_variate cv;
+		for (int n = 1; n <= N; ++n) {
+			auto [x, c] = f();
+			cv.add(x, c);
+		}
+		const double b = cv.beta();
+
+		return { cv.mean(Ec, b), cv.variance(b) };
+	}
+
+	// Stratified estimate of E[f(U)] for U uniform on (0, 1) using S equally likely strata
+	// [s/S, (s + 1)/S) and N samples allocated in rotation. g is a uniform random bit generator.
+	// Every stratum needs two samples to estimate its variance so N must be at least 2S.
+	// Return mean and N times the variance of the mean so the standard error is sqrt(variance/N).
+	template<class G>
+	inline std::pair<double, double> monte_stratified(const std::function<double(double)>& f, int N, int S, G& g)
+	{
+		if (S < 1 || N < 2 * S) {
+			throw std::invalid_argument("monte_stratified: need at least two samples per stratum");
+		}
+		std::uniform_real_distribution<double> U;
+		std::vector<double> m(S), s2(S);
+		std::vector<int> n(S);
+		for (int i = 0; i < N; ++i) {
+			const int s = i % S;
+			const double x = f((s + U(g)) / S);
+			std::tie(m[s], s2[s]) = monte_step(x, ++n[s], m[s], s2[s]);
+		}
+		double mean = 0, var = 0;
+		for (int s = 0; s < S; ++s) {
+			mean += m[s] / S;
+			var += (s2[s] - m[s] * m[s]) / (double(S) * S * n[s]);
+		}
+
+		return { mean, N * var };
+	}
+
+	// Convergence trace point.
+	struct monte_point {
+		size_t n; // number of samples
+		double mean;
+		double error; // standard error of the mean
+		double seconds; // elapsed time
+	};
+
+	// Run rounds of parallel batches until the standard error is at most tolerance,
+	// samples have been drawn, or the time budget is used. Batch b uses a generator seeded
+	// by (seed, b) and batches are merged in order so the result for a given number of
+	// samples does not depend on the number of threads.
+	struct monte_target {
+		double tolerance = 0; // standard error target
+		size_t samples = 1'000'000; // maximum number of samples
+		double seconds = std::numeric_limits<double>::infinity(); // time budget
+		size_t batch = 1024; // samples per batch
+		size_t round = 64; // batches per parallel round
+
+		// f(g) returns a sample using the generator g.
+		template<class F>
+		welford run(const F& f, uint64_t seed = 0, std::vector<monte_point>* trace = nullptr) const
+		{
+			return accumulate(f, welford{}, seed, trace);
+		}
+
+		// Accumulate samples into copies of the empty accumulator a, e.g. a sketch from fsl_quantile.h.
+		// A needs add, merge, size, mean, and error.
+		template<class F, class A>
+		A accumulate(const F& f, const A& a, uint64_t seed = 0, std::vector<monte_point>* trace = nullptr) const
+		{
+			if (batch == 0 || round == 0) {
+				throw std::invalid_argument("monte_target: batch and round must be positive");
+			}
+			const auto start = std::chrono::steady_clock::now();
+			const size_t nb = (samples + batch - 1) / batch;
+			std::vector<A> w(round, a);
+			std::vector<size_t> b_(round);
+			A res = a;
+			for (size_t b0 = 0; b0 < nb; b0 += round) {
+				const size_t nr = std::min(round, nb - b0);
+				for (size_t i = 0; i < nr; ++i) {
+					b_[i] = b0 + i;
+				}
+				std::for_each(std::execution::par, b_.begin(), b_.begin() + nr, [&](size_t b) {
+					std::seed_seq ss{ seed, static_cast<uint64_t>(b) };
+					std::mt19937_64 g(ss);
+					A& wb = w[b - b0];
+					wb = a;
+					const size_t i1 = std::min((b + 1) * batch, samples);
+					for (size_t i = b * batch; i < i1; ++i) {
+						wb.add(f(g));
+					}
+				});
+				for (size_t i = 0; i < nr; ++i) {
+					res.merge(w[i]);
+				}
+				const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (trace) {
+					trace->push_back({ res.size(), res.mean(), res.error(), dt });
+				}
+				if ((res.size() >= 2 && res.error() <= tolerance) || dt >= seconds) {
+					break;
+				}
+			}
+
+			return res;
+		}
+	};
+
 #ifdef _DEBUG
+	inline int test_monte_target()
+	{
+		const auto f = [](std::mt19937_64& g) { return std::exp(std::normal_distribution<double>{}(g)); };
+		monte_target m;
+		m.tolerance = 0.01;
+		m.batch = 256;
+		m.round = 16;
+		std::vector<monte_point> trace;
+		auto w = m.run(f, 1, &trace);
+		// Var[exp(Z)] = e(e - 1) so about 47,000 samples are needed
+		assert(w.error() <= m.tolerance);
+		assert(w.size() < 100'000 && w.size() % (m.batch * m.round) == 0);
+		assert(std::fabs(w.mean() - std::exp(0.5)) < 4 * w.error());
+		assert(trace.size() == w.size() / (m.batch * m.round));
+		assert(trace.back().n == w.size() && trace.back().error == w.error());
+		for (size_t i = 1; i < trace.size(); ++i) {
+			assert(trace[i].n > trace[i - 1].n);
+			assert(trace[i].seconds >= trace[i - 1].seconds);
+		}
+
+		// same seed, same result, and a longer run extends the same samples
+		auto w_ = m.run(f, 1);
+		assert(w_.mean() == w.mean() && w_.variance() == w.variance());
+		m.tolerance = 0;
+		m.samples = 1000;
+		auto w1 = m.run(f, 1);
+		assert(w1.size() == 1000);
+
+		// time budget stops after the first round
+		m.samples = 1'000'000;
+		m.seconds = 0;
+		assert(m.run(f, 1).size() == m.batch * m.round);
+
+		return 0;
+	}
+
+	inline int test_monte_reduction()
+	{
+		std::default_random_engine dre;
+		std::normal_distribution<double> Z;
+		const int N = 100'000;
+		// E[exp(Z)] = exp(1/2)
+		const double ex = std::exp(0.5);
+		auto [m, v] = monte([&]() { return std::exp(Z(dre)); }, N);
+		assert(std::fabs(m - ex) < 4 * std::sqrt(v / N));
+		{
+			auto [ma, va] = monte_antithetic([&]() { double z = Z(dre); return std::pair{ std::exp(z), std::exp(-z) }; }, N);
+			assert(std::fabs(ma - ex) < 4 * std::sqrt(va / N));
+			assert(va < v / 2);
+		}
+		{
+			// control 1 + Z + Z^2/2 with mean 3/2
+			auto [mc, vc] = monte_control([&]() { double z = Z(dre); return std::pair{ std::exp(z), 1 + z + z * z / 2 }; }, 1.5, N);
+			assert(std::fabs(mc - ex) < 4 * std::sqrt(vc / N));
+			assert(vc < v / 5);
+
+			// merging matches a single pass
+			welford wa, wb, wc;
+			for (int i = 0; i < 100; ++i) {
+				double x = Z(dre);
+				(i < 63 ? wa : wb).add(x);
+				wc.add(x);
+			}
+			wa.merge(wb).merge(welford{});
+			assert(wa.size() == 100);
+			assert(std::fabs(wa.mean() - wc.mean()) < 1e-15);
+			assert(std::fabs(wa.variance() - wc.variance()) < 1e-14);
+
+			control_variate a, b, c;
+			for (int i = 0; i < 100; ++i) {
+				double z = Z(dre);
+				(i < 37 ? a : b).add(std::exp(z), z);
+				c.add(std::exp(z), z);
+			}
+			a.merge(b);
+			assert(a.size() == c.size());
+			assert(std::fabs(a.mean(0, a.beta()) - c.mean(0, c.beta())) < 1e-12);
+			assert(std::fabs(a.variance() - c.variance()) < 1e-12);
+		}
+		{
+			// E[exp(U)] = e - 1
+			auto [m1, v1] = monte_stratified([](double u) { return std::exp(u); }, N, 1, dre);
+			auto [ms, vs] = monte_stratified([](double u) { return std::exp(u); }, N, 100, dre);
+			assert(std::fabs(m1 - (std::exp(1) - 1)) < 4 * std::sqrt(v1 / N));
+			assert(std::fabs(ms - (std::exp(1) - 1)) < 4 * std::sqrt(vs / N));
+			assert(vs < v1 / 1000);
+
+			assert(throws<std::invalid_argument>([&] { monte_stratified([](double u) { return u; }, 10, 100, dre); }));
+		}
+
+		return 0;
+	}
 	static_assert(monte({ -1, 1 }) == std::make_tuple(0, 1));
 	static_assert(monte({ 1, 2, 3 }) == std::make_tuple(2, .6666666666666661));
 #endif // _DEBUG
@@ -1,19 +1,27 @@
 // fsl_normal.h - Header file for random variate generation
+// Kernels compute in real_t of their argument types so integral arguments are promoted to double.
 #pragma once
 #include <cassert>
 #include <cmath>
+#include <limits>
 #include <numbers>
 #include <random>
+#include "fsl_math.h"
 #include "fsl_monte.h"
 
 namespace fsl
 {
 	// Standard normal cumulative distribution function P(Z <= z).
 	// https://en.wikipedia.org/wiki/Error_function#Cumulative_distribution_function
-	inline double normal_cdf(double z)
+	// For X = float the absolute error is less than 1e-7.
+	template<class Z, class X = real_t<Z>>
+	inline X normal_cdf(Z z_)
 	{
+		const X z(z_);
+		using std::erf;
+
 		// Cumulative distribution function for the standard normal distribution
-		return 0.5 * (1 + std::erf(z / std::sqrt(2)));
+		return X(0.5) * (1 + erf(z / X(std::numbers::sqrt2)));
 	}
 	inline int test_normal_cdf()
 	{
@@ -33,14 +41,82 @@ namespace fsl
 	}
 
 	// Standard normal probability density function.
-	inline double normal_pdf(double z)
+	// For X = float the absolute error is less than 5e-8.
+	template<class Z, class X = real_t<Z>>
+	inline X normal_pdf(Z z_)
 	{
-		return std::exp(-0.5 * z * z) / std::sqrt(2 * std::numbers::pi);
+		const X z(z_);
+		using std::exp;
+
+		return exp(X(-0.5) * z * z) / X(std::sqrt(2 * std::numbers::pi));
 	}
 	inline int test_normal_pdf()
 	{
 		{
 			assert(normal_pdf(0) == 1 / std::sqrt(2 * std::numbers::pi));
+			assert(normal_cdf(1) == normal_cdf(1.));
+		}
+
+		return 0;
+	}
+
+	// Inverse of the standard normal cumulative distribution function.
+	// Acklam's rational approximation followed by one Halley step.
+	// https://web.archive.org/web/20151030215612/http://home.online.no/~pjacklam/notes/invnorm/
+	template<class P, class X = real_t<P>>
+	inline X normal_quantile(P p_)
+	{
+		const X p(p_);
+		using std::sqrt, std::log, std::exp, std::erfc;
+
+		if (!(0 < p && p < 1)) {
+			return p == 0 ? -std::numeric_limits<X>::infinity()
+				: p == 1 ? std::numeric_limits<X>::infinity()
+				: std::numeric_limits<X>::quiet_NaN();
+		}
+
+		static const X a[] = { X(-3.969683028665376e+01), X(2.209460984245205e+02), X(-2.759285104469687e+02),
+			X(1.383577518672690e+02), X(-3.066479806614716e+01), X(2.506628277459239e+00) };
+		static const X b[] = { X(-5.447609879822406e+01), X(1.615858368580409e+02), X(-1.556989798598866e+02),
+			X(6.680131188771972e+01), X(-1.328068155288572e+01) };
+		static const X c[] = { X(-7.784894002430293e-03), X(-3.223964580411365e-01), X(-2.400758277161838e+00),
+			X(-2.549732539343734e+00), X(4.374664141464968e+00), X(2.938163982698783e+00) };
+		static const X d[] = { X(7.784695709041462e-03), X(3.224671290700398e-01), X(2.445134137142996e+00),
+			X(3.754408661907416e+00) };
+		const X plow = X(0.02425);
+
+		X x;
+		if (p < plow || 1 - p < plow) {
+			const X q = sqrt(-2 * log(p < plow ? p : 1 - p));
+			x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5])
+				/ ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+			if (p >= plow) {
+				x = -x;
+			}
+		}
+		else {
+			const X q = p - X(0.5);
+			const X r = q * q;
+			x = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q
+				/ (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+		}
+		// Halley step on P(Z <= x) - p using erfc for accuracy in the lower tail
+		const X e = X(0.5) * erfc(-x / X(std::numbers::sqrt2)) - p;
+		const X u = e * X(std::sqrt(2 * std::numbers::pi)) * exp(x * x / 2);
+
+		return x - u / (1 + x * u / 2);
+	}
+	inline int test_normal_quantile()
+	{
+		{
+			assert(normal_quantile(0.5) == 0);
+			for (double p : { 1e-10, 1e-4, 0.01, 0.02425, 0.1, 0.3, 0.7, 0.9, 0.99, 1 - 1e-4 }) {
+				double x = normal_quantile(p);
+				assert(std::fabs(0.5 * std::erfc(-x / std::numbers::sqrt2) - p) < 1e-14 * p);
+				assert(p < 1e-8 || std::fabs(normal_quantile(1 - p) + x) < 1e-10); // 1 - p is inexact
+			}
+			assert(normal_quantile(0.) == -std::numeric_limits<double>::infinity());
+			assert(std::isnan(normal_quantile(2.)));
 		}
 
 		return 0;
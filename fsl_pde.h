@@ -0,0 +1,436 @@
+// fsl_pde.h - Crank-Nicolson finite differences for Black-Scholes/Merton
+/*
+The value V(τ, S) with time to expiry τ satisfies
+
+	V_τ = σ^2 S^2/2 V_SS + (r - q) S V_S - r V = L V.
+
+The S grid S(ξ) = k + α sinh(c ξ + d(1 - ξ)) for uniform ξ in [0, 1] runs
+from S_0 to S_{n-1} and concentrates nodes near the strike. The derivatives
+use the three point Lagrange stencil on the non-uniform grid. Each time step
+solves the θ scheme
+
+	(I - θ Δτ L) V^{j+1} = (I + (1 - θ) Δτ L) V^j
+
+with Dirichlet values at both ends. Crank-Nicolson (θ = 1/2) is second order
+but rings on the payoff kink, so the first steps are Rannacher smoothed by
+replacing each with two fully implicit (θ = 1) half steps.
+
+Barriers are knock out with no rebate. The grid ends at the barrier where
+V = 0. Otherwise the grid ends far from the strike where V is the discounted
+intrinsic value.
+
+Early exercise uses Brennan-Schwartz. Calls are stored on a decreasing grid
+so the exercise region is always at the start. Elimination runs from the end
+of the grid and back substitution from the start applies max(V, payoff)
+as it goes. This is exact for puts and calls with one exercise boundary.
+
+Many options are solved together. Every grid has n nodes and the nodes of the
+m options are interleaved, x[i * m + j], so the Thomas sweeps run over options
+in the inner loop and vectorize. Blocks of options run in parallel.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "fsl_math.h"
+#ifdef _DEBUG
+#include "fsl_bsm.h"
+#endif // _DEBUG
+
+namespace fsl::pde {
+
+	// n nodes from s0 to s1 concentrated at k with stretch α (smaller is more concentrated).
+	template<class X = double>
+	inline std::vector<X> sinh_grid(size_t n, X s0, X s1, X k, X alpha)
+	{
+		if (n < 3 || !(s0 < s1) || !(alpha > 0)) {
+			throw std::invalid_argument("sinh_grid: need n >= 3, s0 < s1, and alpha > 0");
+		}
+		const X c = std::asinh((s1 - k) / alpha);
+		const X d = std::asinh((s0 - k) / alpha);
+		std::vector<X> s(n);
+		for (size_t i = 0; i < n; ++i) {
+			const X xi = X(i) / (n - 1);
+			s[i] = k + alpha * std::sinh(c * xi + d * (1 - xi));
+		}
+		s.front() = s0;
+		s.back() = s1;
+
+		return s;
+	}
+
+	// Solve m interleaved tridiagonal systems a_i x_{i-1} + b_i x_i + c_i x_{i+1} = d_i, i < n,
+	// by eliminating from the end. If v is not null then x_i = max(x_i, v_i) during back substitution.
+	// The solution overwrites d and w is scratch of size n m.
+	template<class X = double>
+	inline void thomas(size_t n, size_t m, const X* a, const X* b, const X* c, X* d, X* w, const X* v = nullptr)
+	{
+		// w_i = b_i - c_i a_{i+1}/w_{i+1}, d_i -= c_i d_{i+1}/w_{i+1}
+		for (size_t j = 0; j < m; ++j) {
+			w[(n - 1) * m + j] = b[(n - 1) * m + j];
+		}
+		for (size_t i = n - 1; i-- > 0; ) {
+			const size_t o = i * m;
+			for (size_t j = 0; j < m; ++j) {
+				const X e = c[o + j] / w[o + m + j];
+				w[o + j] = b[o + j] - e * a[o + m + j];
+				d[o + j] -= e * d[o + m + j];
+			}
+		}
+		// x_i = (d_i - a_i x_{i-1})/w_i
+		for (size_t j = 0; j < m; ++j) {
+			d[j] /= w[j];
+		}
+		if (v) {
+			for (size_t j = 0; j < m; ++j) {
+				d[j] = std::max(d[j], v[j]);
+			}
+		}
+		for (size_t i = 1; i < n; ++i) {
+			const size_t o = i * m;
+			for (size_t j = 0; j < m; ++j) {
+				d[o + j] = (d[o + j] - a[o + j] * d[o - m + j]) / w[o + j];
+			}
+			if (v) {
+				for (size_t j = 0; j < m; ++j) {
+					d[o + j] = std::max(d[o + j], v[o + j]);
+				}
+			}
+		}
+	}
+
+	template<class X = double>
+	struct option {
+		X s; // spot
+		X k; // strike
+		X r; // interest rate
+		X q; // dividend yield
+		X sigma; // volatility
+		X t; // expiry
+		bool call = false;
+		bool american = false;
+		X lower = 0; // knock out if S <= lower when lower > 0
+		X upper = infinity<X>; // knock out if S >= upper
+
+		// S = 0 is not knocked out unless a lower barrier is set.
+		bool knocked_out(X S) const
+		{
+			return (lower > 0 && S <= lower) || S >= upper;
+		}
+	};
+
+	template<class X = double>
+	struct result {
+		X value, delta, gamma, theta;
+	};
+
+	// Finite difference pricer with n space nodes and steps time steps.
+	template<class X = double>
+	struct crank_nicolson {
+		size_t n = 200; // space nodes
+		size_t steps = 100; // time steps
+		size_t rannacher = 2; // smoothed steps
+		X width = 6; // standard deviations to the far boundary
+		X stretch = X(0.1); // sinh stretch as a fraction of the grid width
+		size_t block = 32; // options per parallel block
+
+		// Price m options with the same expiry.
+		void price(size_t m, const option<X>* o, result<X>* res, bool parallel = true) const
+		{
+			if (steps == 0) {
+				throw std::invalid_argument("crank_nicolson: need at least one time step");
+			}
+			if (m == 0) {
+				return;
+			}
+			const X t = o[0].t;
+			for (size_t j = 0; j < m; ++j) {
+				if (o[j].t != t || !(t > 0) || !(o[j].sigma > 0) || !(o[j].k > 0)) {
+					throw std::invalid_argument("crank_nicolson: options need positive vol, strike, and a common positive expiry");
+				}
+				if (!(o[j].lower < o[j].s && o[j].s < o[j].upper)) {
+					throw std::invalid_argument("crank_nicolson: spot must be strictly between the barriers");
+				}
+			}
+			std::vector<size_t> b((m + block - 1) / block);
+			std::iota(b.begin(), b.end(), size_t(0));
+			const auto f = [&](size_t i) {
+				const size_t j = i * block;
+				solve(std::min(block, m - j), o + j, res + j);
+			};
+			if (parallel) {
+				std::for_each(std::execution::par, b.begin(), b.end(), f);
+			}
+			else {
+				std::for_each(b.begin(), b.end(), f);
+			}
+		}
+		result<X> price(const option<X>& o) const
+		{
+			result<X> r;
+			price(1, &o, &r, false);
+
+			return r;
+		}
+
+	private:
+		void solve(size_t m, const option<X>* o, result<X>* res) const
+		{
+			const size_t N = n * m;
+			const X T = o[0].t;
+			std::vector<X> S(N), payoff(N), V(N), V_(N), w(N);
+			std::vector<X> a(N), b(N), c(N); // L
+			std::vector<X> A(N), B(N), C(N); // I - θ Δτ L
+			for (size_t j = 0; j < m; ++j) {
+				const auto& oj = o[j];
+				const X sd = oj.sigma * std::sqrt(T);
+				const X lo = oj.lower > 0 ? oj.lower : X(0);
+				const X hi = oj.upper < infinity<X> ? oj.upper : std::max(oj.s, oj.k) * std::exp(width * sd);
+				const auto s = sinh_grid(n, lo, hi, std::clamp(oj.k, lo, hi), stretch * (hi - lo));
+				for (size_t i = 0; i < n; ++i) {
+					// calls on a decreasing grid
+					const X si = oj.call ? s[n - 1 - i] : s[i];
+					S[i * m + j] = si;
+					payoff[i * m + j] = std::max(oj.call ? si - oj.k : oj.k - si, X(0));
+				}
+				for (size_t i = 1; i + 1 < n; ++i) {
+					const X sm = S[(i - 1) * m + j], si = S[i * m + j], sp = S[(i + 1) * m + j];
+					const X hm = si - sm, hp = sp - si;
+					const X diff = oj.sigma * oj.sigma * si * si / 2;
+					const X conv = (oj.r - oj.q) * si;
+					a[i * m + j] = diff * 2 / (hm * (hm + hp)) - conv * hp / (hm * (hm + hp));
+					b[i * m + j] = -diff * 2 / (hm * hp) + conv * (hp - hm) / (hm * hp) - oj.r;
+					c[i * m + j] = diff * 2 / (hp * (hm + hp)) + conv * hm / (hp * (hm + hp));
+				}
+			}
+			// knocked out or far boundary values at both ends
+			const auto boundary = [&](X tau) {
+				for (size_t j = 0; j < m; ++j) {
+					const auto& oj = o[j];
+					for (size_t i : { size_t(0), n - 1 }) {
+						const X si = S[i * m + j];
+						X v = 0;
+						if (!oj.knocked_out(si)) {
+							const X f = si * std::exp(-oj.q * tau) - oj.k * std::exp(-oj.r * tau);
+							v = std::max(oj.call ? f : -f, X(0));
+							if (oj.american) {
+								v = std::max(v, payoff[i * m + j]);
+							}
+						}
+						V[i * m + j] = v;
+					}
+				}
+			};
+			bool american = false;
+			for (size_t j = 0; j < m; ++j) {
+				american = american || o[j].american;
+			}
+			std::vector<X> v(american ? N : 0); // exercise values, -infinity if European
+			if (american) {
+				for (size_t i = 0; i < N; ++i) {
+					v[i] = o[i % m].american ? payoff[i] : -infinity<X>;
+				}
+			}
+			const auto operator_ = [&](X theta, X dt) {
+				for (size_t i = 0; i < N; ++i) {
+					A[i] = -theta * dt * a[i];
+					B[i] = 1 - theta * dt * b[i];
+					C[i] = -theta * dt * c[i];
+				}
+				// Dirichlet
+				for (size_t j = 0; j < m; ++j) {
+					A[j] = C[j] = A[(n - 1) * m + j] = C[(n - 1) * m + j] = 0;
+					B[j] = B[(n - 1) * m + j] = 1;
+				}
+			};
+			const auto step = [&](X theta, X dt, X tau) {
+				// V_ = (I + (1 - θ) Δτ L) V
+				for (size_t i = m; i + m < N; ++i) {
+					V_[i] = V[i] + (1 - theta) * dt * (a[i] * V[i - m] + b[i] * V[i] + c[i] * V[i + m]);
+				}
+				std::swap(V, V_);
+				boundary(tau);
+				thomas(n, m, A.data(), B.data(), C.data(), V.data(), w.data(), american ? v.data() : nullptr);
+			};
+
+			// payoff averaged over the cell containing the strike
+			V = payoff;
+			for (size_t j = 0; j < m; ++j) {
+				const X k = o[j].k;
+				for (size_t i = 1; i + 1 < n; ++i) {
+					const X s0 = (S[(i - 1) * m + j] + S[i * m + j]) / 2;
+					const X s1 = (S[i * m + j] + S[(i + 1) * m + j]) / 2;
+					const X lo = std::min(s0, s1), hi = std::max(s0, s1);
+					if (lo < k && k < hi) {
+						const X e = o[j].call ? hi - k : k - lo;
+						V[i * m + j] = e * e / (2 * (hi - lo));
+					}
+				}
+				for (size_t i = 0; i < n; ++i) {
+					if (o[j].knocked_out(S[i * m + j])) {
+						V[i * m + j] = 0;
+					}
+				}
+			}
+			const X dt = T / steps;
+			const size_t smooth = std::min(rannacher, steps);
+			X tau = 0;
+			std::vector<X> U; // value one step before expiry for theta
+			if (smooth) {
+				operator_(X(1), dt / 2);
+				for (size_t k = 0; k < 2 * smooth; ++k) {
+					if (smooth == steps && k + 1 == 2 * smooth) {
+						U = V; // only smoothed steps, theta over the last half step
+					}
+					tau += dt / 2;
+					step(X(1), dt / 2, tau);
+				}
+			}
+			if (smooth < steps) {
+				operator_(X(0.5), dt);
+				for (size_t k = smooth; k < steps; ++k) {
+					if (k + 1 == steps) {
+						U = V;
+					}
+					tau += dt;
+					step(X(0.5), dt, tau);
+				}
+			}
+			const X dtau = smooth < steps ? dt : dt / 2;
+
+			// quadratic interpolation at spot
+			for (size_t j = 0; j < m; ++j) {
+				const X s = o[j].s;
+				size_t i = 1;
+				while (i + 2 < n && (o[j].call ? S[(i + 1) * m + j] > s : S[(i + 1) * m + j] < s)) {
+					++i;
+				}
+				const X x0 = S[(i - 1) * m + j], x1 = S[i * m + j], x2 = S[(i + 1) * m + j];
+				const X h0 = s - x0, h1 = s - x1, h2 = s - x2;
+				const X d0 = (x0 - x1) * (x0 - x2), d1 = (x1 - x0) * (x1 - x2), d2 = (x2 - x0) * (x2 - x1);
+				const X l[3] = { h1 * h2 / d0, h0 * h2 / d1, h0 * h1 / d2 };
+				const X dl[3] = { (h1 + h2) / d0, (h0 + h2) / d1, (h0 + h1) / d2 };
+				const X d2l[3] = { 2 / d0, 2 / d1, 2 / d2 };
+				X r[4] = { 0, 0, 0, 0 };
+				for (size_t k = 0; k < 3; ++k) {
+					const size_t ik = (i - 1 + k) * m + j;
+					r[0] += l[k] * V[ik];
+					r[1] += dl[k] * V[ik];
+					r[2] += d2l[k] * V[ik];
+					r[3] += l[k] * U[ik];
+				}
+				res[j] = result<X>{ r[0], r[1], r[2], -(r[0] - r[3]) / dtau };
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_crank_nicolson()
+	{
+		{
+			// tridiagonal solve
+			const double a[] = { 0, 1, 1, 1 }, b[] = { 4, 4, 4, 4 }, c[] = { 1, 1, 1, 0 };
+			double d[] = { 5, 6, 6, 5 }, w[4];
+			thomas<double>(4, 1, a, b, c, d, w);
+			for (double x : d) {
+				assert(fabs(x - 1) < 1e-15);
+			}
+		}
+		{
+			auto s = sinh_grid<double>(101, 0, 400, 100, 20);
+			assert(s[0] == 0 && s[100] == 400 && std::is_sorted(s.begin(), s.end()));
+			assert(s[51] - s[50] < s[100] - s[99]);
+		}
+		crank_nicolson<> cn;
+		{
+			// European puts and calls against closed form
+			std::vector<option<>> o;
+			for (double k : { 80, 90, 100, 110, 120 }) {
+				o.push_back({ 100, k, 0.05, 0.02, 0.2, 1 });
+				o.push_back({ 100, k, 0.05, 0.02, 0.2, 1, true });
+			}
+			std::vector<result<>> r(o.size());
+			cn.price(o.size(), o.data(), r.data());
+			for (size_t j = 0; j < o.size(); ++j) {
+				const auto& oj = o[j];
+				auto e = bsm_expiry<>(oj.s, oj.t, pwflat::curve_view<>(oj.r), pwflat::curve_view<>(oj.q));
+				double p = e.put_value(oj.sigma, oj.k), d = e.put_delta(oj.sigma, oj.k), g = e.put_gamma(oj.sigma, oj.k);
+				if (oj.call) {
+					p += e.D * (e.f - oj.k);
+					d += e.Dq;
+				}
+				assert(fabs(r[j].value - p) < 1e-3);
+				assert(fabs(r[j].delta - d) < 2e-4);
+				assert(fabs(r[j].gamma - g) < 1e-3);
+				const double h = 1e-4;
+				const auto pt = [&](double t) {
+					auto e = bsm_expiry<>(oj.s, t, pwflat::curve_view<>(oj.r), pwflat::curve_view<>(oj.q));
+					return e.put_value(oj.sigma, oj.k) + (oj.call ? e.D * (e.f - oj.k) : 0);
+				};
+				assert(fabs(r[j].theta + (pt(1 + h) - pt(1 - h)) / (2 * h)) < 2e-2);
+			}
+			// batch matches one at a time
+			auto r1 = cn.price(o[3]);
+			assert(fabs(r1.value - r[3].value) < 1e-12);
+			// theta when every step is smoothed
+			crank_nicolson<> cn_;
+			cn_.steps = 2;
+			auto r2 = cn_.price(o[4]);
+			assert(r2.theta < 0 && fabs(r2.theta - r[4].theta) < 0.5);
+			cn_.steps = 0;
+			assert(throws<std::invalid_argument>([&] { cn_.price(o[4]); }));
+		}
+		{
+			// deep in the money puts near S = 0
+			for (double s : { 1., 5. }) {
+				option<> o{ s, 100, 0.05, 0, 0.2, 1 };
+				auto r = cn.price(o);
+				assert(fabs(r.value - bsm_put_value(0.05, s, 0.2, 1., 100.)) < 1e-3);
+				assert(fabs(r.delta + 1) < 1e-3);
+			}
+		}
+		{
+			// American put
+			crank_nicolson<> cn_;
+			cn_.n = 400;
+			cn_.steps = 200;
+			option<> o{ 100, 100, 0.05, 0, 0.2, 1 };
+			o.american = true;
+			auto r = cn_.price(o);
+			assert(fabs(r.value - 6.0904) < 2e-3);
+			// never exercise an American call without dividends
+			o.call = true;
+			r = cn.price(o);
+			assert(fabs(r.value - bsm_put_value(0.05, 100., 0.2, 1., 100.) - (100 - 100 * std::exp(-0.05))) < 2e-3);
+			// early exercise premium for calls with dividends
+			o.q = 0.08;
+			auto re = cn.price(o);
+			o.american = false;
+			assert(re.value > cn.price(o).value + 0.1);
+		}
+		{
+			// down and out call, B <= k, q = 0
+			const double s = 100, k = 100, B = 90, r = 0.05, sigma = 0.2, t = 1;
+			const auto call = [=](double s) {
+				return bsm_put_value(r, s, sigma, t, k) + s - k * std::exp(-r * t);
+			};
+			const double p = 2 * r / (sigma * sigma) - 1;
+			const double v = call(s) - std::pow(B / s, p) * call(B * B / s);
+			option<> o{ s, k, r, 0, sigma, t, true };
+			o.lower = B;
+			crank_nicolson<> cn_;
+			cn_.n = 400;
+			cn_.steps = 200;
+			auto res = cn_.price(o);
+			assert(fabs(res.value - v) < 5e-3);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl::pde
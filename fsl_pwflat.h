@@ -20,6 +20,7 @@ Discount is represented using a piecewise flat right-continuous forward curve.
 
 	Note f(t[i]) = f[i].
 */
+#pragma once
 #include <cassert>
 #include <cmath>
 #include <limits> 
@@ -235,14 +236,53 @@ namespace fsl::pwflat {
 			curve_view<T, F>::t_ = this->t.data();
 			curve_view<T, F>::f_ = this->f.data();
 		}
-		constexpr curve& operator=(const curve&) = default;
+		// Copies own their arrays so the view must point at them.
+		constexpr curve(const curve& c)
+			: curve(c.size(), c.time(), c.rate(), c.extrapolate())
+		{ }
+		constexpr curve& operator=(const curve& c)
+		{
+			if (this != &c) {
+				t = c.t;
+				f = c.f;
+				curve_view<T, F>::operator=(c);
+				curve_view<T, F>::t_ = t.data();
+				curve_view<T, F>::f_ = f.data();
+			}
+
+			return *this;
+		}
+		// Moves take the arrays and leave c an empty curve.
+		constexpr curve(curve&& c) noexcept
+			: curve_view<T, F>(c), t(std::move(c.t)), f(std::move(c.f))
+		{
+			curve_view<T, F>::t_ = t.data();
+			curve_view<T, F>::f_ = f.data();
+			c.n_ = 0;
+			c.t_ = nullptr;
+			c.f_ = nullptr;
+		}
+		constexpr curve& operator=(curve&& c) noexcept
+		{
+			if (this != &c) {
+				t = std::move(c.t);
+				f = std::move(c.f);
+				curve_view<T, F>::operator=(c);
+				curve_view<T, F>::t_ = t.data();
+				curve_view<T, F>::f_ = f.data();
+				c.n_ = 0;
+				c.t_ = nullptr;
+				c.f_ = nullptr;
+			}
+
+			return *this;
+		}
 		constexpr ~curve() = default;
 
 		// Equal values.
 		constexpr bool operator==(const curve& c) const
 		{
-			using curve_view<T, F>::curve_view::extrapolate;
-			F e = extrapolate();
+			F e = curve_view<T, F>::extrapolate();
 			F ce = c.extrapolate();
 
 			return ((is_nan(e) && is_nan(ce)) || e == ce) && t == c.t && f == c.f;
@@ -278,6 +318,18 @@ namespace fsl::pwflat {
 		constexpr double f[] = { .1, .2, .3 };
 		static_assert(curve<double,double>(3, t, f, 0.4).size() == 3);
 		//static_assert(c.size() == 3);
+		{
+			curve<double, double> c(3, t, f, 0.4);
+			curve<double, double> c2(c);
+			curve<double, double> c3(std::move(c2));
+			assert(c3 == c);
+			assert(c2.size() == 0);
+			assert(c3.forward(2.5) == .3);
+			c2 = std::move(c3);
+			assert(c2 == c);
+			assert(c3.size() == 0);
+			assert(c2.forward(4) == 0.4);
+		}
 	}
 #endif // _DEBUG
 
@@ -0,0 +1,952 @@
+// fsl_quantile.h - Streaming quantile estimation
+/*
+Sketches summarize a stream of samples in bounded memory and can be merged,
+so each Monte Carlo batch or scenario slice keeps its own and the results are
+combined afterward.
+
+	p2_quantile: one quantile with five markers. Not mergeable.
+	moments: mean, variance, skewness, and excess kurtosis.
+	histogram: counts in equal width bins on [lo, hi) plus underflow and overflow.
+	kll_sketch: all quantiles with rank error about 1.7/k using O(k) items.
+	t_digest: all quantiles with error shrinking toward the tails using about δ/2 centroids.
+
+The KLL sketch keeps levels of sorted compactors. Items at level h have weight
+2^h and a full level is compacted by keeping every other item, starting at a
+pseudo random offset, in the level above. Capacities shrink geometrically by
+2/3 with depth below the top level. Karnin, Lang, and Liberty, FOCS 2016.
+
+The t-digest buffers samples and merges them into centroids sorted by mean.
+A centroid starting at quantile q may grow while k(q') - k(q) <= 1 for the
+scale function k(q) = δ/(2π) asin(2q - 1), so centroids are small near q = 0
+and q = 1. Quantiles interpolate linearly between centroid centers. Use it for
+VaR and ES since the KLL error is uniform in rank and coarse in the tails.
+Queries merge pending samples so a t_digest should not be read concurrently.
+
+For a P&L sample X the value at risk at level α is VaR = -q_{1-α} and the
+expected shortfall is ES = -E[X | X <= q_{1-α}], the negative mean of the
+lowest 1 - α fraction of weighted items.
+*/
+#pragma once
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "fsl_math.h"
+#ifdef _DEBUG
+#include <random>
+#include "fsl_monte.h"
+#endif // _DEBUG
+
+namespace fsl {
+
+	// P-square algorithm for the p-quantile using five markers and constant memory.
+	// Jain and Chlamtac, Communications of the ACM, 1985.
+	template<class X = double>
+	class p2_quantile {
+		X p_;
+		size_t count_ = 0;
+		std::array<X, 5> q; // marker heights
+		std::array<X, 5> n; // marker positions
+		std::array<X, 5> np; // desired marker positions
+		std::array<X, 5> dn; // desired position increments
+
+		X parabolic(size_t i, X d) const
+		{
+			return q[i] + d / (n[i + 1] - n[i - 1])
+				* ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i])
+					+ (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+		}
+		X linear(size_t i, int d) const
+		{
+			return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+		}
+	public:
+		p2_quantile(X p = X(0.5))
+			: p_(p), q{}, n{ 0, 1, 2, 3, 4 }, np{ 0, 2 * p, 4 * p, 2 + 2 * p, 4 }, dn{ 0, p / 2, p, (1 + p) / 2, 1 }
+		{
+			if (!(0 <= p && p <= 1)) {
+				throw std::invalid_argument("p2_quantile: p must be in [0, 1]");
+			}
+		}
+
+		X probability() const
+		{
+			return p_;
+		}
+		size_t count() const
+		{
+			return count_;
+		}
+
+		p2_quantile& add(X x)
+		{
+			if (count_ < 5) {
+				q[count_++] = x;
+				if (count_ == 5) {
+					std::sort(q.begin(), q.end());
+				}
+
+				return *this;
+			}
+			++count_;
+
+			size_t k;
+			if (x < q[0]) {
+				q[0] = x;
+				k = 0;
+			}
+			else if (x >= q[4]) {
+				q[4] = x;
+				k = 3;
+			}
+			else {
+				k = std::upper_bound(q.begin() + 1, q.end(), x) - q.begin() - 1;
+			}
+			for (size_t i = k + 1; i < 5; ++i) {
+				n[i] += 1;
+			}
+			for (size_t i = 0; i < 5; ++i) {
+				np[i] += dn[i];
+			}
+			for (size_t i = 1; i < 4; ++i) {
+				X d = np[i] - n[i];
+				if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+					int d_ = d > 0 ? 1 : -1;
+					X qi = parabolic(i, X(d_));
+					q[i] = q[i - 1] < qi && qi < q[i + 1] ? qi : linear(i, d_);
+					n[i] += d_;
+				}
+			}
+
+			return *this;
+		}
+
+		// Current estimate of the p-quantile.
+		X value() const
+		{
+			if (count_ == 0) {
+				return NaN<X>;
+			}
+			if (count_ < 5) {
+				std::array<X, 5> q_ = q;
+				std::sort(q_.begin(), q_.begin() + count_);
+
+				return q_[static_cast<size_t>(std::lround(p_ * (count_ - 1)))];
+			}
+
+			return q[2];
+		}
+	};
+#ifdef _DEBUG
+	inline int test_p2_quantile()
+	{
+		{
+			p2_quantile<> q(0.5);
+			assert(is_nan(q.value()));
+			q.add(3).add(1).add(2);
+			assert(q.value() == 2);
+		}
+		{
+			// Low discrepancy uniform sequence in [0, 1).
+			p2_quantile<> q1(0.1), q5(0.5), q9(0.9);
+			const double phi = 0.6180339887498949;
+			double u = 0;
+			for (int i = 0; i < 10'000; ++i) {
+				u += phi;
+				u -= std::floor(u);
+				q1.add(u);
+				q5.add(u);
+				q9.add(u);
+			}
+			assert(std::fabs(q1.value() - 0.1) < 0.01);
+			assert(std::fabs(q5.value() - 0.5) < 0.01);
+			assert(std::fabs(q9.value() - 0.9) < 0.01);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	// Mean and central moments up to fourth order.
+	// Pébay, Sandia Report SAND2008-6212, 2008.
+	template<class X = double>
+	class moments {
+		size_t n_ = 0;
+		X m1 = 0, m2 = 0, m3 = 0, m4 = 0; // mean and centered sums of powers
+	public:
+		moments& add(X x)
+		{
+			const X n = X(++n_);
+			const X d = x - m1;
+			const X dn = d / n;
+			const X dn2 = dn * dn;
+			const X t = d * dn * (n - 1);
+			m1 += dn;
+			m4 += t * dn2 * (n * n - 3 * n + 3) + 6 * dn2 * m2 - 4 * dn * m3;
+			m3 += t * dn * (n - 2) - 3 * dn * m2;
+			m2 += t;
+
+			return *this;
+		}
+		moments& merge(const moments& o)
+		{
+			if (o.n_ == 0) {
+				return *this;
+			}
+			const X na = X(n_), nb = X(o.n_), n = na + nb;
+			const X d = o.m1 - m1;
+			const X d2 = d * d;
+			const X m2_ = m2 + o.m2 + d2 * na * nb / n;
+			const X m3_ = m3 + o.m3 + d * d2 * na * nb * (na - nb) / (n * n)
+				+ 3 * d * (na * o.m2 - nb * m2) / n;
+			const X m4_ = m4 + o.m4 + d2 * d2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n)
+				+ 6 * d2 * (na * na * o.m2 + nb * nb * m2) / (n * n) + 4 * d * (na * o.m3 - nb * m3) / n;
+			m1 += d * nb / n;
+			m2 = m2_;
+			m3 = m3_;
+			m4 = m4_;
+			n_ += o.n_;
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return n_;
+		}
+		X mean() const
+		{
+			return n_ ? m1 : NaN<X>;
+		}
+		// Population variance.
+		X variance() const
+		{
+			return n_ ? m2 / n_ : NaN<X>;
+		}
+		// Standard error of the mean.
+		X error() const
+		{
+			return n_ ? std::sqrt(m2 / n_ / n_) : NaN<X>;
+		}
+		X skewness() const
+		{
+			return n_ && m2 > 0 ? std::sqrt(X(n_)) * m3 / std::pow(m2, X(1.5)) : NaN<X>;
+		}
+		// Excess kurtosis.
+		X kurtosis() const
+		{
+			return n_ && m2 > 0 ? n_ * m4 / (m2 * m2) - 3 : NaN<X>;
+		}
+	};
+
+	// Counts in equal width bins on [lo, hi) with underflow and overflow counts.
+	template<class X = double>
+	class histogram {
+		X lo_, hi_;
+		std::vector<size_t> c_; // underflow, bins, overflow
+		size_t n_ = 0;
+	public:
+		histogram(X lo = 0, X hi = 1, size_t bins = 100)
+			: lo_(lo), hi_(hi), c_(bins + 2)
+		{
+			if (!(lo < hi) || bins == 0) {
+				throw std::invalid_argument("histogram: need lo < hi and at least one bin");
+			}
+		}
+		histogram& add(X x)
+		{
+			const size_t m = bins();
+			const X u = (x - lo_) / (hi_ - lo_) * m;
+			++c_[u < 0 ? 0 : u >= m ? m + 1 : 1 + static_cast<size_t>(u)];
+			++n_;
+
+			return *this;
+		}
+		histogram& merge(const histogram& h)
+		{
+			if (h.lo_ != lo_ || h.hi_ != hi_ || h.c_.size() != c_.size()) {
+				throw std::invalid_argument("histogram: merge requires the same bins");
+			}
+			for (size_t i = 0; i < c_.size(); ++i) {
+				c_[i] += h.c_[i];
+			}
+			n_ += h.n_;
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return n_;
+		}
+		size_t bins() const
+		{
+			return c_.size() - 2;
+		}
+		// Left edge of bin i.
+		X edge(size_t i) const
+		{
+			return lo_ + (hi_ - lo_) * i / bins();
+		}
+		// Count in bin i.
+		size_t count(size_t i) const
+		{
+			return c_[i + 1];
+		}
+		size_t underflow() const
+		{
+			return c_.front();
+		}
+		size_t overflow() const
+		{
+			return c_.back();
+		}
+		// Fraction of samples at most x, linear within bins.
+		X cdf(X x) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			if (x < lo_) {
+				return X(0);
+			}
+			const size_t m = bins();
+			const X u = std::min((x - lo_) / (hi_ - lo_) * m, X(m));
+			const size_t i = std::min(static_cast<size_t>(u), m - 1);
+			X c = X(c_[0]);
+			for (size_t j = 0; j < i; ++j) {
+				c += c_[j + 1];
+			}
+			c += (u - i) * c_[i + 1];
+			if (x >= hi_) {
+				c += c_[m + 1];
+			}
+
+			return c / n_;
+		}
+		// Inverse of cdf. Quantiles in the underflow or overflow return lo or hi.
+		X quantile(X p) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			const X r = p * n_;
+			X c = X(c_[0]);
+			if (r <= c) {
+				return lo_;
+			}
+			for (size_t i = 0; i < bins(); ++i) {
+				const X ci = X(c_[i + 1]);
+				if (c + ci >= r && ci > 0) {
+					return edge(i) + (r - c) / ci * (hi_ - lo_) / bins();
+				}
+				c += ci;
+			}
+
+			return hi_;
+		}
+	};
+
+	// Mergeable quantile sketch with k items in the top compactor.
+	template<class X = double>
+	class kll_sketch {
+		size_t k_;
+		size_t n_ = 0;
+		uint64_t r_ = 0x9e3779b97f4a7c15; // offset generator state
+		std::vector<std::vector<X>> c_; // compactor at each level
+
+		// splitmix64 bit for the compaction offset
+		size_t bit()
+		{
+			uint64_t z = (r_ += 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+			return (z ^ (z >> 31)) & 1;
+		}
+		size_t capacity(size_t h) const
+		{
+			const size_t depth = c_.size() - 1 - h;
+
+			return std::max(size_t(2), static_cast<size_t>(std::ceil(k_ * std::pow(2. / 3, double(depth)))));
+		}
+		size_t items() const
+		{
+			size_t m = 0;
+			for (const auto& c : c_) {
+				m += c.size();
+			}
+
+			return m;
+		}
+		size_t max_items() const
+		{
+			size_t m = 0;
+			for (size_t h = 0; h < c_.size(); ++h) {
+				m += capacity(h);
+			}
+
+			return m;
+		}
+		// Compact the lowest full level until the sketch fits.
+		void compress()
+		{
+			while (items() >= max_items()) {
+				for (size_t h = 0; h < c_.size(); ++h) {
+					if (c_[h].size() >= capacity(h)) {
+						if (h + 1 == c_.size()) {
+							c_.emplace_back();
+						}
+						auto& c = c_[h];
+						auto& c1 = c_[h + 1];
+						std::sort(c.begin(), c.end());
+						// keep the largest item if the count is odd so total weight is preserved
+						const size_t m = c.size() & ~size_t(1);
+						for (size_t i = bit(); i < m; i += 2) {
+							c1.push_back(c[i]);
+						}
+						if (m < c.size()) {
+							c.front() = c.back();
+							c.resize(1);
+						}
+						else {
+							c.clear();
+						}
+						break;
+					}
+				}
+			}
+		}
+		// Items sorted with their weights.
+		std::vector<std::pair<X, size_t>> sorted() const
+		{
+			std::vector<std::pair<X, size_t>> w;
+			w.reserve(items());
+			for (size_t h = 0; h < c_.size(); ++h) {
+				for (X x : c_[h]) {
+					w.emplace_back(x, size_t(1) << h);
+				}
+			}
+			std::sort(w.begin(), w.end());
+
+			return w;
+		}
+	public:
+		kll_sketch(size_t k = 200)
+			: k_(k), c_(1)
+		{
+			if (k < 8) {
+				throw std::invalid_argument("kll_sketch: k must be at least 8");
+			}
+		}
+		kll_sketch& add(X x)
+		{
+			c_[0].push_back(x);
+			++n_;
+			if (c_[0].size() >= capacity(0)) {
+				compress();
+			}
+
+			return *this;
+		}
+		kll_sketch& merge(const kll_sketch& s)
+		{
+			if (c_.size() < s.c_.size()) {
+				c_.resize(s.c_.size());
+			}
+			for (size_t h = 0; h < s.c_.size(); ++h) {
+				c_[h].insert(c_[h].end(), s.c_[h].begin(), s.c_[h].end());
+			}
+			n_ += s.n_;
+			compress();
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return n_;
+		}
+		// Number of items retained.
+		size_t retained() const
+		{
+			return items();
+		}
+		// Smallest retained x with rank at least p n.
+		X quantile(X p) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			const auto w = sorted();
+			const X r = p * n_;
+			size_t c = 0;
+			for (const auto& [x, wx] : w) {
+				c += wx;
+				if (c >= r) {
+					return x;
+				}
+			}
+
+			return w.back().first;
+		}
+		// Fraction of samples at most x.
+		X cdf(X x) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			size_t c = 0;
+			for (size_t h = 0; h < c_.size(); ++h) {
+				for (X y : c_[h]) {
+					if (y <= x) {
+						c += size_t(1) << h;
+					}
+				}
+			}
+
+			return X(c) / n_;
+		}
+		// Mean of the lowest fraction p of samples.
+		X tail_mean(X p) const
+		{
+			if (n_ == 0 || !(p > 0)) {
+				return NaN<X>;
+			}
+			const X r = p * n_;
+			X c = 0, s = 0;
+			for (const auto& [x, wx] : sorted()) {
+				const X w = std::min(X(wx), r - c);
+				s += w * x;
+				c += w;
+				if (c >= r) {
+					break;
+				}
+			}
+
+			return s / c;
+		}
+	};
+
+	// Merging t-digest with compression delta. Centroids near the tails hold few samples
+	// so extreme quantiles have small relative error. Dunning and Ertl, arXiv 1902.04023.
+	template<class X = double>
+	class t_digest {
+		X delta_;
+		mutable std::vector<std::pair<X, X>> c_; // centroid mean and weight sorted by mean
+		mutable std::vector<std::pair<X, X>> b_; // unmerged samples and centroids
+		X n_ = 0; // total weight
+		X min_ = infinity<X>, max_ = -infinity<X>;
+		mutable bool flip_ = false; // merge direction
+
+		// Scale function k(q) = δ/(2π) asin(2q - 1) and its inverse.
+		X k(X q) const
+		{
+			return delta_ / (2 * X(3.141592653589793)) * std::asin(2 * q - 1);
+		}
+		X q(X k) const
+		{
+			return (std::sin(std::min(k * 2 * X(3.141592653589793) / delta_, X(1.5707963267948966))) + 1) / 2;
+		}
+		// Merge buffered points into the centroids.
+		void flush() const
+		{
+			if (b_.empty()) {
+				return;
+			}
+			b_.insert(b_.end(), c_.begin(), c_.end());
+			// alternate the merge direction to avoid bias toward one tail
+			flip_ = !flip_;
+			if (flip_) {
+				std::sort(b_.begin(), b_.end(), std::greater<>{});
+			}
+			else {
+				std::sort(b_.begin(), b_.end());
+			}
+			c_.clear();
+			X w = 0; // weight of completed centroids
+			auto cur = b_[0];
+			X limit = n_ * q(k(0) + 1);
+			for (size_t i = 1; i < b_.size(); ++i) {
+				if (w + cur.second + b_[i].second <= limit) {
+					cur.second += b_[i].second;
+					cur.first += (b_[i].first - cur.first) * b_[i].second / cur.second;
+				}
+				else {
+					w += cur.second;
+					c_.push_back(cur);
+					limit = n_ * q(k(w / n_) + 1);
+					cur = b_[i];
+				}
+			}
+			c_.push_back(cur);
+			if (flip_) {
+				std::reverse(c_.begin(), c_.end());
+			}
+			b_.clear();
+		}
+	public:
+		t_digest(X delta = 200)
+			: delta_(delta)
+		{
+			if (!(delta >= 10)) {
+				throw std::invalid_argument("t_digest: delta must be at least 10");
+			}
+		}
+		t_digest& add(X x, X w = 1)
+		{
+			b_.emplace_back(x, w);
+			n_ += w;
+			min_ = std::min(min_, x);
+			max_ = std::max(max_, x);
+			if (b_.size() >= 10 * static_cast<size_t>(delta_)) {
+				flush();
+			}
+
+			return *this;
+		}
+		t_digest& merge(const t_digest& t)
+		{
+			b_.insert(b_.end(), t.c_.begin(), t.c_.end());
+			b_.insert(b_.end(), t.b_.begin(), t.b_.end());
+			n_ += t.n_;
+			min_ = std::min(min_, t.min_);
+			max_ = std::max(max_, t.max_);
+			flush();
+
+			return *this;
+		}
+		X size() const
+		{
+			return n_;
+		}
+		// Number of centroids after merging.
+		size_t centroids() const
+		{
+			flush();
+
+			return c_.size();
+		}
+		// Piecewise linear in the cumulative weight at centroid centers, from min to max.
+		X quantile(X p) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			flush();
+			const X r = std::clamp(p, X(0), X(1)) * n_;
+			X t = 0; // weight before centroid i
+			X r_ = 0, x_ = min_; // previous center
+			for (const auto& [m, w] : c_) {
+				const X ri = t + w / 2;
+				if (r <= ri) {
+					return ri > r_ ? x_ + (m - x_) * (r - r_) / (ri - r_) : m;
+				}
+				r_ = ri;
+				x_ = m;
+				t += w;
+			}
+
+			return n_ > r_ ? x_ + (max_ - x_) * (r - r_) / (n_ - r_) : max_;
+		}
+		// Inverse of quantile.
+		X cdf(X x) const
+		{
+			if (n_ == 0) {
+				return NaN<X>;
+			}
+			if (x < min_) {
+				return 0;
+			}
+			if (x >= max_) {
+				return 1;
+			}
+			flush();
+			X t = 0;
+			X r_ = 0, x_ = min_;
+			for (const auto& [m, w] : c_) {
+				const X ri = t + w / 2;
+				if (x < m) {
+					return (r_ + (ri - r_) * (x - x_) / (m - x_)) / n_;
+				}
+				r_ = ri;
+				x_ = m;
+				t += w;
+			}
+
+			return (r_ + (n_ - r_) * (x - x_) / (max_ - x_)) / n_;
+		}
+		// Mean of the lowest fraction p of samples, integrating the quantile function.
+		X tail_mean(X p) const
+		{
+			if (n_ == 0 || !(p > 0)) {
+				return NaN<X>;
+			}
+			flush();
+			const X r = std::min(p, X(1)) * n_;
+			X s = 0; // integral of the quantile function over rank
+			X t = 0;
+			X r_ = 0, x_ = min_;
+			const auto segment = [&](X ri, X xi) {
+				// trapezoid from (r_, x_) to (ri, xi) truncated at r
+				if (r <= r_) {
+					return true;
+				}
+				if (r < ri) {
+					const X xr = x_ + (xi - x_) * (r - r_) / (ri - r_);
+					s += (r - r_) * (x_ + xr) / 2;
+					return true;
+				}
+				s += (ri - r_) * (x_ + xi) / 2;
+				r_ = ri;
+				x_ = xi;
+				return false;
+			};
+			for (const auto& [m, w] : c_) {
+				if (segment(t + w / 2, m)) {
+					return s / r;
+				}
+				t += w;
+			}
+			segment(n_, max_);
+
+			return s / r;
+		}
+	};
+
+	// Value at risk of P&L at level alpha, e.g. 0.99.
+	template<class X>
+	inline X value_at_risk(const t_digest<X>& s, X alpha)
+	{
+		return -s.quantile(1 - alpha);
+	}
+	// Expected shortfall of P&L at level alpha.
+	template<class X>
+	inline X expected_shortfall(const t_digest<X>& s, X alpha)
+	{
+		return -s.tail_mean(1 - alpha);
+	}
+
+	// Moments, quantiles, and a histogram of the same samples.
+	// Attach to a Monte Carlo run with monte_target::accumulate or add scenario values directly.
+	template<class X = double>
+	struct distribution_sketch {
+		fsl::moments<X> moments;
+		t_digest<X> quantiles;
+		fsl::histogram<X> histogram;
+
+		distribution_sketch(X lo = -1, X hi = 1, size_t bins = 100, X delta = 200)
+			: quantiles(delta), histogram(lo, hi, bins)
+		{ }
+		distribution_sketch& add(X x)
+		{
+			moments.add(x);
+			quantiles.add(x);
+			histogram.add(x);
+
+			return *this;
+		}
+		distribution_sketch& merge(const distribution_sketch& s)
+		{
+			moments.merge(s.moments);
+			quantiles.merge(s.quantiles);
+			histogram.merge(s.histogram);
+
+			return *this;
+		}
+		size_t size() const
+		{
+			return moments.size();
+		}
+		X mean() const
+		{
+			return moments.mean();
+		}
+		X error() const
+		{
+			return moments.error();
+		}
+	};
+
+	// Value at risk of P&L at level alpha, e.g. 0.99.
+	template<class X>
+	inline X value_at_risk(const kll_sketch<X>& s, X alpha)
+	{
+		return -s.quantile(1 - alpha);
+	}
+	// Expected shortfall of P&L at level alpha.
+	template<class X>
+	inline X expected_shortfall(const kll_sketch<X>& s, X alpha)
+	{
+		return -s.tail_mean(1 - alpha);
+	}
+
+#ifdef _DEBUG
+	inline int test_moments()
+	{
+		{
+			moments<> m;
+			assert(is_nan(m.mean()));
+			m.add(1).add(2).add(3).add(10);
+			assert(m.mean() == 4);
+			assert(std::fabs(m.variance() - 12.5) < 1e-14);
+			// sum (x - 4)^3 = -27 - 8 - 1 + 216 = 180, sum (x - 4)^4 = 81 + 16 + 1 + 1296 = 1394
+			assert(std::fabs(m.skewness() - 180. / 4 / std::pow(12.5, 1.5)) < 1e-14);
+			assert(std::fabs(m.kurtosis() - (1394. / 4 / (12.5 * 12.5) - 3)) < 1e-14);
+		}
+		{
+			// merging matches a single pass
+			moments<> a, b, c;
+			double x = 0.5;
+			for (int i = 0; i < 1000; ++i) {
+				x = 3.7 * x * (1 - x); // chaotic but deterministic
+				(i < 300 ? a : b).add(x * x);
+				c.add(x * x);
+			}
+			a.merge(b);
+			assert(a.size() == c.size());
+			assert(std::fabs(a.mean() - c.mean()) < 1e-14);
+			assert(std::fabs(a.variance() - c.variance()) < 1e-14);
+			assert(std::fabs(a.skewness() - c.skewness()) < 1e-12);
+			assert(std::fabs(a.kurtosis() - c.kurtosis()) < 1e-12);
+		}
+
+		return 0;
+	}
+
+	inline int test_histogram()
+	{
+		histogram<> h(0, 1, 10);
+		h.add(-1).add(0).add(0.05).add(0.55).add(0.999).add(1);
+		assert(h.size() == 6);
+		assert(h.underflow() == 1 && h.overflow() == 1);
+		assert(h.count(0) == 2 && h.count(5) == 1 && h.count(9) == 1);
+		assert(h.cdf(-2) == 0 && h.cdf(2) == 1);
+		assert(h.quantile(0.1) == 0);
+		assert(h.quantile(1) == 1);
+
+		histogram<> u(0, 1, 100), v(0, 1, 100);
+		const double phi = 0.6180339887498949;
+		double x = 0;
+		for (int i = 0; i < 10'000; ++i) {
+			x += phi;
+			x -= std::floor(x);
+			(i % 2 ? u : v).add(x);
+		}
+		u.merge(v);
+		assert(u.size() == 10'000);
+		for (double p : { 0.01, 0.1, 0.5, 0.9, 0.99 }) {
+			assert(std::fabs(u.quantile(p) - p) < 1e-3);
+			assert(std::fabs(u.cdf(p) - p) < 1e-3);
+		}
+
+		return 0;
+	}
+
+	inline int test_kll_sketch()
+	{
+		{
+			kll_sketch<> s;
+			assert(is_nan(s.quantile(0.5)));
+			s.add(3).add(1).add(2);
+			assert(s.quantile(0.5) == 2);
+			assert(s.quantile(0) == 1 && s.quantile(1) == 3);
+		}
+		{
+			// low discrepancy uniform sequence in 8 merged parts
+			const size_t n = 1'000'000;
+			std::vector<kll_sketch<>> s(8);
+			const double phi = 0.6180339887498949;
+			double x = 0;
+			for (size_t i = 0; i < n; ++i) {
+				x += phi;
+				x -= std::floor(x);
+				s[i % 8].add(x);
+			}
+			kll_sketch<> t;
+			for (const auto& si : s) {
+				t.merge(si);
+			}
+			assert(t.size() == n);
+			assert(t.retained() < 1000);
+			for (double p : { 0.001, 0.01, 0.1, 0.5, 0.9, 0.99 }) {
+				assert(std::fabs(t.quantile(p) - p) < 0.01);
+				assert(std::fabs(t.cdf(p) - p) < 0.01);
+			}
+			// mean of the lowest 5% is 0.025
+			assert(std::fabs(t.tail_mean(0.05) - 0.025) < 0.005);
+			assert(std::fabs(value_at_risk(t, 0.95) + 0.05) < 0.01);
+			assert(std::fabs(expected_shortfall(t, 0.95) + 0.025) < 0.005);
+		}
+
+		return 0;
+	}
+
+	inline int test_t_digest()
+	{
+		{
+			t_digest<> t;
+			assert(is_nan(t.quantile(0.5)));
+			t.add(1).add(2).add(3);
+			assert(t.quantile(0) == 1 && t.quantile(1) == 3);
+			assert(t.quantile(0.5) == 2);
+		}
+		{
+			// low discrepancy uniform sequence in 8 merged parts
+			const size_t n = 1'000'000;
+			std::vector<t_digest<>> s(8);
+			const double phi = 0.6180339887498949;
+			double x = 0;
+			for (size_t i = 0; i < n; ++i) {
+				x += phi;
+				x -= std::floor(x);
+				s[i % 8].add(x);
+			}
+			t_digest<> t;
+			for (const auto& si : s) {
+				t.merge(si);
+			}
+			assert(t.size() == n);
+			assert(t.centroids() < 200);
+			for (double p : { 0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999 }) {
+				// error shrinks in the tails
+				assert(std::fabs(t.quantile(p) - p) < 0.02 * std::min(p, 1 - p) + 2e-4);
+				assert(std::fabs(t.cdf(p) - p) < 0.02 * std::min(p, 1 - p) + 2e-4);
+			}
+			assert(std::fabs(t.tail_mean(0.05) - 0.025) < 5e-4);
+			assert(std::fabs(t.tail_mean(1) - 0.5) < 1e-4);
+		}
+
+		return 0;
+	}
+
+	inline int test_distribution_sketch()
+	{
+		// standard normal P&L from a parallel Monte Carlo run
+		monte_target m;
+		m.samples = 1'000'000;
+		const auto f = [](std::mt19937_64& g) { return std::normal_distribution<double>{}(g); };
+		auto s = m.accumulate(f, distribution_sketch<>(-5, 5, 1000), 1);
+		assert(s.size() == m.samples);
+		assert(std::fabs(s.mean()) < 4 * s.error());
+		assert(std::fabs(s.moments.variance() - 1) < 0.01);
+		assert(std::fabs(s.moments.skewness()) < 0.01);
+		assert(std::fabs(s.moments.kurtosis()) < 0.02);
+		// VaR and ES at 99% are 2.3263 and φ(2.3263)/0.01 = 2.6652
+		assert(std::fabs(value_at_risk(s.quantiles, 0.99) - 2.3263) < 0.02);
+		assert(std::fabs(expected_shortfall(s.quantiles, 0.99) - 2.6652) < 0.03);
+		assert(std::fabs(s.histogram.quantile(0.01) + 2.3263) < 0.01);
+		assert(std::fabs(s.histogram.cdf(0) - 0.5) < 0.002);
+		assert(s.quantiles.centroids() < 200);
+
+		// same seed, same sketch
+		auto s_ = m.accumulate(f, distribution_sketch<>(-5, 5, 1000), 1);
+		assert(s_.quantiles.quantile(0.01) == s.quantiles.quantile(0.01));
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -0,0 +1,287 @@
+// fsl_risk.h - Portfolio present value, DV01, convexity, and key rate ladder
+/*
+Cash flows of every instrument in a portfolio are merged into one grid of
+distinct times u_l with amounts c_l. For a piecewise flat forward curve with
+knots t_j and forwards f_j on (t_{j-1}, t_j]
+
+	PV = sum_l c_l D(u_l)
+	dPV/dε = -sum_l u_l c_l D(u_l) for a parallel shift ε of all forwards
+	d^2PV/dε^2 = sum_l u_l^2 c_l D(u_l)
+	dPV/df_j = -sum_l c_l D(u_l) |(t_{j-1}, t_j] ∩ (0, u_l]|
+
+If u_l is in segment k the last is -c_l D(u_l) (t_j - t_{j-1}) for j < k and
+-c_l D(u_l) (u_l - t_{k-1}) for j = k, so one pass over the grid accumulating
+per segment sums followed by a suffix sum over segments gives the ladder.
+Segments of grid points are cached until the curve knots change.
+*/
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "fsl_instrument.h"
+#include "fsl_pwflat.h"
+
+namespace fsl {
+
+	template<class F = double>
+	struct risk_ladder {
+		F pv = 0; // present value
+		F dv01 = 0; // change in present value for a 1bp parallel forward shift
+		F convexity = 0; // second derivative of present value with respect to a parallel forward shift
+		std::vector<F> key_rate; // change in present value for a 1bp shift of each forward segment
+	};
+
+	template<class U = double, class C = double, class T = double, class F = double>
+	class portfolio {
+		std::vector<U> u_; // merged cash flow times
+		std::vector<C> c_; // merged cash flow amounts
+		bool merged_ = true;
+		// cache for the last curve
+		std::vector<T> t_; // knots
+		std::vector<size_t> k_; // segment of each cash flow
+		bool valid_ = false; // k_ matches t_ and the merged cash flows
+		std::vector<F> x_, B_, P_; // exponent, per segment sums
+
+		void merge()
+		{
+			std::vector<size_t> i(u_.size());
+			std::iota(i.begin(), i.end(), size_t(0));
+			std::stable_sort(i.begin(), i.end(), [this](size_t a, size_t b) { return u_[a] < u_[b]; });
+			std::vector<U> u;
+			std::vector<C> c;
+			for (size_t j : i) {
+				if (!u.empty() && u.back() == u_[j]) {
+					c.back() += c_[j];
+				}
+				else {
+					u.push_back(u_[j]);
+					c.push_back(c_[j]);
+				}
+			}
+			u_.swap(u);
+			c_.swap(c);
+			merged_ = true;
+			valid_ = false;
+		}
+		void segments(const pwflat::curve_view<T, F>& f)
+		{
+			const size_t n = f.size();
+			if (valid_ && t_.size() == n && std::equal(t_.begin(), t_.end(), f.time())) {
+				return;
+			}
+			t_.assign(f.time(), f.time() + n);
+			k_.resize(u_.size());
+			size_t k = 0;
+			for (size_t l = 0; l < u_.size(); ++l) {
+				while (k < n && t_[k] < u_[l]) {
+					++k;
+				}
+				k_[l] = k;
+			}
+			valid_ = true;
+		}
+	public:
+		portfolio() = default;
+
+		// Add notional times the cash flows of an instrument.
+		portfolio& add(const instrument<U, C>& uc, C notional = 1)
+		{
+			for (const auto& [u, c] : uc) {
+				if (u < 0) {
+					throw std::invalid_argument("portfolio: cash flow times must be non-negative");
+				}
+				u_.push_back(u);
+				c_.push_back(notional * c);
+			}
+			merged_ = false;
+
+			return *this;
+		}
+
+		// Number of distinct cash flow times.
+		size_t size()
+		{
+			if (!merged_) {
+				merge();
+			}
+
+			return u_.size();
+		}
+
+		// Present value, DV01, convexity, and key rate ladder with one entry per knot
+		// and a last entry for the extrapolated segment.
+		risk_ladder<F> risk(const pwflat::curve_view<T, F>& f, bool parallel = false)
+		{
+			if (!merged_) {
+				merge();
+			}
+			segments(f);
+			const size_t n = f.size();
+			const size_t m = u_.size();
+			const T* t = f.time();
+			const F* r = f.rate();
+
+			// integral of forward up to start of each segment
+			std::vector<F> I(n + 1);
+			std::vector<T> t0(n + 1);
+			for (size_t j = 0; j < n; ++j) {
+				t0[j + 1] = t[j];
+				I[j + 1] = I[j] + r[j] * (t[j] - t0[j]);
+			}
+
+			x_.resize(m);
+			for (size_t l = 0; l < m; ++l) {
+				const size_t k = k_[l];
+				x_[l] = -(I[k] + (k < n ? r[k] : f.extrapolate()) * (u_[l] - t0[k]));
+			}
+
+			// Chunks are accumulated in order so parallel and serial results are identical.
+			const size_t cs = 4096;
+			const size_t nc = std::max<size_t>(1, (m + cs - 1) / cs);
+			std::vector<F> pv(nc), du(nc), cv(nc);
+			B_.assign(nc * (n + 1), F(0));
+			P_.assign(nc * (n + 1), F(0));
+			const auto sweep = [&](size_t i) {
+				F* B = B_.data() + i * (n + 1);
+				F* P = P_.data() + i * (n + 1);
+				F pv_ = 0, du_ = 0, cv_ = 0;
+				const size_t l1 = std::min(m, (i + 1) * cs);
+				for (size_t l = i * cs; l < l1; ++l) {
+					const size_t k = k_[l];
+					const F cD = c_[l] * std::exp(x_[l]);
+					pv_ += cD;
+					du_ += u_[l] * cD;
+					cv_ += u_[l] * u_[l] * cD;
+					B[k] += cD;
+					P[k] += cD * (u_[l] - t0[k]);
+				}
+				pv[i] = pv_;
+				du[i] = du_;
+				cv[i] = cv_;
+			};
+			if (parallel && nc > 1) {
+				std::vector<size_t> idx(nc);
+				std::iota(idx.begin(), idx.end(), size_t(0));
+				std::for_each(std::execution::par, idx.begin(), idx.end(), sweep);
+			}
+			else {
+				for (size_t i = 0; i < nc; ++i) {
+					sweep(i);
+				}
+			}
+
+			risk_ladder<F> res;
+			res.key_rate.resize(n + 1);
+			for (size_t i = 0; i < nc; ++i) {
+				res.pv += pv[i];
+				res.dv01 -= du[i];
+				res.convexity += cv[i];
+				if (i > 0) {
+					for (size_t j = 0; j <= n; ++j) {
+						B_[j] += B_[i * (n + 1) + j];
+						P_[j] += P_[i * (n + 1) + j];
+					}
+				}
+			}
+			res.dv01 *= F(0.0001);
+			F S = 0; // sum of B over later segments
+			for (size_t j = n + 1; j-- > 0; ) {
+				const F dt = j < n ? t[j] - t0[j] : F(0);
+				res.key_rate[j] = -F(0.0001) * (P_[j] + dt * S);
+				S += B_[j];
+			}
+
+			return res;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_portfolio_risk()
+	{
+		const double t[] = { 1, 2, 3, 5 };
+		const double f[] = { .03, .035, .04, .045 };
+		const pwflat::curve_view<> c(4, t, f, .05);
+		const auto pv = [](const instrument<>& uc, const pwflat::curve_view<>& f) {
+			double p = 0;
+			for (const auto& [u, c] : uc) {
+				p += c * std::exp(-f.integral(u));
+			}
+			return p;
+		};
+
+		portfolio<> p;
+		interest_rate_swap<> s3(3, .04, frequency::semiannually), s7(7, .045);
+		zero_coupon_bond<> z(2, .9);
+		p.add(s3, 2).add(s7, -1).add(z, 3).add(s3);
+		assert(p.size() == 11); // 0, .5, 1, ..., 3, 4, 5, 6, 7
+		auto r = p.risk(c);
+		const double pv0 = 3 * pv(s3, c) - pv(s7, c) + 3 * pv(z, c);
+		assert(fabs(r.pv - pv0) < 1e-12);
+		assert(r.key_rate.size() == 5);
+		double sum = 0;
+		for (double k : r.key_rate) {
+			sum += k;
+		}
+		assert(fabs(sum - r.dv01) < 1e-15);
+
+		// finite differences
+		const double h = 1e-6;
+		for (size_t j = 0; j < 5; ++j) {
+			double fu[4], fd[4];
+			std::copy(f, f + 4, fu);
+			std::copy(f, f + 4, fd);
+			double eu = .05, ed = .05;
+			(j < 4 ? fu[j] : eu) += h;
+			(j < 4 ? fd[j] : ed) -= h;
+			const double d = (p.risk(pwflat::curve_view<>(4, t, fu, eu)).pv - p.risk(pwflat::curve_view<>(4, t, fd, ed)).pv) / (2 * h);
+			assert(fabs(d * 0.0001 - r.key_rate[j]) < 1e-9);
+		}
+		{
+			double fu[4], fd[4];
+			for (size_t j = 0; j < 4; ++j) {
+				fu[j] = f[j] + h;
+				fd[j] = f[j] - h;
+			}
+			const double pu = p.risk(pwflat::curve_view<>(4, t, fu, .05 + h)).pv;
+			const double pd = p.risk(pwflat::curve_view<>(4, t, fd, .05 - h)).pv;
+			assert(fabs((pu - pd) / (2 * h) * 0.0001 - r.dv01) < 1e-9);
+			const double h2 = 1e-4;
+			for (size_t j = 0; j < 4; ++j) {
+				fu[j] = f[j] + h2;
+				fd[j] = f[j] - h2;
+			}
+			const double pu2 = p.risk(pwflat::curve_view<>(4, t, fu, .05 + h2)).pv;
+			const double pd2 = p.risk(pwflat::curve_view<>(4, t, fd, .05 - h2)).pv;
+			assert(fabs((pu2 - 2 * r.pv + pd2) / (h2 * h2) - r.convexity) < 1e-4 * fabs(r.convexity));
+		}
+
+		{
+			// flat curve with no knots, before and after adding cash flows
+			const pwflat::curve_view<> c0(.03);
+			portfolio<> p0;
+			p0.add(s3);
+			auto r0 = p0.risk(c0);
+			assert(fabs(r0.pv - pv(s3, c0)) < 1e-12);
+			assert(r0.key_rate.size() == 1);
+			assert(fabs(r0.key_rate[0] - r0.dv01) < 1e-15);
+			p0.add(z);
+			assert(fabs(p0.risk(c0).pv - pv(s3, c0) - pv(z, c0)) < 1e-12);
+		}
+
+		// parallel matches serial for a large book
+		portfolio<> q;
+		for (int i = 1; i <= 2000; ++i) {
+			q.add(interest_rate_swap<>(0.01 * i, .04, frequency::monthly), i % 2 ? 1. : -1.);
+		}
+		auto rs = q.risk(c);
+		auto rp = q.risk(c, true);
+		assert(rs.pv == rp.pv && rs.dv01 == rp.dv01 && rs.convexity == rp.convexity);
+		assert(rs.key_rate == rp.key_rate);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -1,7 +1,11 @@
 // fmx_root1d.h - 1-d root using secant method
 #pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
 #include <tuple>
 #include <limits>
+#include <utility>
 #include "fsl_math.h"
 
 namespace fsl::root1d {
@@ -141,5 +145,278 @@ namespace fsl::root1d {
 #endif // _DEBUG	
 	};
 
+	// Expand [x - dx, x + dx] geometrically until f changes sign, staying in (lo, hi).
+	// Return the bracket or NaNs if no sign change is found.
+	template<class X, class F>
+	constexpr std::pair<X, X> expand(const F& f, X x, X dx, X lo = -infinity<X>, X hi = infinity<X>, size_t iter = 50)
+	{
+		X a = std::max(x - dx, (x + lo) / 2);
+		X b = std::min(x + dx, (x + hi) / 2);
+		auto fa = f(a);
+		auto fb = f(b);
+
+		for (size_t n = 0; n < iter; ++n) {
+			if (!samesign(fa, fb)) {
+				return { a, b };
+			}
+			if (fabs(fa) < fabs(fb) && a > lo) {
+				a = std::max(a + X(1.6) * (a - b), (a + lo) / 2); // at most halfway to lo
+				fa = f(a);
+			}
+			else if (b < hi) {
+				b = std::min(b + X(1.6) * (b - a), (b + hi) / 2); // at most halfway to hi
+				fb = f(b);
+			}
+			else {
+				break;
+			}
+		}
+
+		return { NaN<X>, NaN<X> };
+	}
+
+	// Brent's method given a bracket [a, b] with f(a) and f(b) of opposite sign.
+	// Stops when |f(x)| <= tolerance or the bracket is narrower than 2 tolerance.
+	template<class X = double, class Y = X>
+	struct brent {
+		X a, b;
+		X tolerance;
+		size_t iterations;
+
+		brent(X a, X b, X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: a(a), b(b), tolerance(tol), iterations(iter)
+		{
+		}
+		brent(std::pair<X, X> ab, X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: brent(ab.first, ab.second, tol, iter)
+		{
+		}
+
+		// Return root approximation, residual, and number of iterations.
+		template<class F>
+		constexpr std::tuple<X, X, size_t> solve(const F& f)
+		{
+			Y fa = f(a);
+			Y fb = f(b);
+			if (is_nan(a) || is_nan(b) || (samesign(fa, fb) && fa != 0)) {
+				return { NaN<X>, NaN<X>, 0 };
+			}
+
+			X c = a, d = b - a, e = d;
+			Y fc = fa;
+			size_t n = 0;
+			while (++n < iterations) {
+				if (samesign(fb, fc) && fb != 0) {
+					c = a;
+					fc = fa;
+					d = e = b - a;
+				}
+				if (fabs(fc) < fabs(fb)) {
+					a = b;
+					b = c;
+					c = a;
+					fa = fb;
+					fb = fc;
+					fc = fa;
+				}
+				X tol = 2 * epsilon<X> * fabs(b) + tolerance;
+				X xm = (c - b) / 2;
+				if (fabs(xm) <= tol || fabs(fb) <= tolerance) {
+					break;
+				}
+				if (fabs(e) >= tol && fabs(fa) > fabs(fb)) {
+					// inverse quadratic interpolation or secant
+					X p, q, s_ = fb / fa;
+					if (a == c) {
+						p = 2 * xm * s_;
+						q = 1 - s_;
+					}
+					else {
+						X q_ = fa / fc, r = fb / fc;
+						p = s_ * (2 * xm * q_ * (q_ - r) - (b - a) * (r - 1));
+						q = (q_ - 1) * (r - 1) * (s_ - 1);
+					}
+					if (p > 0) {
+						q = -q;
+					}
+					p = fabs(p);
+					if (2 * p < std::min(3 * xm * q - fabs(tol * q), fabs(e * q))) {
+						e = d;
+						d = p / q;
+					}
+					else {
+						d = e = xm; // bisection
+					}
+				}
+				else {
+					d = e = xm; // bisection
+				}
+				a = b;
+				fa = fb;
+				b += fabs(d) > tol ? d : (xm > 0 ? tol : -tol);
+				fb = f(b);
+			}
+			if (n == iterations) {
+				b = NaN<X>;
+			}
+
+			return { b, fb, n };
+		}
+	};
+#ifdef _DEBUG
+	inline int test_brent()
+	{
+		{
+			auto [x, y, n] = brent(0., 3.).solve([](double x) { return x * x - 4; });
+			assert(fabs(x - 2) <= sqrt_epsilon<double>);
+			assert(n < 20);
+		}
+		{
+			// no bracket
+			auto [x, y, n] = brent(3., 4.).solve([](double x) { return x * x - 4; });
+			assert(is_nan(x));
+		}
+		{
+			// discontinuous at root
+			auto [x, y, n] = brent(-1., 2., 1e-12).solve([](double x) { return x < 1 ? -1. : 1.; });
+			assert(fabs(x - 1) <= 1e-11);
+		}
+		{
+			const auto f = [](double x) { return std::exp(x) - 10; };
+			auto ab = expand(f, 0., 0.1);
+			assert(!samesign(f(ab.first), f(ab.second)));
+			auto [x, y, n] = brent(ab).solve(f);
+			assert(fabs(x - std::log(10)) <= sqrt_epsilon<double>);
+		}
+		{
+			// stay inside domain
+			const auto f = [](double x) { return std::log(x) + 5; };
+			auto [a, b] = expand(f, 1., 0.5, 0.);
+			assert(a > 0 && f(a) < 0 && f(b) > 0);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	// Interpolate, truncate, and project (ITP) method given a bracket [a, b].
+	// Never takes more than ceil(log2((b - a)/(2 tolerance))) + n0 iterations and
+	// converges superlinearly for smooth f.
+	// Oliveira and Takahashi, ACM Transactions on Mathematical Software, 2020.
+	template<class X = double, class Y = X>
+	struct itp {
+		X a, b;
+		X tolerance;
+		size_t iterations;
+		X k1 = X(0.2), k2 = X(2);
+		size_t n0 = 1;
+
+		itp(X a, X b, X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: a(a), b(b), tolerance(tol), iterations(iter)
+		{
+		}
+		itp(std::pair<X, X> ab, X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: itp(ab.first, ab.second, tol, iter)
+		{
+		}
+
+		// Return root approximation, residual, and number of iterations.
+		template<class F>
+		constexpr std::tuple<X, X, size_t> solve(const F& f)
+		{
+			if (a > b) {
+				std::swap(a, b);
+			}
+			Y ya = f(a);
+			Y yb = f(b);
+			if (is_nan(a) || is_nan(b) || (samesign(ya, yb) && ya != 0)) {
+				return { NaN<X>, NaN<X>, 0 };
+			}
+			if (ya == 0) {
+				return { a, ya, 0 };
+			}
+			if (yb == 0) {
+				return { b, yb, 0 };
+			}
+			// Work with f increasing.
+			const Y s = ya < 0 ? Y(1) : Y(-1);
+			ya *= s;
+			yb *= s;
+
+			const X k1_ = k1 / (b - a);
+			const size_t nmax = static_cast<size_t>(std::max(std::ceil(std::log2((b - a) / (2 * tolerance))), X(0))) + n0;
+			X x = (a + b) / 2;
+			Y y = NaN<Y>;
+			size_t n = 0;
+			while (b - a > 2 * tolerance && n < std::min(nmax, iterations)) {
+				X xh = (a + b) / 2;
+				X r = tolerance * std::ldexp(X(1), static_cast<int>(nmax - n)) - (b - a) / 2;
+				X delta = k1_ * std::pow(b - a, k2);
+				X xf = (yb * a - ya * b) / (yb - ya); // regula falsi
+				X sigma = sgn(xh - xf);
+				X xt = delta <= fabs(xh - xf) ? xf + sigma * delta : xh; // truncate
+				x = fabs(xt - xh) <= r ? xt : xh - sigma * r; // project
+				y = s * f(x);
+				++n;
+				if (y > 0) {
+					b = x;
+					yb = y;
+				}
+				else if (y < 0) {
+					a = x;
+					ya = y;
+				}
+				else {
+					a = b = x;
+				}
+				if (fabs(y) <= tolerance) {
+					break;
+				}
+			}
+			// also if no iteration was taken
+			if (!(fabs(y) <= tolerance)) {
+				x = (a + b) / 2;
+				y = s * f(x);
+			}
+
+			return { x, s * y, n };
+		}
+	};
+#ifdef _DEBUG
+	inline int test_itp()
+	{
+		{
+			auto [x, y, n] = itp(0., 3.).solve([](double x) { return x * x - 4; });
+			assert(fabs(x - 2) <= sqrt_epsilon<double>);
+			assert(n < 20);
+		}
+		{
+			// decreasing
+			auto [x, y, n] = itp(0., 3.).solve([](double x) { return 4 - x * x; });
+			assert(fabs(x - 2) <= sqrt_epsilon<double>);
+		}
+		{
+			// no bracket
+			auto [x, y, n] = itp(3., 4.).solve([](double x) { return x * x - 4; });
+			assert(is_nan(x));
+		}
+		{
+			// worst case is bisection
+			auto [x, y, n] = itp(-1., 2., 1e-12).solve([](double x) { return x < 1 ? -1. : 1.; });
+			assert(fabs(x - 1) <= 1e-12);
+			assert(n <= 42);
+		}
+		{
+			// bracket already within tolerance
+			auto [x, y, n] = itp(2 - 1e-10, 2 + 1e-10).solve([](double x) { return x * x - 4; });
+			assert(n == 0 && x == 2 && y == 0);
+			std::tie(x, y, n) = itp(1.5, 2.5, 1.).solve([](double x) { return x * x - 4; });
+			assert(n == 0 && x == 2 && y == 0);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
 } // namespace fms::secant
 
@@ -0,0 +1,301 @@
+// fsl_root1d_batch.h - Solve many independent 1-d problems in lockstep
+/*
+The objective is evaluated for all active problems at once
+
+	f(m, i, x, y) sets y[j] = f_{i[j]}(x[j]) for 0 <= j < m
+
+so it can be written as a loop the compiler vectorizes. Solver state is kept
+in structure of array form for active problems only. After each iteration
+converged problems are written to the output and the active set is compacted
+so every lane of the next evaluation does useful work.
+*/
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "fsl_root1d.h"
+
+namespace fsl::root1d {
+
+	// Keep lanes j < m with keep[j] != 0, preserving order. Return new number of lanes.
+	template<class... A>
+	inline size_t compact(size_t m, const unsigned char* keep, A*... a)
+	{
+		size_t w = 0;
+		for (size_t j = 0; j < m; ++j) {
+			if (keep[j]) {
+				if (w != j) {
+					((a[w] = a[j]), ...);
+				}
+				++w;
+			}
+		}
+
+		return w;
+	}
+
+	// Secant method for n problems given two initial guesses each.
+	template<class X = double>
+	struct batch_secant {
+		X tolerance;
+		size_t iterations;
+
+		batch_secant(X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: tolerance(tol), iterations(iter)
+		{ }
+
+		// Set roots x[i], residuals y[i], and iteration counts iter[i] if not null.
+		// Unconverged roots are NaN. Return the number of converged problems.
+		template<class F>
+		size_t solve(const F& f, size_t n, const X* x0, const X* x1, X* x, X* y = nullptr, size_t* iter = nullptr)
+		{
+			std::vector<size_t> i(n);
+			std::iota(i.begin(), i.end(), size_t(0));
+			std::vector<X> a(x0, x0 + n), fa(n), b(x1, x1 + n), fb(n), c(n), fc(n);
+			std::vector<unsigned char> keep(n), bounded(n);
+			f(n, i.data(), a.data(), fa.data());
+			f(n, i.data(), b.data(), fb.data());
+			for (size_t j = 0; j < n; ++j) {
+				bounded[j] = !samesign(fa[j], fb[j]);
+			}
+
+			size_t m = n, solved = 0;
+			for (size_t k = 1; m > 0; ++k) {
+				const bool last = k >= iterations;
+				for (size_t j = 0; j < m; ++j) {
+					const bool done = fabs(fb[j]) <= tolerance;
+					keep[j] = !done && !last;
+					if (!keep[j]) {
+						x[i[j]] = done ? b[j] : NaN<X>;
+						if (y) y[i[j]] = fb[j];
+						if (iter) iter[i[j]] = k;
+						solved += done;
+					}
+				}
+				m = compact(m, keep.data(), i.data(), a.data(), fa.data(), b.data(), fb.data(), bounded.data());
+				for (size_t j = 0; j < m; ++j) {
+					c[j] = (a[j] * fb[j] - b[j] * fa[j]) / (fb[j] - fa[j]);
+				}
+				f(m, i.data(), c.data(), fc.data());
+				// Same update as secant::solve.
+				for (size_t j = 0; j < m; ++j) {
+					const bool keep_a = bounded[j] && samesign(fc[j], fb[j]);
+					a[j] = keep_a ? a[j] : b[j];
+					fa[j] = keep_a ? fa[j] : fb[j];
+					b[j] = c[j];
+					fb[j] = fc[j];
+					bounded[j] = keep_a || !samesign(fa[j], fb[j]);
+				}
+			}
+
+			return solved;
+		}
+	};
+
+	// Newton's method for n problems with derivative df and common domain [a, b].
+	template<class X = double>
+	struct batch_newton {
+		X tolerance;
+		size_t iterations;
+
+		batch_newton(X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: tolerance(tol), iterations(iter)
+		{ }
+
+		template<class F, class dF>
+		size_t solve(const F& f, const dF& df, size_t n, const X* x0, X* x, X* y = nullptr, size_t* iter = nullptr,
+			X a = -infinity<X>, X b = infinity<X>)
+		{
+			std::vector<size_t> i(n);
+			std::iota(i.begin(), i.end(), size_t(0));
+			std::vector<X> x_(x0, x0 + n), fx(n), dfx(n);
+			std::vector<unsigned char> keep(n);
+			f(n, i.data(), x_.data(), fx.data());
+
+			size_t m = n, solved = 0;
+			for (size_t k = 1; m > 0; ++k) {
+				const bool last = k >= iterations;
+				for (size_t j = 0; j < m; ++j) {
+					const bool done = fabs(fx[j]) <= tolerance;
+					keep[j] = !done && !last;
+					if (!keep[j]) {
+						x[i[j]] = done ? x_[j] : NaN<X>;
+						if (y) y[i[j]] = fx[j];
+						if (iter) iter[i[j]] = k;
+						solved += done;
+					}
+				}
+				m = compact(m, keep.data(), i.data(), x_.data(), fx.data());
+				df(m, i.data(), x_.data(), dfx.data());
+				for (size_t j = 0; j < m; ++j) {
+					X xj = x_[j] - fx[j] / dfx[j];
+					// same as bracket(xj, x_[j], a, b) without branches
+					xj = xj < a ? (x_[j] + a) / 2 : xj;
+					xj = xj > b ? (x_[j] + b) / 2 : xj;
+					x_[j] = xj;
+				}
+				f(m, i.data(), x_.data(), fx.data());
+			}
+
+			return solved;
+		}
+	};
+
+	// Brent's method for n problems given brackets [a[i], b[i]].
+	// The step logic is per lane but all objective evaluations are batched.
+	template<class X = double>
+	struct batch_brent {
+		X tolerance;
+		size_t iterations;
+
+		batch_brent(X tol = sqrt_epsilon<X>, size_t iter = 100)
+			: tolerance(tol), iterations(iter)
+		{ }
+
+		template<class F>
+		size_t solve(const F& f, size_t n, const X* a0, const X* b0, X* x, X* y = nullptr, size_t* iter = nullptr)
+		{
+			std::vector<size_t> i(n);
+			std::iota(i.begin(), i.end(), size_t(0));
+			std::vector<X> a(a0, a0 + n), b(b0, b0 + n), c(n), d(n), e(n), fa(n), fb(n), fc(n);
+			std::vector<unsigned char> keep(n);
+			f(n, i.data(), a.data(), fa.data());
+			f(n, i.data(), b.data(), fb.data());
+
+			size_t solved = 0;
+			const auto finish = [&](size_t j, X xj, X yj, size_t k, bool done) {
+				x[i[j]] = done ? xj : NaN<X>;
+				if (y) y[i[j]] = yj;
+				if (iter) iter[i[j]] = k;
+				solved += done;
+			};
+
+			// Drop problems without a bracket.
+			for (size_t j = 0; j < n; ++j) {
+				keep[j] = !(is_nan(a[j]) || is_nan(b[j]) || (samesign(fa[j], fb[j]) && fa[j] != 0));
+				if (!keep[j]) {
+					finish(j, NaN<X>, NaN<X>, 0, false);
+				}
+				c[j] = a[j];
+				fc[j] = fa[j];
+				d[j] = e[j] = b[j] - a[j];
+			}
+			size_t m = compact(n, keep.data(), i.data(), a.data(), b.data(), c.data(), d.data(), e.data(), fa.data(), fb.data(), fc.data());
+
+			for (size_t k = 1; m > 0; ++k) {
+				for (size_t j = 0; j < m; ++j) {
+					if (samesign(fb[j], fc[j]) && fb[j] != 0) {
+						c[j] = a[j];
+						fc[j] = fa[j];
+						d[j] = e[j] = b[j] - a[j];
+					}
+					if (fabs(fc[j]) < fabs(fb[j])) {
+						a[j] = b[j];
+						b[j] = c[j];
+						c[j] = a[j];
+						fa[j] = fb[j];
+						fb[j] = fc[j];
+						fc[j] = fa[j];
+					}
+					X tol = 2 * epsilon<X> * fabs(b[j]) + tolerance;
+					X xm = (c[j] - b[j]) / 2;
+					const bool done = fabs(xm) <= tol || fabs(fb[j]) <= tolerance;
+					keep[j] = !done && k < iterations;
+					if (!keep[j]) {
+						finish(j, b[j], fb[j], k, done);
+						continue;
+					}
+					if (fabs(e[j]) >= tol && fabs(fa[j]) > fabs(fb[j])) {
+						X p, q, s = fb[j] / fa[j];
+						if (a[j] == c[j]) {
+							p = 2 * xm * s;
+							q = 1 - s;
+						}
+						else {
+							X q_ = fa[j] / fc[j], r = fb[j] / fc[j];
+							p = s * (2 * xm * q_ * (q_ - r) - (b[j] - a[j]) * (r - 1));
+							q = (q_ - 1) * (r - 1) * (s - 1);
+						}
+						if (p > 0) {
+							q = -q;
+						}
+						p = fabs(p);
+						if (2 * p < std::min(3 * xm * q - fabs(tol * q), fabs(e[j] * q))) {
+							e[j] = d[j];
+							d[j] = p / q;
+						}
+						else {
+							d[j] = e[j] = xm;
+						}
+					}
+					else {
+						d[j] = e[j] = xm;
+					}
+					a[j] = b[j];
+					fa[j] = fb[j];
+					b[j] += fabs(d[j]) > tol ? d[j] : (xm > 0 ? tol : -tol);
+				}
+				m = compact(m, keep.data(), i.data(), a.data(), b.data(), c.data(), d.data(), e.data(), fa.data(), fb.data(), fc.data());
+				f(m, i.data(), b.data(), fb.data());
+			}
+
+			return solved;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_batch_root1d()
+	{
+		// x^2 - i - 1 = 0 has root sqrt(i + 1)
+		const auto f = [](size_t m, const size_t* i, const double* x, double* y) {
+			for (size_t j = 0; j < m; ++j) {
+				y[j] = x[j] * x[j] - double(i[j] + 1);
+			}
+		};
+		const auto df = [](size_t m, const size_t*, const double* x, double* y) {
+			for (size_t j = 0; j < m; ++j) {
+				y[j] = 2 * x[j];
+			}
+		};
+		constexpr size_t n = 100;
+		std::vector<double> x0(n, 1.), x1(n, 2.), a(n, 0.), b(n), x(n), y(n);
+		std::vector<size_t> iter(n);
+		for (size_t i = 0; i < n; ++i) {
+			b[i] = double(i + 1);
+		}
+		{
+			assert(n == batch_secant<>().solve(f, n, x0.data(), x1.data(), x.data(), y.data(), iter.data()));
+			for (size_t i = 0; i < n; ++i) {
+				assert(fabs(x[i] - std::sqrt(i + 1.)) < 1e-8);
+				auto [x_, y_, n_] = secant(1., 2.).solve([i](double x) { return x * x - double(i + 1); });
+				assert(x[i] == x_ && iter[i] == n_);
+			}
+		}
+		{
+			assert(n == batch_newton<>().solve(f, df, n, x1.data(), x.data(), y.data(), iter.data(), 0.));
+			for (size_t i = 0; i < n; ++i) {
+				assert(fabs(x[i] - std::sqrt(i + 1.)) < 1e-8);
+			}
+		}
+		{
+			b[0] = 2; // bracket sqrt(1)
+			assert(n == batch_brent<>().solve(f, n, a.data(), b.data(), x.data(), y.data(), iter.data()));
+			for (size_t i = 0; i < n; ++i) {
+				auto [x_, y_, n_] = brent(a[i], b[i]).solve([i](double x) { return x * x - double(i + 1); });
+				assert(x[i] == x_ && iter[i] == n_);
+			}
+		}
+		{
+			// failures
+			a[1] = 3; // no bracket
+			assert(n - 1 == batch_brent<>().solve(f, n, a.data(), b.data(), x.data()));
+			assert(is_nan(x[1]));
+			assert(n > batch_secant<>(1e-8, 2).solve(f, n, x0.data(), x1.data(), x.data()));
+			assert(is_nan(x[n - 1]));
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl::root1d
@@ -0,0 +1,241 @@
+// fsl_root1d_telemetry.h - Opt-in call site statistics for root1d solvers
+/*
+Each call site declares a static telemetry object that registers itself in a
+lock-free list. While telemetry::enabled is set, root1d::solve records
+iterations, function evaluations, failures, NaN residuals, and wall time
+using relaxed atomic counters so any number of threads can record at once.
+When disabled the only overhead is one relaxed load.
+*/
+#pragma once
+#include <cassert>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "fsl_root1d.h"
+
+// Reference to a static telemetry object for this call site.
+#define FSL_ROOT1D_SITE(name) ([]() -> fsl::root1d::telemetry& { static fsl::root1d::telemetry site(name); return site; }())
+
+namespace fsl::root1d {
+
+	class telemetry {
+		inline static std::atomic<telemetry*> head_ = nullptr;
+		telemetry* next_ = nullptr;
+	public:
+		// Iteration histogram buckets are 1, 2, 3-4, 5-8, ..., 65-128, more than 128.
+		static constexpr size_t buckets = 9;
+		inline static std::atomic<bool> enabled = false;
+
+		const char* name;
+		std::atomic<uint64_t> calls = 0;
+		std::atomic<uint64_t> iterations = 0;
+		std::atomic<uint64_t> evaluations = 0;
+		std::atomic<uint64_t> failures = 0; // root is NaN
+		std::atomic<uint64_t> nans = 0; // residual is NaN
+		std::atomic<uint64_t> nanoseconds = 0;
+		std::array<std::atomic<uint64_t>, buckets> histogram = {};
+
+		telemetry(const char* name)
+			: name(name)
+		{
+			next_ = head_.load(std::memory_order_relaxed);
+			while (!head_.compare_exchange_weak(next_, this, std::memory_order_release, std::memory_order_relaxed))
+				;
+		}
+		telemetry(const telemetry&) = delete;
+		telemetry& operator=(const telemetry&) = delete;
+		// Call sites are static and never unregister.
+		~telemetry() = default;
+
+		static constexpr size_t bucket(size_t n)
+		{
+			size_t b = 0;
+			for (size_t m = 1; m < n && b < buckets - 1; m *= 2) {
+				++b;
+			}
+
+			return b;
+		}
+
+		void record(size_t n, size_t evals, bool failed, bool nan, uint64_t ns)
+		{
+			calls.fetch_add(1, std::memory_order_relaxed);
+			iterations.fetch_add(n, std::memory_order_relaxed);
+			evaluations.fetch_add(evals, std::memory_order_relaxed);
+			failures.fetch_add(failed, std::memory_order_relaxed);
+			nans.fetch_add(nan, std::memory_order_relaxed);
+			nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+			histogram[bucket(n)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void clear()
+		{
+			calls = iterations = evaluations = failures = nans = nanoseconds = 0;
+			for (auto& h : histogram) {
+				h = 0;
+			}
+		}
+
+		// Registered call sites, most recent first.
+		static const telemetry* first()
+		{
+			return head_.load(std::memory_order_acquire);
+		}
+		const telemetry* next() const
+		{
+			return next_;
+		}
+
+		static void reset()
+		{
+			for (auto p = head_.load(std::memory_order_acquire); p; p = p->next_) {
+				p->clear();
+			}
+		}
+
+		// One line per call site that has been called.
+		static std::ostream& report(std::ostream& os)
+		{
+			os << std::left << std::setw(24) << "site" << std::right
+				<< std::setw(12) << "calls" << std::setw(12) << "iter/call" << std::setw(12) << "eval/call"
+				<< std::setw(10) << "failures" << std::setw(10) << "nans" << std::setw(12) << "us/call"
+				<< "  histogram 1 2 4 8 16 32 64 128 >128\n";
+			for (auto p = first(); p; p = p->next()) {
+				const double n = static_cast<double>(p->calls.load());
+				if (n == 0) {
+					continue;
+				}
+				os << std::left << std::setw(24) << p->name << std::right
+					<< std::setw(12) << p->calls.load()
+					<< std::setw(12) << p->iterations.load() / n
+					<< std::setw(12) << p->evaluations.load() / n
+					<< std::setw(10) << p->failures.load()
+					<< std::setw(10) << p->nans.load()
+					<< std::setw(12) << p->nanoseconds.load() / n / 1000 << " ";
+				for (const auto& h : p->histogram) {
+					os << " " << h.load();
+				}
+				os << "\n";
+			}
+
+			return os;
+		}
+	};
+#ifdef _DEBUG
+	static_assert(telemetry::bucket(0) == 0);
+	static_assert(telemetry::bucket(1) == 0);
+	static_assert(telemetry::bucket(2) == 1);
+	static_assert(telemetry::bucket(3) == 2);
+	static_assert(telemetry::bucket(4) == 2);
+	static_assert(telemetry::bucket(5) == 3);
+	static_assert(telemetry::bucket(1000) == telemetry::buckets - 1);
+#endif // _DEBUG
+
+	// Times a solve and records it at site if telemetry is enabled.
+	class telemetry_scope {
+		telemetry& site_;
+		bool on_;
+		std::chrono::steady_clock::time_point t0_;
+	public:
+		size_t evaluations = 0;
+
+		telemetry_scope(telemetry& site)
+			: site_(site), on_(telemetry::enabled.load(std::memory_order_relaxed))
+		{
+			if (on_) {
+				t0_ = std::chrono::steady_clock::now();
+			}
+		}
+		bool on() const
+		{
+			return on_;
+		}
+		template<class X, class Y>
+		void record(size_t n, X x, Y y)
+		{
+			if (on_) {
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0_).count();
+				site_.record(n, evaluations, is_nan(x), is_nan(y), static_cast<uint64_t>(ns));
+			}
+		}
+	};
+
+	// Count calls of a if it is a function, e.g. the derivative for Newton's method.
+	template<class A>
+	inline decltype(auto) counted(telemetry_scope& ts, A&& a)
+	{
+		if constexpr (std::is_invocable_v<A, double>) {
+			return [&ts, &a](auto x) { ++ts.evaluations; return a(x); };
+		}
+		else {
+			return std::forward<A>(a);
+		}
+	}
+
+	// Call solver.solve(f, args...) and record the result at site.
+	// Every call of f and of any function in args is one evaluation.
+	template<class S, class F, class... Args>
+	inline auto solve(telemetry& site, S&& solver, const F& f, Args&&... args)
+	{
+		telemetry_scope ts(site);
+		if (!ts.on()) {
+			return solver.solve(f, std::forward<Args>(args)...);
+		}
+
+		const auto f_ = [&f, &ts](auto x) { ++ts.evaluations; return f(x); };
+		auto result = solver.solve(f_, counted(ts, std::forward<Args>(args))...);
+		ts.record(std::get<2>(result), std::get<0>(result), std::get<1>(result));
+
+		return result;
+	}
+
+#ifdef _DEBUG
+	inline int test_root1d_telemetry()
+	{
+		{
+			auto& site = FSL_ROOT1D_SITE("test_root1d_telemetry");
+			const auto f = [](double x) { return x * x - 4; };
+			telemetry::enabled = false;
+			solve(site, brent(0., 3.), f);
+			assert(site.calls == 0);
+
+			telemetry::enabled = true;
+			auto [x, y, n] = solve(site, brent(0., 3.), f);
+			assert(fabs(x - 2) <= sqrt_epsilon<double>);
+			assert(site.calls == 1);
+			assert(site.iterations == n);
+			assert(site.evaluations == n + 1);
+			assert(site.histogram[telemetry::bucket(n)] == 1);
+			solve(site, brent(3., 4.), f);
+			assert(site.calls == 2 && site.failures == 1);
+			const uint64_t e = site.evaluations;
+			auto [x_, y_, n_] = solve(site, newton(1.), f, [](double x) { return 2 * x; });
+			assert(site.calls == 3);
+			// value and derivative each step
+			assert(site.evaluations - e == 2 * n_ - 1);
+			telemetry::enabled = false;
+
+			bool found = false;
+			for (auto p = telemetry::first(); p; p = p->next()) {
+				found = found || p == &site;
+			}
+			assert(found);
+			std::ostringstream os;
+			telemetry::report(os);
+			assert(os.str().find("test_root1d_telemetry") != std::string::npos);
+			site.clear();
+			assert(site.calls == 0);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl::root1d
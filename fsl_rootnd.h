@@ -0,0 +1,427 @@
+// fsl_rootnd.h - n-d nonlinear least squares using Levenberg-Marquardt
+/*
+Minimize |r(x)|^2 = sum_i r_i(x)^2 for residuals r: R^n -> R^m, m >= n.
+Each iteration solves the damped normal equations
+
+	(J'J + λ diag(J'J)) dx = -J'r
+
+where J = dr/dx is the m x n Jacobian. The step is accepted and λ decreased if
+it reduces the sum of squares, otherwise λ is increased and the step retried.
+
+If every residual only depends on nearby parameters then J'J is banded and the
+normal equations are solved with a banded Cholesky factorization in O(n k^2)
+instead of O(n^3) for half bandwidth k.
+
+Workspace is kept in the solver, as is λ, so calling solve again with the
+previous solution as the initial guess (warm start) does not allocate and
+usually takes one or two iterations.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include "fsl_math.h"
+
+namespace fsl::rootnd {
+
+	// Solve A x = b in place for symmetric positive definite n x n row major A.
+	// A is overwritten by its Cholesky factor and b by x. Return false if A is not positive definite.
+	template<class X>
+	inline bool cholesky(size_t n, X* A, X* b)
+	{
+		for (size_t j = 0; j < n; ++j) {
+			X* Aj = A + j * n;
+			X d = Aj[j];
+			for (size_t k = 0; k < j; ++k) {
+				d -= Aj[k] * Aj[k];
+			}
+			if (!(d > 0)) {
+				return false;
+			}
+			d = std::sqrt(d);
+			Aj[j] = d;
+			for (size_t i = j + 1; i < n; ++i) {
+				X* Ai = A + i * n;
+				X s = Ai[j];
+				for (size_t k = 0; k < j; ++k) {
+					s -= Ai[k] * Aj[k];
+				}
+				Ai[j] = s / d;
+			}
+		}
+		// L y = b
+		for (size_t i = 0; i < n; ++i) {
+			X s = b[i];
+			for (size_t k = 0; k < i; ++k) {
+				s -= A[i * n + k] * b[k];
+			}
+			b[i] = s / A[i * n + i];
+		}
+		// L' x = y
+		for (size_t i = n; i-- > 0; ) {
+			X s = b[i];
+			for (size_t k = i + 1; k < n; ++k) {
+				s -= A[k * n + i] * b[k];
+			}
+			b[i] = s / A[i * n + i];
+		}
+
+		return true;
+	}
+
+	// Banded version of cholesky for half bandwidth k.
+	// Lower band is stored by row with A[i*(k + 1) + k - (i - j)] = A_ij for i - k <= j <= i.
+	template<class X>
+	inline bool cholesky(size_t n, size_t k, X* A, X* b)
+	{
+		const size_t w = k + 1;
+		const auto a = [A, w, k](size_t i, size_t j) -> X& { return A[i * w + k - (i - j)]; };
+
+		for (size_t j = 0; j < n; ++j) {
+			const size_t j0 = j > k ? j - k : 0;
+			X d = a(j, j);
+			for (size_t l = j0; l < j; ++l) {
+				d -= a(j, l) * a(j, l);
+			}
+			if (!(d > 0)) {
+				return false;
+			}
+			d = std::sqrt(d);
+			a(j, j) = d;
+			for (size_t i = j + 1; i < std::min(n, j + w); ++i) {
+				const size_t i0 = i > k ? i - k : 0;
+				X s = a(i, j);
+				for (size_t l = std::max(i0, j0); l < j; ++l) {
+					s -= a(i, l) * a(j, l);
+				}
+				a(i, j) = s / d;
+			}
+		}
+		for (size_t i = 0; i < n; ++i) {
+			X s = b[i];
+			for (size_t l = i > k ? i - k : 0; l < i; ++l) {
+				s -= a(i, l) * b[l];
+			}
+			b[i] = s / a(i, i);
+		}
+		for (size_t i = n; i-- > 0; ) {
+			X s = b[i];
+			for (size_t l = i + 1; l < std::min(n, i + w); ++l) {
+				s -= a(l, i) * b[l];
+			}
+			b[i] = s / a(i, i);
+		}
+
+		return true;
+	}
+#ifdef _DEBUG
+	inline int test_cholesky()
+	{
+		{
+			double A[] = { 4, 2, 2, 3 };
+			double b[] = { 2, 1 };
+			assert(cholesky(2, A, b));
+			assert(fabs(b[0] - 0.5) < 1e-15 && fabs(b[1]) < 1e-15);
+		}
+		{
+			double A[] = { 1, 2, 2, 1 };
+			double b[] = { 1, 1 };
+			assert(!cholesky(2, A, b));
+		}
+		{
+			// tridiagonal 2 on diagonal, -1 off diagonal
+			constexpr size_t n = 6;
+			double A[n * n] = {}, B[2 * n] = {}, b[n], c[n];
+			for (size_t i = 0; i < n; ++i) {
+				A[i * n + i] = 2;
+				B[i * 2 + 1] = 2;
+				if (i > 0) {
+					A[i * n + i - 1] = A[(i - 1) * n + i] = -1;
+					B[i * 2] = -1;
+				}
+				b[i] = c[i] = double(i);
+			}
+			assert(cholesky(n, A, b));
+			assert(cholesky(n, 1, B, c));
+			for (size_t i = 0; i < n; ++i) {
+				assert(fabs(b[i] - c[i]) < 1e-13);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	// Levenberg-Marquardt for m residuals of n parameters.
+	template<class X = double>
+	struct levenberg_marquardt {
+		size_t n, m;
+		X tolerance;
+		size_t iterations;
+		size_t band; // half bandwidth of J'J, n for dense
+		X lambda = X(1e-3); // damping carried over between calls
+		size_t evaluations = 0; // residual evaluations in last solve
+	private:
+		std::vector<X> r_, r1_, x1_, J_, A_, B_, g_, dx_, rh_;
+	public:
+
+		levenberg_marquardt(size_t n, size_t m, X tol = sqrt_epsilon<X>, size_t iter = 100, size_t band = 0)
+			: n(n), m(m), tolerance(tol), iterations(iter), band(band && band < n ? band : n),
+			r_(m), r1_(m), x1_(n), J_(m * n), A_(n * (this->band < n ? this->band + 1 : n)), B_(A_.size()), g_(n), dx_(n)
+		{
+			if (m < n) {
+				throw std::invalid_argument("levenberg_marquardt: need at least as many residuals as parameters");
+			}
+		}
+
+		// Reset damping before solving an unrelated problem.
+		levenberg_marquardt& reset(X lambda0 = X(1e-3))
+		{
+			lambda = lambda0;
+
+			return *this;
+		}
+
+		// Residuals at the last accepted point.
+		const X* residual() const
+		{
+			return r_.data();
+		}
+		// Row major m x n Jacobian at the last accepted point.
+		const X* jacobian() const
+		{
+			return J_.data();
+		}
+
+		// Minimize |r(x)|^2 in place given f(x, r) setting r[0..m) and df(x, J) setting the row major Jacobian.
+		// Return sum of squared residuals, max norm of gradient J'r, and number of iterations.
+		// The sum of squares is NaN if not converged in which case x is the best point found.
+		template<class F, class dF>
+		std::tuple<X, X, size_t> solve(const F& f, const dF& df, X* x)
+		{
+			const bool banded = band < n;
+			const size_t w = banded ? band + 1 : n;
+			A_.resize(n * w);
+			B_.resize(n * w);
+
+			f(x, r_.data());
+			evaluations = 1;
+			X ss = sum2(r_.data());
+			X gmax = NaN<X>;
+			size_t k = 0;
+			bool done = false;
+			while (!done && ++k < iterations) {
+				df(x, J_.data());
+				// normal equations
+				std::fill(A_.begin(), A_.end(), X(0));
+				std::fill(g_.begin(), g_.end(), X(0));
+				for (size_t l = 0; l < m; ++l) {
+					const X* Jl = &J_[l * n];
+					for (size_t i = 0; i < n; ++i) {
+						if (Jl[i] == 0) {
+							continue;
+						}
+						g_[i] += Jl[i] * r_[l];
+						const size_t j0 = banded && i > band ? i - band : 0;
+						X* Ai = banded ? &A_[i * w + band - (i - j0)] : &A_[i * n];
+						for (size_t j = j0; j <= i; ++j) {
+							*Ai++ += Jl[i] * Jl[j];
+						}
+					}
+				}
+				gmax = 0;
+				for (size_t i = 0; i < n; ++i) {
+					gmax = std::max(gmax, fabs(g_[i]));
+				}
+				if (gmax <= tolerance * tolerance) {
+					break;
+				}
+
+				// increase λ until the step decreases the sum of squares
+				while (true) {
+					std::copy(A_.begin(), A_.end(), B_.begin());
+					for (size_t i = 0; i < n; ++i) {
+						X& d = banded ? B_[i * w + band] : B_[i * n + i];
+						d += lambda * std::max(d, epsilon<X>);
+						dx_[i] = -g_[i];
+					}
+					bool pd = banded ? cholesky(n, band, B_.data(), dx_.data()) : cholesky(n, B_.data(), dx_.data());
+					if (pd) {
+						X dxmax = 0, xmax = 0;
+						for (size_t i = 0; i < n; ++i) {
+							x1_[i] = x[i] + dx_[i];
+							dxmax = std::max(dxmax, fabs(dx_[i]));
+							xmax = std::max(xmax, fabs(x[i]));
+						}
+						f(x1_.data(), r1_.data());
+						++evaluations;
+						X ss1 = sum2(r1_.data());
+						// converged if the step is below tolerance, even if rounding makes it uphill
+						done = dxmax <= tolerance * (xmax + tolerance);
+						if (ss1 <= ss) {
+							done = done || ss - ss1 <= tolerance * tolerance * ss;
+							std::copy(x1_.begin(), x1_.end(), x);
+							std::swap(r_, r1_);
+							ss = ss1;
+							lambda = std::max(lambda / 10, X(1e-12));
+							break;
+						}
+						if (done) {
+							break;
+						}
+					}
+					lambda *= 10;
+					if (lambda > X(1e16)) {
+						k = iterations;
+						break;
+					}
+				}
+			}
+
+			return { k < iterations ? ss : NaN<X>, gmax, k };
+		}
+
+		// Minimize using a forward difference Jacobian.
+		template<class F>
+		std::tuple<X, X, size_t> solve(const F& f, X* x)
+		{
+			rh_.resize(m);
+			const auto df = [this, &f](X* x, X* J) {
+				for (size_t j = 0; j < n; ++j) {
+					const X xj = x[j];
+					const X h = sqrt_epsilon<X> * std::max(fabs(xj), X(1));
+					x[j] = xj + h;
+					f(x, rh_.data());
+					++evaluations;
+					x[j] = xj;
+					for (size_t i = 0; i < m; ++i) {
+						J[i * n + j] = (rh_[i] - r_[i]) / h;
+					}
+				}
+			};
+
+			return solve(f, df, x);
+		}
+
+	private:
+		X sum2(const X* r) const
+		{
+			X s = 0;
+			for (size_t i = 0; i < m; ++i) {
+				s += r[i] * r[i];
+			}
+
+			return s;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_levenberg_marquardt()
+	{
+		// Rosenbrock residuals 10(x_1 - x_0^2), 1 - x_0 have minimum 0 at (1, 1).
+		const auto f = [](const double* x, double* r) {
+			r[0] = 10 * (x[1] - x[0] * x[0]);
+			r[1] = 1 - x[0];
+		};
+		const auto df = [](const double* x, double* J) {
+			J[0] = -20 * x[0];
+			J[1] = 10;
+			J[2] = -1;
+			J[3] = 0;
+		};
+		{
+			levenberg_marquardt<> lm(2, 2);
+			double x[] = { -1.2, 1 };
+			auto [ss, g, k] = lm.solve(f, df, x);
+			assert(ss < 1e-20);
+			assert(fabs(x[0] - 1) < 1e-10 && fabs(x[1] - 1) < 1e-10);
+			assert(k < 100);
+
+			// warm start
+			x[0] += 1e-4;
+			auto [ss_, g_, k_] = lm.solve(f, df, x);
+			assert(ss_ < 1e-20 && k_ <= 3);
+		}
+		{
+			// finite difference Jacobian
+			levenberg_marquardt<> lm(2, 2);
+			double x[] = { -1.2, 1 };
+			auto [ss, g, k] = lm.solve(f, x);
+			assert(ss < 1e-16);
+			assert(fabs(x[0] - 1) < 1e-8 && fabs(x[1] - 1) < 1e-8);
+			assert(lm.evaluations > k);
+		}
+		{
+			// fit a exp(-b t) to noisy data
+			constexpr size_t m = 20;
+			double t[m], y[m];
+			for (size_t i = 0; i < m; ++i) {
+				t[i] = 0.25 * i;
+				y[i] = 2 * std::exp(-0.7 * t[i]) + 0.01 * ((i % 3) - 1.);
+			}
+			const auto e = [&](const double* x, double* r) {
+				for (size_t i = 0; i < m; ++i) {
+					r[i] = x[0] * std::exp(-x[1] * t[i]) - y[i];
+				}
+			};
+			levenberg_marquardt<> lm(2, m);
+			double x[] = { 1, 0.1 };
+			auto [ss, g, k] = lm.solve(e, x);
+			assert(!is_nan(ss));
+			assert(fabs(x[0] - 2) < 0.02 && fabs(x[1] - 0.7) < 0.02);
+
+			// warm restarts of an inexact fit stop at the first step below tolerance
+			// even if rounding makes it uphill
+			for (size_t i = 0; i < m; ++i) {
+				y[i] = 2 * std::exp(-0.7 * t[i]) + ((i % 3) - 1.);
+			}
+			const auto de = [&](const double* x, double* J) {
+				for (size_t i = 0; i < m; ++i) {
+					J[2 * i] = std::exp(-x[1] * t[i]);
+					J[2 * i + 1] = -t[i] * x[0] * J[2 * i];
+				}
+			};
+			levenberg_marquardt<> lm_(2, m);
+			double x_[] = { 1, 0.1 };
+			auto [ss0, g0, k0] = lm_.solve(e, de, x_);
+			assert(!is_nan(ss0));
+			for (int i = 0; i < 3; ++i) {
+				auto [ss_, g_, k_] = lm_.solve(e, de, x_);
+				assert(fabs(ss_ - ss0) <= 1e-12 * ss0);
+				assert(lm_.evaluations <= 2);
+			}
+		}
+		{
+			// chained residuals x_i - x_{i-1}^2/2 - 1 have tridiagonal J'J
+			constexpr size_t n = 50;
+			const auto c = [](const double* x, double* r) {
+				r[0] = x[0] - 0.5;
+				for (size_t i = 1; i < n; ++i) {
+					r[i] = x[i] - x[i - 1] * x[i - 1] / 4 - 0.5;
+				}
+			};
+			const auto dc = [](const double* x, double* J) {
+				std::fill(J, J + n * n, 0.);
+				J[0] = 1;
+				for (size_t i = 1; i < n; ++i) {
+					J[i * n + i] = 1;
+					J[i * n + i - 1] = -x[i - 1] / 2;
+				}
+			};
+			levenberg_marquardt<> dense(n, n), band(n, n, sqrt_epsilon<double>, 100, 1);
+			std::vector<double> x(n, 0.), y(n, 0.);
+			auto [ssx, gx, kx] = dense.solve(c, dc, x.data());
+			auto [ssy, gy, ky] = band.solve(c, dc, y.data());
+			assert(ssx < 1e-20 && ssy < 1e-20);
+			for (size_t i = 0; i < n; ++i) {
+				assert(fabs(x[i] - y[i]) < 1e-12);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl::rootnd
@@ -0,0 +1,437 @@
+// fsl_svi.h - Implied volatility surface from SVI slices
+/*
+Each expiry t_i has a raw SVI slice giving total implied variance w = s^2 = sigma^2 t
+as a function of log moneyness x = log(k/f)
+
+	w(x) = a + b (ρ (x - m) + sqrt((x - m)^2 + σ^2)).
+
+A slice has no butterfly arbitrage if
+
+	g(x) = (1 - x w'/(2w))^2 - (w'^2/4)(1/w + 1/4) + w''/2 >= 0
+
+and slices have no calendar arbitrage if w_i(x) <= w_{i+1}(x). Between
+expiries total variance is linear in t at fixed log moneyness, which keeps
+calendar arbitrage out if the slices do not cross. Before the first expiry
+and after the last, w(t, x) = w_i(x) t/t_i. Forwards are log linear in t.
+
+Slices are calibrated independently, and in parallel, by Levenberg-Marquardt
+on total variance from Black implied vols of undiscounted put prices.
+Parameters are mapped by b = exp(β), ρ = tanh(θ), σ = exp(ς) so the fit is
+unconstrained.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "fsl_black.h"
+#include "fsl_chain.h"
+#include "fsl_rootnd.h"
+
+namespace fsl {
+
+	template<class X = double>
+	struct svi {
+		X a, b, rho, m, sigma;
+
+		// Total variance at log moneyness x.
+		X operator()(X x) const
+		{
+			const X y = x - m;
+
+			return a + b * (rho * y + std::sqrt(y * y + sigma * sigma));
+		}
+		X dw(X x) const
+		{
+			const X y = x - m;
+
+			return b * (rho + y / std::sqrt(y * y + sigma * sigma));
+		}
+		X d2w(X x) const
+		{
+			const X y = x - m;
+			const X R = std::sqrt(y * y + sigma * sigma);
+
+			return b * sigma * sigma / (R * R * R);
+		}
+		// Butterfly arbitrage free where g(x) >= 0.
+		X g(X x) const
+		{
+			const X w = operator()(x);
+			const X w1 = dw(x);
+			const X u = 1 - x * w1 / (2 * w);
+
+			return u * u - w1 * w1 / 4 * (1 / w + X(0.25)) + d2w(x) / 2;
+		}
+		// Parameters give non-negative variance.
+		bool valid() const
+		{
+			return b >= 0 && fabs(rho) < 1 && sigma > 0 && a + b * sigma * std::sqrt(1 - rho * rho) >= 0;
+		}
+
+		// Least squares fit to total variances w at n log moneynesses x.
+		// Return the sum of squared residuals, NaN if not converged.
+		X fit(size_t n, const X* x, const X* w, size_t iter = 100)
+		{
+			if (n < 5) {
+				throw std::invalid_argument("svi: need at least five points to fit");
+			}
+			// initial guess from the smallest variance
+			if (!valid()) {
+				const size_t i = std::min_element(w, w + n) - w;
+				m = x[i];
+				rho = 0;
+				sigma = X(0.1);
+				b = X(0.1);
+				a = w[i] - b * sigma;
+			}
+			X p[5] = { a, std::log(b), std::atanh(rho), m, std::log(sigma) };
+			const auto param = [this](const X* p) {
+				a = p[0];
+				b = std::exp(p[1]);
+				rho = std::tanh(p[2]);
+				m = p[3];
+				sigma = std::exp(p[4]);
+			};
+			const auto r = [&](const X* p, X* r) {
+				param(p);
+				for (size_t i = 0; i < n; ++i) {
+					r[i] = operator()(x[i]) - w[i];
+				}
+			};
+			const auto dr = [&](const X* p, X* J) {
+				param(p);
+				for (size_t i = 0; i < n; ++i) {
+					const X y = x[i] - m;
+					const X R = std::sqrt(y * y + sigma * sigma);
+					X* Ji = J + 5 * i;
+					Ji[0] = 1;
+					Ji[1] = b * (rho * y + R);
+					Ji[2] = b * y * (1 - rho * rho);
+					Ji[3] = -b * (rho + y / R);
+					Ji[4] = b * sigma * sigma / R;
+				}
+			};
+			rootnd::levenberg_marquardt<X> lm(5, n, sqrt_epsilon<X>, iter);
+			auto [ss, g, k] = lm.solve(r, dr, p);
+			param(p);
+
+			return ss;
+		}
+	};
+
+	// Undiscounted put prices p at strikes k for expiry t and forward f.
+	template<class X = double>
+	struct svi_quotes {
+		X t, f;
+		std::vector<X> k, p;
+	};
+
+	template<class X = double>
+	class vol_surface {
+		std::vector<X> t_; // expiries
+		std::vector<X> f_; // forwards
+		std::vector<svi<X>> s_; // slices
+		std::vector<X> error_; // sum of squared total variance residuals of calibration
+		std::vector<X> logf_; // log forwards
+
+		// Number of expiries <= t.
+		size_t index(X t) const
+		{
+			return std::upper_bound(t_.begin(), t_.end(), t) - t_.begin();
+		}
+		X log_forward(size_t i, X t) const
+		{
+			if (i == 0) {
+				return logf_[0];
+			}
+			if (i == t_.size()) {
+				return logf_.back();
+			}
+
+			return logf_[i - 1] + (t - t_[i - 1]) * (logf_[i] - logf_[i - 1]) / (t_[i] - t_[i - 1]);
+		}
+		X total_variance(size_t i, X t, X x) const
+		{
+			if (i == 0) {
+				return s_[0](x) * t / t_[0];
+			}
+			if (i == t_.size()) {
+				return s_.back()(x) * t / t_.back();
+			}
+			const X u = (t - t_[i - 1]) / (t_[i] - t_[i - 1]);
+
+			return (1 - u) * s_[i - 1](x) + u * s_[i](x);
+		}
+		void cache()
+		{
+			logf_.resize(f_.size());
+			for (size_t i = 0; i < f_.size(); ++i) {
+				logf_[i] = std::log(f_[i]);
+			}
+		}
+	public:
+		// Surface from increasing expiries t, forwards f, and slices s.
+		vol_surface(size_t n, const X* t, const X* f, const svi<X>* s)
+			: t_(t, t + n), f_(f, f + n), s_(s, s + n), error_(n, X(0))
+		{
+			if (n == 0) {
+				throw std::invalid_argument("vol_surface: need at least one expiry");
+			}
+			for (size_t i = 0; i < n; ++i) {
+				if (!(t_[i] > (i ? t_[i - 1] : X(0)))) {
+					throw std::invalid_argument("vol_surface: expiries must be positive and increasing");
+				}
+				if (!(f_[i] > 0) || !s_[i].valid()) {
+					throw std::invalid_argument("vol_surface: forwards must be positive and slices valid");
+				}
+			}
+			cache();
+		}
+		// Calibrate one slice per expiry, in parallel, from put prices.
+		vol_surface(const std::vector<svi_quotes<X>>& q, bool parallel = true)
+			: t_(q.size()), f_(q.size()), s_(q.size(), svi<X>{ 0, 0, 0, 0, 0 }), error_(q.size())
+		{
+			if (q.empty()) {
+				throw std::invalid_argument("vol_surface: need at least one expiry");
+			}
+			std::vector<std::string> what(q.size());
+			const auto calibrate = [&](size_t i) {
+				try {
+					const auto& qi = q[i];
+					const size_t n = qi.k.size();
+					if (qi.p.size() != n) {
+						throw std::invalid_argument("vol_surface: need one put price per strike");
+					}
+					// drop missing quotes and prices outside max(k - f, 0) < p < k with no implied vol
+					std::vector<X> k, p;
+					for (size_t j = 0; j < n; ++j) {
+						const X kj = qi.k[j], pj = qi.p[j];
+						if (kj > 0 && pj > std::max(kj - qi.f, X(0)) && pj < kj) {
+							k.push_back(kj);
+							p.push_back(pj);
+						}
+					}
+					std::vector<X> f(k.size(), qi.f), s(k.size()), x;
+					black_put_implied(k.size(), f.data(), p.data(), k.data(), s.data());
+					size_t m = 0;
+					for (size_t j = 0; j < k.size(); ++j) {
+						if (std::isfinite(s[j])) {
+							x.push_back(std::log(k[j] / qi.f));
+							s[m++] = s[j] * s[j];
+						}
+					}
+					if (m < 5) {
+						throw std::invalid_argument("vol_surface: need at least five strikes with an implied vol");
+					}
+					t_[i] = qi.t;
+					f_[i] = qi.f;
+					error_[i] = s_[i].fit(m, x.data(), s.data());
+					if (is_nan(error_[i])) {
+						throw std::runtime_error("vol_surface: SVI fit did not converge");
+					}
+				}
+				catch (const std::exception& ex) {
+					what[i] = ex.what();
+				}
+			};
+			std::vector<size_t> idx(q.size());
+			std::iota(idx.begin(), idx.end(), size_t(0));
+			if (parallel) {
+				std::for_each(std::execution::par, idx.begin(), idx.end(), calibrate);
+			}
+			else {
+				std::for_each(idx.begin(), idx.end(), calibrate);
+			}
+			for (size_t i = 0; i < q.size(); ++i) {
+				if (!what[i].empty()) {
+					throw std::runtime_error("expiry " + std::to_string(i) + ": " + what[i]);
+				}
+				if (!(t_[i] > (i ? t_[i - 1] : X(0)))) {
+					throw std::invalid_argument("vol_surface: expiries must be positive and increasing");
+				}
+			}
+			cache();
+		}
+
+		// Calibrate from the usable quotes of each expiry of an option chain.
+		vol_surface(const option_chain<X>& oc, bool parallel = true)
+			: vol_surface(quotes(oc), parallel)
+		{ }
+		// Undiscounted put quotes of the usable rows of each expiry.
+		static std::vector<svi_quotes<X>> quotes(const option_chain<X>& oc)
+		{
+			std::vector<svi_quotes<X>> q(oc.size());
+			for (size_t j = 0; j < oc.size(); ++j) {
+				const auto v = oc[j];
+				q[j].t = v.t;
+				q[j].f = v.f;
+				for (size_t i = 0; i < v.n; ++i) {
+					if (v.mask[i]) {
+						q[j].k.push_back(v.k[i]);
+						q[j].p.push_back(v.p[i] / v.D);
+					}
+				}
+			}
+
+			return q;
+		}
+
+		size_t size() const
+		{
+			return t_.size();
+		}
+		X expiry(size_t i) const
+		{
+			return t_[i];
+		}
+		const svi<X>& slice(size_t i) const
+		{
+			return s_[i];
+		}
+		// Sum of squared total variance residuals of calibration.
+		X error(size_t i) const
+		{
+			return error_[i];
+		}
+
+		// Forward at t, log linear between expiries and flat outside.
+		X forward(X t) const
+		{
+			return std::exp(log_forward(index(t), t));
+		}
+		// Total variance at expiry t and log moneyness x.
+		X total_variance(X t, X x) const
+		{
+			return total_variance(index(t), t, x);
+		}
+		// Black-Scholes/Merton implied vol at expiry t and strike k.
+		X vol(X t, X k) const
+		{
+			const size_t i = index(t);
+
+			return std::sqrt(total_variance(i, t, std::log(k) - log_forward(i, t)) / t);
+		}
+		// Implied vols for n expiries and strikes.
+		void vol(size_t n, const X* t, const X* k, X* s) const
+		{
+			for (size_t i = 0; i < n; ++i) {
+				s[i] = vol(t[i], k[i]);
+			}
+		}
+
+		// Most negative of butterfly g(x) and calendar w_{i+1}(x) - w_i(x) at n log moneynesses, or 0 if none.
+		X arbitrage(size_t n, const X* x) const
+		{
+			X e = 0;
+			for (size_t i = 0; i < s_.size(); ++i) {
+				for (size_t j = 0; j < n; ++j) {
+					e = std::min(e, s_[i].g(x[j]));
+					if (i + 1 < s_.size()) {
+						e = std::min(e, s_[i + 1](x[j]) - s_[i](x[j]));
+					}
+				}
+			}
+
+			return e;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_vol_surface()
+	{
+		const svi<> s[] = {
+			{ 0.01, 0.1, -0.4, 0.0, 0.1 },
+			{ 0.02, 0.12, -0.35, 0.02, 0.15 },
+			{ 0.045, 0.13, -0.3, 0.05, 0.2 },
+		};
+		const double t[] = { 0.25, 0.5, 1 };
+		const double f[] = { 100, 101, 102 };
+		{
+			vol_surface<> vs(3, t, f, s);
+			std::vector<double> x;
+			for (double x_ = -1; x_ <= 1; x_ += 0.05) {
+				x.push_back(x_);
+			}
+			assert(vs.arbitrage(x.size(), x.data()) == 0);
+			assert(fabs(vs.vol(0.5, 101) - std::sqrt(s[1](0) / 0.5)) < 1e-15);
+			assert(fabs(vs.forward(0.75) - std::sqrt(101. * 102)) < 1e-12);
+			assert(fabs(vs.total_variance(0.75, 0.1) - (s[1](0.1) + s[2](0.1)) / 2) < 1e-15);
+			assert(fabs(vs.total_variance(2, 0.1) - 2 * s[2](0.1)) < 1e-15);
+			double tt[] = { 0.1, 0.3, 1.5 }, k[] = { 90, 100, 120 }, v[3];
+			vs.vol(3, tt, k, v);
+			for (size_t i = 0; i < 3; ++i) {
+				assert(v[i] == vs.vol(tt[i], k[i]));
+			}
+
+			// crossing slices are a calendar arbitrage
+			const svi<> c[] = { s[2], s[0] };
+			vol_surface<> vc(2, t, f, c);
+			assert(vc.arbitrage(x.size(), x.data()) < 0);
+		}
+		{
+			// calibrate from Black put prices
+			std::vector<svi_quotes<>> q(3);
+			for (size_t i = 0; i < 3; ++i) {
+				q[i].t = t[i];
+				q[i].f = f[i];
+				for (double k = 70; k <= 140; k += 5) {
+					q[i].k.push_back(k);
+					q[i].p.push_back(black_put_value(f[i], std::sqrt(s[i](std::log(k / f[i]))), k));
+				}
+			}
+			vol_surface<> vs(q);
+			assert(vs.size() == 3);
+			for (size_t i = 0; i < 3; ++i) {
+				assert(vs.error(i) < 1e-12);
+				for (double k = 75; k <= 135; k += 10) {
+					const double x = std::log(k / f[i]);
+					assert(fabs(vs.slice(i)(x) - s[i](x)) < 1e-7);
+				}
+			}
+			vol_surface<> vs_(q, false);
+			assert(vs_.slice(2).a == vs.slice(2).a);
+
+			// missing and below intrinsic quotes are dropped
+			auto qn = q;
+			qn[1].p[0] = NaN<double>;
+			qn[1].p[1] = 0;
+			qn[1].p.back() = 0.5 * (qn[1].k.back() - f[1]);
+			vol_surface<> vn(qn);
+			for (double k = 85; k <= 135; k += 10) {
+				const double x = std::log(k / f[1]);
+				assert(fabs(vn.slice(1)(x) - s[1](x)) < 1e-6);
+			}
+			for (size_t j = 0; j + 4 < qn[2].p.size(); ++j) {
+				qn[2].p[j] = NaN<double>;
+			}
+			assert(throws<std::runtime_error>([&] { vol_surface<> v4(qn); }));
+			assert(throws<std::invalid_argument>([&] { vol_surface<> v0(std::vector<svi_quotes<>>{}); }));
+
+			// from a cleaned option chain with a bad quote
+			option_chain<> oc;
+			for (size_t i = 0; i < 3; ++i) {
+				std::vector<double> p = q[i].p, c(p.size());
+				p[4] *= 2;
+				for (size_t j = 0; j < p.size(); ++j) {
+					c[j] = p[j] + f[i] - q[i].k[j];
+				}
+				c[4] = q[i].p[4] + f[i] - q[i].k[4];
+				oc.add(t[i], f[i], 1, p.size(), q[i].k.data(), p.data(), c.data());
+			}
+			vol_surface<> vc(oc.clean());
+			for (size_t i = 0; i < 3; ++i) {
+				assert(!oc[i].mask[4]);
+				assert(fabs(vc.slice(i).a - vs.slice(i).a) < 1e-6);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -0,0 +1,324 @@
+// fsl_tick.h - Memory mapped columnar tick files.
+/*
+A tick file holds time and price observations for any number of underlyings.
+
+	tick_header            magic, version, number of series and ticks, column offsets
+	tick_series[n]         id, first tick, and number of ticks of each series
+	double t[m]            observation times, contiguous per series
+	double X[m]            observations, contiguous per series
+
+Columns start on a 64 byte boundary so a mapped view can be handed
+directly to the realized variance computation without parsing or copying.
+*/
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "fsl_vswap.h"
+
+namespace fsl {
+
+	constexpr char tick_magic[8] = { 'F', 'S', 'L', 'T', 'I', 'C', 'K', 0 };
+	constexpr uint32_t tick_version = 1;
+	constexpr uint64_t tick_align = 64;
+
+	struct tick_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t n; // number of series
+		uint64_t m; // total number of ticks
+		uint64_t t; // byte offset of time column
+		uint64_t X; // byte offset of price column
+	};
+
+	struct tick_series {
+		uint64_t id; // underlying identifier
+		uint64_t offset; // index of first tick in columns
+		uint64_t count; // number of ticks
+	};
+
+	// Non-owning view of the ticks of one underlying.
+	struct tick_view {
+		uint64_t id;
+		size_t n;
+		const double* t;
+		const double* X;
+	};
+
+	constexpr uint64_t tick_aligned(uint64_t off)
+	{
+		return (off + tick_align - 1) & ~(tick_align - 1);
+	}
+#ifdef _DEBUG
+	static_assert(tick_aligned(0) == 0);
+	static_assert(tick_aligned(1) == 64);
+	static_assert(tick_aligned(64) == 64);
+#endif // _DEBUG
+
+	// Write series of (t, X) observations keyed by id.
+	inline uint64_t tick_write(const std::filesystem::path& path,
+		const std::map<uint64_t, std::pair<std::vector<double>, std::vector<double>>>& series)
+	{
+		tick_header h{};
+		std::memcpy(h.magic, tick_magic, sizeof(h.magic));
+		h.version = tick_version;
+		h.n = static_cast<uint32_t>(series.size());
+
+		std::vector<tick_series> s;
+		s.reserve(series.size());
+		for (const auto& [id, tX] : series) {
+			if (tX.first.size() != tX.second.size()) {
+				throw std::invalid_argument("tick_write: time and price columns must have the same size");
+			}
+			s.push_back({ id, h.m, tX.first.size() });
+			h.m += tX.first.size();
+		}
+		h.t = tick_aligned(sizeof(tick_header) + h.n * sizeof(tick_series));
+		h.X = tick_aligned(h.t + h.m * sizeof(double));
+
+		std::ofstream os(path, std::ios::binary | std::ios::trunc);
+		if (!os) {
+			throw std::runtime_error("tick_write: unable to open " + path.string());
+		}
+		const auto pad = [&os](uint64_t off) {
+			static const char zero[tick_align] = {};
+			os.write(zero, off - static_cast<uint64_t>(os.tellp()));
+		};
+		os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		os.write(reinterpret_cast<const char*>(s.data()), s.size() * sizeof(tick_series));
+		pad(h.t);
+		for (const auto& [id, tX] : series) {
+			os.write(reinterpret_cast<const char*>(tX.first.data()), tX.first.size() * sizeof(double));
+		}
+		pad(h.X);
+		for (const auto& [id, tX] : series) {
+			os.write(reinterpret_cast<const char*>(tX.second.data()), tX.second.size() * sizeof(double));
+		}
+		if (!os) {
+			throw std::runtime_error("tick_write: error writing " + path.string());
+		}
+
+		return h.m;
+	}
+
+	// Convert lines of "id,t,X" to a tick file. Lines that do not parse are skipped.
+	// Ticks for each id are stored in the order they appear.
+	inline uint64_t tick_csv(const std::filesystem::path& csv, const std::filesystem::path& path)
+	{
+		std::ifstream is(csv, std::ios::binary);
+		if (!is) {
+			throw std::runtime_error("tick_csv: unable to open " + csv.string());
+		}
+		std::string buf(static_cast<size_t>(std::filesystem::file_size(csv)), '\0');
+		is.read(buf.data(), buf.size());
+
+		std::map<uint64_t, std::pair<std::vector<double>, std::vector<double>>> series;
+		const char* b = buf.data();
+		const char* e = b + buf.size();
+		while (b < e) {
+			const char* eol = std::find(b, e, '\n');
+			uint64_t id;
+			double t, X;
+			auto r = std::from_chars(b, eol, id);
+			if (r.ec == std::errc{} && r.ptr < eol && *r.ptr == ',') {
+				r = std::from_chars(r.ptr + 1, eol, t);
+			}
+			if (r.ec == std::errc{} && r.ptr < eol && *r.ptr == ',') {
+				r = std::from_chars(r.ptr + 1, eol, X);
+				if (r.ec == std::errc{}) {
+					auto& tX = series[id];
+					tX.first.push_back(t);
+					tX.second.push_back(X);
+				}
+			}
+			b = eol + (eol < e);
+		}
+
+		return tick_write(path, series);
+	}
+
+	// Read only memory mapped tick file.
+	class tick_file {
+		const char* p_ = nullptr; // mapped view
+		size_t size_ = 0;
+#ifdef _WIN32
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE map_ = nullptr;
+#endif
+		const tick_header* h_ = nullptr;
+		const tick_series* s_ = nullptr;
+
+		void close()
+		{
+#ifdef _WIN32
+			if (p_) UnmapViewOfFile(p_);
+			if (map_) CloseHandle(map_);
+			if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+			map_ = nullptr;
+			file_ = INVALID_HANDLE_VALUE;
+#else
+			if (p_) munmap(const_cast<char*>(p_), size_);
+#endif
+			p_ = nullptr;
+			size_ = 0;
+		}
+	public:
+		tick_file(const std::filesystem::path& path)
+		{
+#ifdef _WIN32
+			file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			LARGE_INTEGER size;
+			if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+				close();
+				throw std::runtime_error("tick_file: unable to open " + path.string());
+			}
+			size_ = static_cast<size_t>(size.QuadPart);
+			map_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			p_ = map_ ? static_cast<const char*>(MapViewOfFile(map_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+			int fd = ::open(path.c_str(), O_RDONLY);
+			struct stat st;
+			if (fd < 0 || fstat(fd, &st) != 0) {
+				if (fd >= 0) ::close(fd);
+				throw std::runtime_error("tick_file: unable to open " + path.string());
+			}
+			size_ = static_cast<size_t>(st.st_size);
+			void* p = size_ ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+			::close(fd);
+			p_ = p == MAP_FAILED ? nullptr : static_cast<const char*>(p);
+			if (p_) madvise(const_cast<char*>(p_), size_, MADV_SEQUENTIAL);
+#endif
+			if (!p_) {
+				close();
+				throw std::runtime_error("tick_file: unable to map " + path.string());
+			}
+
+			h_ = reinterpret_cast<const tick_header*>(p_);
+			if (size_ < sizeof(tick_header) || std::memcmp(h_->magic, tick_magic, sizeof(tick_magic)) != 0
+				|| h_->version != tick_version
+				|| h_->t < sizeof(tick_header) + h_->n * sizeof(tick_series)
+				|| h_->t + h_->m * sizeof(double) > h_->X
+				|| h_->X + h_->m * sizeof(double) > size_) {
+				close();
+				throw std::runtime_error("tick_file: invalid tick file " + path.string());
+			}
+			s_ = reinterpret_cast<const tick_series*>(h_ + 1);
+		}
+		tick_file(const tick_file&) = delete;
+		tick_file& operator=(const tick_file&) = delete;
+		~tick_file()
+		{
+			close();
+		}
+
+		// Number of series.
+		size_t size() const
+		{
+			return h_->n;
+		}
+		tick_view operator[](size_t i) const
+		{
+			if (i >= size() || s_[i].offset + s_[i].count > h_->m) {
+				throw std::out_of_range("tick_file: series index out of range");
+			}
+			const auto t = reinterpret_cast<const double*>(p_ + h_->t);
+			const auto X = reinterpret_cast<const double*>(p_ + h_->X);
+
+			return { s_[i].id, static_cast<size_t>(s_[i].count), t + s_[i].offset, X + s_[i].offset };
+		}
+
+		// Hint the OS to start reading [p, p + n) before it is used.
+		void prefetch(const void* p, size_t n) const
+		{
+			if (n == 0) return;
+#ifdef _WIN32
+			WIN32_MEMORY_RANGE_ENTRY r{ const_cast<void*>(p), n };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &r, 0);
+#else
+			const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+			const uintptr_t b = reinterpret_cast<uintptr_t>(p) & ~(page - 1);
+			madvise(reinterpret_cast<void*>(b), reinterpret_cast<uintptr_t>(p) + n - b, MADV_WILLNEED);
+#endif
+		}
+
+		// Stream series i into acc.add(m, t, X) in blocks, prefetching the next block.
+		template<class Acc>
+		Acc& stream(size_t i, Acc& acc, size_t block = 1 << 16) const
+		{
+			const tick_view v = operator[](i);
+			for (size_t j = 0; j < v.n; j += block) {
+				const size_t m = std::min(block, v.n - j);
+				const size_t k = std::min(block, v.n - j - m);
+				prefetch(v.t + j + m, k * sizeof(double));
+				prefetch(v.X + j + m, k * sizeof(double));
+				acc.add(m, v.t + j, v.X + j);
+			}
+
+			return acc;
+		}
+
+		// Realized variance statistics of series i.
+		vswap_realized<double> realized(size_t i, size_t block = 1 << 16) const
+		{
+			vswap_realized<double> r;
+
+			return stream(i, r, block);
+		}
+	};
+#ifdef _DEBUG
+	inline int test_tick_file()
+	{
+		const auto dir = std::filesystem::temp_directory_path();
+		const auto csv = dir / "fsl_test_tick.csv";
+		const auto bin = dir / "fsl_test_tick.bin";
+		{
+			std::ofstream os(csv);
+			os << "id,t,X\n2,0,100\n1,0,50\n2,1,110\n1,1,55\n2,2,99\n";
+		}
+		assert(tick_csv(csv, bin) == 5);
+		{
+			tick_file f(bin);
+			assert(f.size() == 2);
+			assert(f[0].id == 1 && f[0].n == 2);
+			assert(f[1].id == 2 && f[1].n == 3);
+			assert(reinterpret_cast<uintptr_t>(f[0].t) % tick_align == 0);
+			assert(f[1].X[2] == 99);
+
+			const double t[] = { 0, 1, 2 };
+			const double X[] = { 100, 110, 99 };
+			for (size_t block : {1, 2, 1024}) {
+				auto r = f.realized(1, block);
+				assert(r.variance() == realized_variance(3, t, X));
+				assert(r.pnl() == vswap_pnl(3, t, X));
+			}
+		}
+		std::filesystem::remove(csv);
+		std::filesystem::remove(bin);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -0,0 +1,293 @@
+// fsl_tree.h - Recombining trees for Black-Scholes/Merton options
+/*
+Binomial trees move S by u or d each step of length Δt = t/n with up
+probability p and trinomial trees move by u, 1, or 1/u.
+
+	CRR: u = exp(σ sqrt(Δt)), d = 1/u, p = (exp((r - q)Δt) - d)/(u - d)
+	Leisen-Reimer: p = h(d_2), p' = h(d_1), u = exp((r - q)Δt) p'/p,
+		d = (exp((r - q)Δt) - p u)/(1 - p) for odd n
+	Trinomial: u = exp(σ sqrt(2Δt)) with p_u and p_d matching the
+		moments of a two step binomial on half steps
+
+where h is the Peizer-Pratt inversion of the normal distribution. Leisen-Reimer
+converges at order 2 and smoothly so Richardson extrapolation of n and 2n
+steps gives (4 V_2n - V_n)/3. CRR and trinomial are order 1 but the error
+oscillates with the position of the strike among the nodes, so extrapolation
+can make them worse and is not applied.
+
+Backward induction over m options runs node by node with the options in the
+inner loop, V[i * m + j], so each step is a vectorized sweep. One buffer is
+reused for every step, both step counts, and every option in a block.
+Delta, gamma, and theta are read from the first two steps of the tree.
+Leisen-Reimer trees do not recombine at spot so gamma and theta use the
+quadratic through the step 2 values at s.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "fsl_pde.h"
+#ifdef _DEBUG
+#include "fsl_bsm.h"
+#endif // _DEBUG
+
+namespace fsl::tree {
+
+	enum class method { crr, leisen_reimer, trinomial };
+
+	// Peizer-Pratt method 2 inversion for n steps.
+	template<class X = double>
+	inline X peizer_pratt(X z, size_t n)
+	{
+		const X a = z / (n + X(1) / 3 + X(0.1) / (n + 1));
+
+		return X(0.5) + sgn(z) * std::sqrt(X(0.25) - X(0.25) * std::exp(-a * a * (n + X(1) / 6)));
+	}
+
+	template<class X = double>
+	struct lattice {
+		method type = method::leisen_reimer;
+		size_t n = 101; // steps
+		bool richardson = true; // extrapolate n and 2n steps for Leisen-Reimer
+		size_t block = 64; // options per parallel block
+
+		// Price m options. Options with barriers throw std::invalid_argument.
+		void price(size_t m, const pde::option<X>* o, pde::result<X>* res, bool parallel = true) const
+		{
+			for (size_t j = 0; j < m; ++j) {
+				if (!(o[j].s > 0) || !(o[j].k > 0) || !(o[j].sigma > 0) || !(o[j].t > 0)) {
+					throw std::invalid_argument("lattice: spot, strike, vol, and expiry must be positive");
+				}
+				if (o[j].lower > 0 || o[j].upper < std::numeric_limits<X>::infinity()) {
+					throw std::invalid_argument("lattice: barriers are not supported, use pde::crank_nicolson");
+				}
+			}
+			if (n < 2) {
+				throw std::invalid_argument("lattice: need at least two steps");
+			}
+			std::vector<size_t> b((m + block - 1) / block);
+			std::iota(b.begin(), b.end(), size_t(0));
+			const auto f = [&](size_t i) {
+				const size_t j = i * block;
+				const size_t mj = std::min(block, m - j);
+				std::vector<X> buf;
+				steps(n, mj, o + j, res + j, buf);
+				if (richardson && type == method::leisen_reimer) {
+					std::vector<pde::result<X>> r2(mj);
+					steps(2 * n, mj, o + j, r2.data(), buf);
+					const X w = X(4) / 3;
+					for (size_t k = 0; k < mj; ++k) {
+						auto& r = res[j + k];
+						r.value = w * r2[k].value + (1 - w) * r.value;
+						r.delta = w * r2[k].delta + (1 - w) * r.delta;
+						r.gamma = w * r2[k].gamma + (1 - w) * r.gamma;
+						r.theta = w * r2[k].theta + (1 - w) * r.theta;
+					}
+				}
+			};
+			if (parallel) {
+				std::for_each(std::execution::par, b.begin(), b.end(), f);
+			}
+			else {
+				std::for_each(b.begin(), b.end(), f);
+			}
+		}
+		pde::result<X> price(const pde::option<X>& o) const
+		{
+			pde::result<X> r;
+			price(1, &o, &r, false);
+
+			return r;
+		}
+
+	private:
+		// Backward induction with N steps using buf for the values.
+		void steps(size_t N, size_t m, const pde::option<X>* o, pde::result<X>* res, std::vector<X>& buf) const
+		{
+			if (type == method::leisen_reimer && N % 2 == 0) {
+				++N;
+			}
+			const bool tri = type == method::trinomial;
+			const size_t width = tri ? 2 * N + 1 : N + 1; // nodes at expiry
+			buf.resize(width * m);
+			X* V = buf.data();
+			// per option parameters
+			std::vector<X> u(m), d(m), pu(m), pm(m), pd(m), D(m), s0(m), ratio(m), S(m), k(m), sign(m), ex(m);
+			for (size_t j = 0; j < m; ++j) {
+				const auto& oj = o[j];
+				const X dt = oj.t / N;
+				const X g = std::exp((oj.r - oj.q) * dt);
+				D[j] = std::exp(-oj.r * dt);
+				k[j] = oj.k;
+				sign[j] = oj.call ? X(1) : X(-1);
+				ex[j] = oj.american ? X(1) : X(0);
+				if (type == method::crr) {
+					u[j] = std::exp(oj.sigma * std::sqrt(dt));
+					d[j] = 1 / u[j];
+					pu[j] = (g - d[j]) / (u[j] - d[j]);
+				}
+				else if (type == method::leisen_reimer) {
+					const X sd = oj.sigma * std::sqrt(oj.t);
+					const X d1 = (std::log(oj.s / oj.k) + (oj.r - oj.q) * oj.t) / sd + sd / 2;
+					const X p = peizer_pratt(d1 - sd, N);
+					pu[j] = p;
+					u[j] = g * peizer_pratt(d1, N) / p;
+					d[j] = (g - p * u[j]) / (1 - p);
+				}
+				else {
+					const X h = oj.sigma * std::sqrt(dt / 2);
+					const X a = std::exp((oj.r - oj.q) * dt / 2);
+					const X eh = std::exp(h);
+					const X q_ = (a - 1 / eh) / (eh - 1 / eh);
+					u[j] = eh * eh;
+					d[j] = 1 / u[j];
+					pu[j] = q_ * q_;
+					pd[j] = (1 - q_) * (1 - q_);
+					pm[j] = 1 - pu[j] - pd[j];
+				}
+				if (!tri) {
+					pd[j] = 1 - pu[j];
+				}
+				ratio[j] = tri ? u[j] : u[j] / d[j];
+				// lowest node at expiry
+				s0[j] = oj.s * std::pow(d[j], X(N));
+			}
+			// payoff
+			for (size_t j = 0; j < m; ++j) {
+				S[j] = s0[j];
+			}
+			for (size_t i = 0; i < width; ++i) {
+				for (size_t j = 0; j < m; ++j) {
+					V[i * m + j] = std::max(sign[j] * (S[j] - k[j]), X(0));
+					S[j] *= ratio[j];
+				}
+			}
+			// values at the first two steps for greeks
+			std::vector<X> w1(3 * m), w2(5 * m);
+			for (size_t step = N; step-- > 0; ) {
+				const size_t nodes = tri ? 2 * step + 1 : step + 1;
+				for (size_t j = 0; j < m; ++j) {
+					s0[j] /= d[j]; // lowest node
+					S[j] = s0[j];
+				}
+				for (size_t i = 0; i < nodes; ++i) {
+					X* Vi = V + i * m;
+					for (size_t j = 0; j < m; ++j) {
+						const X v = tri
+							? D[j] * (pd[j] * Vi[j] + pm[j] * Vi[m + j] + pu[j] * Vi[2 * m + j])
+							: D[j] * (pd[j] * Vi[j] + pu[j] * Vi[m + j]);
+						Vi[j] = std::max(v, ex[j] * sign[j] * (S[j] - k[j]));
+						S[j] *= ratio[j];
+					}
+				}
+				if (step == 2) {
+					std::copy(V, V + nodes * m, w2.data());
+				}
+				else if (step == 1) {
+					std::copy(V, V + nodes * m, w1.data());
+				}
+			}
+			for (size_t j = 0; j < m; ++j) {
+				const auto& oj = o[j];
+				const X dt = oj.t / N;
+				const X s = oj.s;
+				res[j].value = V[j];
+				if (tri) {
+					// step 1 nodes s/u, s, s u
+					const X sd = s * d[j], su = s * u[j];
+					const X vd = w1[j], vm = w1[m + j], vu = w1[2 * m + j];
+					res[j].delta = (vu - vd) / (su - sd);
+					res[j].gamma = ((vu - vm) / (su - s) - (vm - vd) / (s - sd)) / ((su - sd) / 2);
+					res[j].theta = (vm - V[j]) / dt;
+				}
+				else {
+					res[j].delta = (w1[m + j] - w1[j]) / (s * (u[j] - d[j]));
+					// quadratic through the step 2 nodes at s since s u d != s for Leisen-Reimer
+					const X x0 = s * d[j] * d[j], x1 = s * d[j] * u[j], x2 = s * u[j] * u[j];
+					const X v0 = w2[j], v1 = w2[m + j], v2 = w2[2 * m + j];
+					const X h0 = s - x0, h1 = s - x1, h2 = s - x2;
+					const X d0 = (x0 - x1) * (x0 - x2), d1 = (x1 - x0) * (x1 - x2), d2 = (x2 - x0) * (x2 - x1);
+					res[j].gamma = 2 * (v0 / d0 + v1 / d1 + v2 / d2);
+					const X v = v0 * h1 * h2 / d0 + v1 * h0 * h2 / d1 + v2 * h0 * h1 / d2;
+					res[j].theta = (v - V[j]) / (2 * dt);
+				}
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_lattice()
+	{
+		{
+			// Peizer-Pratt is symmetric and increasing
+			assert(peizer_pratt(0., 101) == 0.5);
+			assert(fabs(peizer_pratt(1., 101) + peizer_pratt(-1., 101) - 1) < 1e-15);
+			assert(peizer_pratt(0.5, 101) < peizer_pratt(1., 101));
+		}
+		std::vector<pde::option<>> o;
+		for (double k : { 80, 90, 100, 110, 120 }) {
+			o.push_back({ 100, k, 0.05, 0.02, 0.2, 1 });
+			o.push_back({ 100, k, 0.05, 0.02, 0.2, 1, true });
+		}
+		const auto bsm = [](const pde::option<>& o) {
+			auto e = bsm_expiry<>(o.s, o.t, pwflat::curve_view<>(o.r), pwflat::curve_view<>(o.q));
+			double p = e.put_value(o.sigma, o.k), d = e.put_delta(o.sigma, o.k);
+			if (o.call) {
+				p += e.D * (e.f - o.k);
+				d += e.Dq;
+			}
+			return pde::result<>{ p, d, e.put_gamma(o.sigma, o.k), 0 };
+		};
+		for (auto [type, tol] : { std::pair{ method::leisen_reimer, 1e-5 }, std::pair{ method::crr, 2e-2 }, std::pair{ method::trinomial, 1e-2 } }) {
+			// European against closed form
+			lattice<> l;
+			l.type = type;
+			std::vector<pde::result<>> r(o.size());
+			l.price(o.size(), o.data(), r.data());
+			for (size_t j = 0; j < o.size(); ++j) {
+				const auto b = bsm(o[j]);
+				assert(fabs(r[j].value - b.value) < tol);
+				assert(fabs(r[j].delta - b.delta) < (type == method::leisen_reimer ? 1e-3 : 2e-3));
+				assert(fabs(r[j].gamma - b.gamma) < 1e-3);
+			}
+			auto r3 = l.price(o[3]);
+			assert(fabs(r3.value - r[3].value) < 1e-14);
+			if (type != method::leisen_reimer) {
+				// Richardson extrapolation only applies to Leisen-Reimer
+				l.richardson = false;
+				assert(l.price(o[3]).value == r3.value);
+			}
+		}
+		{
+			// barriers are rejected
+			pde::option<> b{ 100, 100, 0.05, 0, 0.2, 1 };
+			b.lower = 90;
+			assert(throws<std::invalid_argument>([&] { lattice<>().price(b); }));
+		}
+		{
+			// American put against the PDE
+			pde::option<> a{ 100, 100, 0.05, 0, 0.2, 1 };
+			a.american = true;
+			lattice<> l;
+			auto r = l.price(a);
+			assert(fabs(r.value - 6.0904) < 2e-3);
+			pde::crank_nicolson<> cn;
+			auto p = cn.price(a);
+			assert(fabs(r.value - p.value) < 3e-3);
+			assert(fabs(r.delta - p.delta) < 1e-3);
+			assert(fabs(r.theta - p.theta) < 2e-2);
+			l.type = method::trinomial;
+			l.n = 500;
+			assert(fabs(l.price(a).value - 6.0904) < 3e-3);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl::tree
@@ -0,0 +1,196 @@
+// fsl_variance.h - Forward variance term structure
+/*
+Total variance V(t) = int_0^t v(u) du where the forward variance v is
+piecewise flat on (t_{j-1}, t_j] and extrapolated flat past the last point.
+This is a pwflat curve with variance in place of rate, so pwflat::integral
+gives total variance.
+
+The Black vol for expiry t is s = sqrt(V(t)) and the Black-Scholes/Merton
+vol is sigma = sqrt(V(t)/t). A variance swap from 0 to t_j with annualized
+par variance σ_j^2 has V(t_j) = σ_j^2 t_j, so bootstrapping quotes gives
+
+	v_j = (σ_j^2 t_j - σ_{j-1}^2 t_{j-1})/(t_j - t_{j-1}).
+
+Negative forward variance is a calendar arbitrage.
+*/
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "fsl_pwflat.h"
+#ifdef _DEBUG
+#include "fsl_black.h"
+#include "fsl_vswap.h"
+#endif // _DEBUG
+
+namespace fsl {
+
+	template<class T = double, class F = double>
+	class forward_variance {
+		pwflat::curve<T, F> v_;
+	public:
+		// Forward variances v on (t[j-1], t[j]] with the last extrapolated.
+		forward_variance(size_t n, const T* t, const F* v)
+			: v_(n, t, v, n ? v[n - 1] : NaN<F>)
+		{
+			for (size_t j = 0; j < n; ++j) {
+				if (!(t[j] > (j ? t[j - 1] : T(0)))) {
+					throw std::invalid_argument("forward_variance: times must be positive and increasing");
+				}
+				if (!(v[j] >= 0)) {
+					throw std::invalid_argument("forward_variance: forward variance must be non-negative");
+				}
+			}
+		}
+
+		size_t size() const
+		{
+			return v_.size();
+		}
+		const pwflat::curve_view<T, F>& curve() const
+		{
+			return v_;
+		}
+
+		// Total variance V(t).
+		F total(T t) const
+		{
+			return v_.integral(t);
+		}
+		// Black vol sqrt(V(t)).
+		F stdev(T t) const
+		{
+			return std::sqrt(total(t));
+		}
+		// Black-Scholes/Merton vol sqrt(V(t)/t).
+		F vol(T t) const
+		{
+			return std::sqrt(total(t) / t);
+		}
+		// Annualized par variance of a forward starting variance swap over [t0, t1].
+		F par(T t0, T t1) const
+		{
+			return (total(t1) - total(t0)) / (t1 - t0);
+		}
+
+		// Black vols s[i] for m increasing expiries in one pass over the curve.
+		void stdev(size_t m, const T* t, F* s) const
+		{
+			const size_t n = v_.size();
+			const T* tj = v_.time();
+			const F* vj = v_.rate();
+			size_t j = 0;
+			T t_ = 0;
+			F V = 0; // total variance to t_
+			for (size_t i = 0; i < m; ++i) {
+				if (i && t[i] < t[i - 1]) {
+					throw std::invalid_argument("forward_variance: expiries must be increasing");
+				}
+				while (j < n && tj[j] <= t[i]) {
+					V += vj[j] * (tj[j] - t_);
+					t_ = tj[j];
+					++j;
+				}
+				s[i] = std::sqrt(V + (j < n ? vj[j] : v_.extrapolate()) * (t[i] - t_));
+			}
+		}
+
+		// Largest difference between the curve and annualized par variances s2 to t.
+		F check(size_t n, const T* t, const F* s2) const
+		{
+			F e = 0;
+			for (size_t i = 0; i < n; ++i) {
+				e = std::max(e, std::fabs(par(0, t[i]) - s2[i]));
+			}
+
+			return e;
+		}
+	};
+
+	// Bootstrap forward variance from annualized par variances s2 of variance swaps to t.
+	template<class T = double, class F = double>
+	inline forward_variance<T, F> bootstrap_variance(size_t n, const T* t, const F* s2)
+	{
+		std::vector<F> v(n);
+		F V_ = 0;
+		for (size_t j = 0; j < n; ++j) {
+			const T t_ = j ? t[j - 1] : T(0);
+			if (!(t[j] > t_)) {
+				throw std::invalid_argument("bootstrap_variance: times must be positive and increasing");
+			}
+			const F V = s2[j] * t[j];
+			v[j] = (V - V_) / (t[j] - t_);
+			if (v[j] < 0) {
+				throw std::invalid_argument("bootstrap_variance: negative forward variance is a calendar arbitrage");
+			}
+			V_ = V;
+		}
+
+		return forward_variance<T, F>(n, t, v.data());
+	}
+
+#ifdef _DEBUG
+	inline int test_forward_variance()
+	{
+		{
+			const double t[] = { 0.5, 1, 2 };
+			const double s2[] = { 0.04, 0.0625, 0.0484 }; // vols 20%, 25%, 22%
+			auto fv = bootstrap_variance(3, t, s2);
+			assert(fv.size() == 3);
+			assert(fabs(fv.curve().rate()[0] - 0.04) < 1e-15);
+			assert(fabs(fv.curve().rate()[1] - 0.085) < 1e-15);
+			assert(fabs(fv.curve().rate()[2] - 0.0343) < 1e-15);
+			assert(fv.check(3, t, s2) < 1e-15);
+			assert(fabs(fv.vol(1) - 0.25) < 1e-15);
+			assert(fabs(fv.stdev(2) - 0.22 * std::sqrt(2.)) < 1e-15);
+			assert(fabs(fv.par(1, 2) - 0.0343) < 1e-15);
+			assert(fabs(fv.total(3) - (0.0484 * 2 + 0.0343)) < 1e-15); // extrapolated
+
+			// copies own their curve
+			forward_variance<> fv2 = fv;
+			assert(fv2.curve().time() != fv.curve().time() && fv2.total(3) == fv.total(3));
+			fv2 = bootstrap_variance(1, t, s2);
+			assert(fv2.size() == 1 && fv2.curve().time() != fv.curve().time());
+			assert(fabs(fv2.total(1) - 0.04) < 1e-15);
+
+			const double u[] = { 0.25, 0.5, 0.75, 1, 3 };
+			double s[5];
+			fv.stdev(5, u, s);
+			for (size_t i = 0; i < 5; ++i) {
+				assert(fabs(s[i] - fv.stdev(u[i])) < 1e-15);
+			}
+		}
+		{
+			// consistent with par variance replicated from Black prices
+			const double t[] = { 1, 2 };
+			const double v[] = { 0.04, 0.0484 };
+			forward_variance<> fv(2, t, v);
+			double s2[2];
+			for (size_t i = 0; i < 2; ++i) {
+				std::vector<double> k, p, c;
+				for (double x = 20; x <= 400; x += 1) {
+					const double p_ = black_put_value(100., fv.stdev(t[i]), x);
+					k.push_back(x);
+					p.push_back(p_);
+					c.push_back(p_ + 100 - x);
+				}
+				s2[i] = par_variance(t[i], 100., 100., k.size(), k.data(), p.data(), c.data());
+			}
+			assert(fv.check(2, t, s2) < 1e-4);
+			auto fv_ = bootstrap_variance(2, t, s2);
+			assert(fabs(fv_.vol(2) - fv.vol(2)) < 1e-3);
+		}
+		{
+			// calendar arbitrage
+			const double t[] = { 1, 2 };
+			const double s2[] = { 0.09, 0.04 };
+			assert(throws<std::invalid_argument>([&] { bootstrap_variance(2, t, s2); }));
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
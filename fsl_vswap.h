@@ -30,6 +30,7 @@
 #include <functional>
 #include <numeric>
 #include <span>
+#include <vector>
 #include "fsl_math.h"
 
 namespace fsl {
@@ -124,25 +125,12 @@ namespace fsl {
 		return w;
 	}
 
-	// Par variance is σ_0^2 = E[σ^2]
-	// given dt = tn - t0, x0 = X(0), z = put/call seperator,
-	// strikes k, put price p, and call prices c.
+	// Par variance given weights w from vswap_weights(x0, z, n, k, w).
+	// The weights do not depend on x0 so they can be reused for any underlying
+	// with the same put/call separator and strikes.
 	template<class X = double>
-	inline double par_variance(X dt, X x0, X z, size_t n, const X* k, const X* p, const X* c)
+	inline double par_variance(X dt, X x0, X z, size_t n, const X* k, const X* w, const X* p, const X* c)
 	{
-		if (n < 2 || k == nullptr || p == nullptr || c == nullptr) {
-			return NaN<X>;
-		}
-		if (!std::is_sorted(k, k + n)) return NaN<X>;
-		if (!is_increasing(p, p + n)) return NaN<X>;
-		if (!is_decreasing(c, c + n)) return NaN<X>;
-
-		std::vector<X> w(n);
-		// +1 to line up with strikes
-		if (!vswap_weights(x0, z, n, k, w.data())) {
-			return NaN<X>;
-		}
-	
 		X s2 = 0.0; // par variance
 		size_t i = 1;
 		// puts
@@ -170,18 +158,108 @@ namespace fsl {
 		return s2 / dt;
 	}
 
-	// TODO: Implement vswap_pnl that takes underlying times and observations
-	// Use formula involving cubic terms
+	// Par variance is σ_0^2 = E[σ^2]
+	// given dt = tn - t0, x0 = X(0), z = put/call seperator,
+	// strikes k, put price p, and call prices c.
 	template<class X = double>
-	inline X vswap_pnl(size_t n, const X* t, const X* S)
+	inline double par_variance(X dt, X x0, X z, size_t n, const X* k, const X* p, const X* c)
 	{
-		X pnl = 0;
-		for (size_t i = 0; i < n - 1; ++i) {
-			X dS_S = (S[i + 1] - S[i]) / S[i];
-			pnl += std::pow(dS_S, 3);
+		if (n < 2 || k == nullptr || p == nullptr || c == nullptr) {
+			return NaN<X>;
+		}
+		if (!std::is_sorted(k, k + n)) return NaN<X>;
+		if (!is_increasing(p, p + n)) return NaN<X>;
+		if (!is_decreasing(c, c + n)) return NaN<X>;
+
+		std::vector<X> w(n);
+		// +1 to line up with strikes
+		if (!vswap_weights(x0, z, n, k, w.data())) {
+			return NaN<X>;
+		}
+
+		return par_variance(dt, x0, z, n, k, w.data(), p, c);
+	}
+
+	// Realized variance and third order P&L error accumulated one observation at a time.
+	// Blocks of observations can be streamed in without copying.
+	template<class X = double>
+	struct vswap_realized {
+		size_t n = 0; // number of observations
+		X t0 = NaN<X>; // first observation time
+		X t = NaN<X>; // last observation time
+		X x = NaN<X>; // last observation
+		X s2 = 0; // sum_j (ΔX_j/X_j)^2
+		X s3 = 0; // sum_j (ΔX_j/X_j)^3
+
+		// Add observation x_ at time t_.
+		constexpr vswap_realized& add(X t_, X x_)
+		{
+			if (n == 0) {
+				t0 = t_;
+			}
+			else {
+				X dx_x = (x_ - x) / x;
+				X dx_x2 = dx_x * dx_x;
+				s2 += dx_x2;
+				s3 += dx_x2 * dx_x;
+			}
+			t = t_;
+			x = x_;
+			++n;
+
+			return *this;
+		}
+		// Add a block of observations.
+		constexpr vswap_realized& add(size_t m, const X* t_, const X* x_)
+		{
+			for (size_t i = 0; i < m; ++i) {
+				add(t_[i], x_[i]);
+			}
+
+			return *this;
 		}
 
-		return -2 * pnl / (3 * (t[n - 1] - t[0]));
+		// 1/(t_n - t_0) sum_0 <= j < n (ΔX_j/X_j)^2
+		constexpr X variance() const
+		{
+			return n < 2 ? NaN<X> : s2 / (t - t0);
+		}
+		// 1/(t_n - t_0) sum_0 <= j < n -2/3 (ΔX_j/X_j)^3
+		constexpr X pnl() const
+		{
+			return n < 2 ? NaN<X> : -2 * s3 / (3 * (t - t0));
+		}
+	};
+#ifdef _DEBUG
+	inline void test_vswap_realized()
+	{
+		const double t[] = { 0, 1, 2 };
+		const double x[] = { 100, 110, 99 };
+		vswap_realized<> r;
+		assert(is_nan(r.variance()));
+		r.add(1, t, x);
+		assert(is_nan(r.pnl()));
+		r.add(2, t + 1, x + 1);
+		assert(r.n == 3);
+		double s2 = (.1 * .1 + .1 * .1) / 2;
+		assert(fabs(r.variance() - s2) < 1e-15);
+		double s3 = -2 * (.1 * .1 * .1 - .1 * .1 * .1) / 6;
+		assert(fabs(r.pnl() - s3) < 1e-15);
+	}
+#endif // _DEBUG
+
+	// Realized variance of observations S at times t.
+	template<class X = double>
+	inline X realized_variance(size_t n, const X* t, const X* S)
+	{
+		return vswap_realized<X>{}.add(n, t, S).variance();
+	}
+
+	// Variance swap P&L error approximation from the cubic terms.
+	template<class X = double>
+	inline X vswap_pnl(size_t n, const X* t, const X* S)
+	{
+		return vswap_realized<X>{}.add(n, t, S).pnl();
 	}
 
 } // namespace fsl
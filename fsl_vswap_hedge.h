@@ -0,0 +1,215 @@
+// fsl_vswap_hedge.h - Monte Carlo variance swap hedge error
+/*
+Simulate the futures price X_j = X(t_j) with t_j = j t/n,
+
+	X_{j+1} = X_j exp(σ sqrt(Δt) Z_j - σ^2 Δt/2 - λ κ Δt + sum_{i < N_j} J_i)
+
+where Z_j are independent standard normal, N_j is Poisson with mean λ Δt,
+J_i are normal with mean μ and standard deviation ς, and κ = exp(μ + ς^2/2) - 1
+so X is a martingale.
+
+The replicating portfolio is the static option hedge with vswap_weights(x0, z, k)
+plus a futures position 2/X_h - 2/z rebalanced every m observations at X_h.
+The replication error on each path is
+
+	(static payoff(X_n) + sum_j (2/X_h - 2/z) ΔX_j)/t - realized variance.
+*/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <random>
+#include <vector>
+#include "fsl_monte.h"
+#include "fsl_quantile.h"
+#include "fsl_vswap.h"
+
+namespace fsl {
+
+	// Payoff at x of the static option hedge with weights w from vswap_weights.
+	// Equal to the piecewise linear interpolation of static_payoff(x0, z, k[i]).
+	template<class X = double>
+	inline X vswap_static_hedge(X x0, X z, size_t n, const X* k, const X* w, X x)
+	{
+		if (n < 2 || k == nullptr || w == nullptr) {
+			return NaN<X>;
+		}
+
+		// segment containing z
+		size_t i = 1;
+		while (i < n - 1 && k[i] < z) {
+			++i;
+		}
+		X fi_ = static_payoff(x0, z, k[i - 1]);
+		X fi = static_payoff(x0, z, k[i]);
+		X m = (fi - fi_) / (k[i] - k[i - 1]);
+		X h = fi_ + m * (x - k[i - 1]);
+
+		for (size_t j = 1; j < n - 1; ++j) {
+			h += w[j] * (k[j] < z ? std::max(k[j] - x, X(0)) : std::max(x - k[j], X(0)));
+		}
+
+		return h;
+	}
+
+	struct vswap_hedge {
+		double x0 = 100; // initial futures price
+		double sigma = 0.2; // diffusion volatility
+		double t = 1; // variance swap tenor in years
+		size_t steps = 252; // number of observations
+		size_t rebalance = 1; // observations between dynamic hedge rebalances
+		double z = 100; // put/call separator
+		std::vector<double> k; // static hedge strikes
+		double lambda = 0; // jump intensity
+		double mu = 0; // mean log jump size
+		double varsigma = 0; // log jump size standard deviation
+		size_t batch = 1024; // paths per batch
+
+		// Replication error of one path.
+		template<class G>
+		double path(G& g, const std::vector<double>& w) const
+		{
+			std::normal_distribution<double> Z;
+			std::poisson_distribution<int> N(lambda * t / steps);
+			const double dt = t / steps;
+			const double kappa = std::exp(mu + varsigma * varsigma / 2) - 1;
+			const double drift = -sigma * sigma * dt / 2 - lambda * kappa * dt;
+			const double sdt = sigma * std::sqrt(dt);
+
+			vswap_realized<double> r;
+			double x = x0;
+			double dyn = 0; // dynamic hedge gains
+			double pos = 0; // futures position
+			r.add(0, x);
+			for (size_t j = 0; j < steps; ++j) {
+				if (j % rebalance == 0) {
+					pos = 2 / x - 2 / z;
+				}
+				double dlx = drift + sdt * Z(g);
+				if (lambda > 0) {
+					for (int i = N(g); i > 0; --i) {
+						dlx += mu + varsigma * Z(g);
+					}
+				}
+				double x_ = x * std::exp(dlx);
+				dyn += pos * (x_ - x);
+				x = x_;
+				r.add((j + 1) * dt, x);
+			}
+			double stat = vswap_static_hedge(x0, z, k.size(), k.data(), w.data(), x);
+
+			return (stat + dyn) / t - r.variance();
+		}
+
+		struct result {
+			size_t n = 0; // number of paths
+			double mean = 0; // mean replication error
+			double variance = 0; // variance of replication error
+			std::vector<p2_quantile<>> quantile;
+		};
+
+		// Simulate paths in parallel batches. Batch b uses a generator seeded by (seed, b)
+		// and batches are accumulated in order so results do not depend on the number of threads.
+		result simulate(size_t paths, const std::vector<double>& p, uint64_t seed = 0) const
+		{
+			if (steps == 0 || rebalance == 0 || batch == 0 || !(sigma >= 0) || !(t > 0)) {
+				throw std::invalid_argument("vswap_hedge: steps, rebalance, batch, and t must be positive and sigma non-negative");
+			}
+			std::vector<double> w(k.size());
+			if (!vswap_weights(x0, z, k.size(), k.data(), w.data())) {
+				throw std::invalid_argument("vswap_hedge: invalid strikes for static hedge");
+			}
+
+			result res;
+			for (double p_ : p) {
+				res.quantile.emplace_back(p_);
+			}
+
+			const size_t nb = (paths + batch - 1) / batch;
+			const size_t round = 64; // batches per parallel round
+			std::vector<double> e;
+			std::vector<size_t> b_(round);
+			double m = 0, s2 = 0;
+			for (size_t b0 = 0; b0 < nb; b0 += round) {
+				const size_t nr = std::min(round, nb - b0);
+				const size_t ne = std::min(nr * batch, paths - b0 * batch);
+				e.resize(ne);
+				for (size_t i = 0; i < nr; ++i) {
+					b_[i] = b0 + i;
+				}
+				std::for_each(std::execution::par, b_.begin(), b_.begin() + nr, [&](size_t b) {
+					std::seed_seq ss{ seed, static_cast<uint64_t>(b) };
+					std::mt19937_64 g(ss);
+					const size_t i0 = (b - b0) * batch;
+					const size_t i1 = std::min(i0 + batch, ne);
+					for (size_t i = i0; i < i1; ++i) {
+						e[i] = path(g, w);
+					}
+				});
+				for (double ei : e) {
+					++res.n;
+					std::tie(m, s2) = monte_step(ei, static_cast<int>(res.n), m, s2);
+					for (auto& q : res.quantile) {
+						q.add(ei);
+					}
+				}
+			}
+			res.mean = m;
+			res.variance = s2 - m * m;
+
+			return res;
+		}
+	};
+#ifdef _DEBUG
+	inline int test_vswap_hedge()
+	{
+		{
+			// Static hedge interpolates the static payoff.
+			const double k[] = { 50, 75, 100, 125, 150 };
+			double w[5];
+			assert(vswap_weights(100., 100., 5, k, w));
+			for (double x : k) {
+				assert(fabs(vswap_static_hedge(100., 100., 5, k, w, x) - static_payoff(100., 100., x)) < 1e-12);
+			}
+		}
+		{
+			vswap_hedge h;
+			for (double k = 20; k <= 400; k += 1) {
+				h.k.push_back(k);
+			}
+			h.steps = 64;
+			auto r = h.simulate(4096, { 0.05, 0.5, 0.95 }, 1);
+			assert(r.n == 4096);
+			assert(fabs(r.mean) < 1e-3);
+			assert(r.quantile[0].value() < r.quantile[1].value());
+			assert(r.quantile[1].value() < r.quantile[2].value());
+
+			// same seed, same result
+			auto r_ = h.simulate(4096, { 0.5 }, 1);
+			assert(r_.mean == r.mean && r_.quantile[0].value() == r.quantile[1].value());
+
+			// less frequent rebalancing increases hedge error
+			h.rebalance = 8;
+			auto r8 = h.simulate(4096, {}, 1);
+			assert(r8.variance > r.variance);
+
+			// jumps bias the hedge
+			h.rebalance = 1;
+			h.lambda = 5;
+			h.mu = -0.1;
+			h.varsigma = 0.05;
+			auto rj = h.simulate(4096, {}, 1);
+			assert(fabs(rj.mean) > fabs(r.mean));
+
+			// pure jumps are allowed but not negative volatility
+			h.sigma = 0;
+			assert(h.simulate(1024, {}, 1).n == 1024);
+			h.sigma = -0.1;
+			assert(throws<std::invalid_argument>([&] { h.simulate(1024, {}, 1); }));
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fsl
@@ -1,4 +1,5 @@
 #include "fsl_bsm.h"	
+#include "fsl_chebyshev.h"
 #include "xll_fsl.h"
 
 using namespace xll;
@@ -113,20 +114,116 @@ double WINAPI xll_black_put_implied(double f, double p, double k)
 	return result;
 }
 
+AddIn xai_black_put_implied_array(
+	Function(XLL_FP, L"?xll_black_put_implied_array", L"BLACK.PUT.IMPLIED.ARRAY")
+	.Arguments({
+		Arg(XLL_FP, L"f", L"is an array of forward prices of the underlying asset."),
+		Arg(XLL_FP, L"p", L"is an array of put values."),
+		Arg(XLL_FP, L"k", L"is an array of strike prices."),
+		})
+		.Category(CATEGORY)
+	.FunctionHelp(L"Return the implied volatilities of Black put options solved in lockstep.")
+);
+_FP12* WINAPI xll_black_put_implied_array(_FP12* pf, _FP12* pp, _FP12* pk)
+{
+#pragma XLLEXPORT
+	static FPX s;
+
+	try {
+		ensure(size(*pf) == size(*pp));
+		ensure(size(*pf) == size(*pk));
+		s.resize(pp->rows, pp->columns);
+		fsl::black_put_implied(size(*pf), pf->array, pp->array, pk->array, s.array());
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return s.get();
+}
+
+AddIn xai_black_put_proxy_(
+	Function(XLL_HANDLEX, L"?xll_black_put_proxy_", L"\\BLACK.PUT.PROXY")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"k0", L"is the lowest strike divided by forward.", .5),
+		Arg(XLL_DOUBLE, L"k1", L"is the highest strike divided by forward.", 2),
+		Arg(XLL_DOUBLE, L"s0", L"is the lowest vol.", .05),
+		Arg(XLL_DOUBLE, L"s1", L"is the highest vol.", 1),
+		Arg(XLL_WORD, L"_n", L"is the optional number of points in strike. Default is 24."),
+		Arg(XLL_WORD, L"_m", L"is the optional number of points in vol. Default is 24."),
+		})
+		.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a handle to a Chebyshev proxy for Black put values.")
+);
+HANDLEX WINAPI xll_black_put_proxy_(double k0, double k1, double s0, double s1, WORD n, WORD m)
+{
+#pragma XLLEXPORT
+	HANDLEX h = INVALID_HANDLEX;
+
+	try {
+		handle<fsl::black_put_proxy<>> h_(new fsl::black_put_proxy<>(k0, k1, s0, s1, n ? n : 24, m ? m : 24));
+		ensure(h_);
+		h = h_.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return h;
+}
+
+AddIn xai_black_put_proxy(
+	Function(XLL_DOUBLE, L"?xll_black_put_proxy", L"BLACK.PUT.PROXY")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"proxy", L"is a handle returned by \\BLACK.PUT.PROXY."),
+		Arg(XLL_DOUBLE, L"f", L"is the forward price of the underlying asset.", 100),
+		Arg(XLL_DOUBLE, L"s", L"is the vol.", .1),
+		Arg(XLL_DOUBLE, L"k", L"is the strike price of the option.", 100),
+		})
+		.Category(CATEGORY)
+	.FunctionHelp(L"Return the approximate Black put value of an option.")
+);
+double WINAPI xll_black_put_proxy(HANDLEX h, double f, double s, double k)
+{
+#pragma XLLEXPORT
+	double result = std::numeric_limits<double>::quiet_NaN();
+
+	try {
+		handle<fsl::black_put_proxy<>> h_(h);
+		ensure(h_);
+		result = (*h_.ptr())(f, s, k);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return result;
+}
+
 // Run tests on xlAutoOpen
 Auto<Open> xao_fsl_test([]() {
 	try {
 		using namespace fsl;
 		test_normal_cdf();
 		test_normal_pdf();
+		test_normal_quantile();
 		test_black_moneyness();
 		test_black_put_value();
+		test_black_put_value_float();
 		test_black_put_delta();
 		test_black_put_gamma();
+		test_dual();
 		test_black_put_vega();
+		test_black_put_greeks();
 		test_black_put_implied();
+		test_chebyshev();
 		test_black_bsm();
 		test_bsm_put_value();
+		test_bsm_put_greeks();
+		test_bsm_expiry();
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
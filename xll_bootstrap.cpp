@@ -1,10 +1,95 @@
 // xll_bootstrap.cpp - Bootstrap a piecewise flat forward curve.
 #include "fsl_bootstrap.h"
+#include "fsl_curve_fit.h"
 #include "xll_fsl.h"
 
 using namespace xll;
 using namespace fsl;
 
+#ifdef _DEBUG
+Auto<Open> xao_root1d_test([] {
+
+	root1d::test_brent();
+	root1d::test_itp();
+	root1d::test_batch_root1d();
+	root1d::test_root1d_telemetry();
+	rootnd::test_cholesky();
+	rootnd::test_levenberg_marquardt();
+	test_curve_fit();
+	test_curve_batch();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_root1d_telemetry_enable(
+	Function(XLL_BOOL, L"?xll_root1d_telemetry_enable", L"ROOT1D.TELEMETRY.ENABLE")
+	.Arguments({
+		Arg(XLL_BOOL, L"enable", L"turns root solver telemetry on or off."),
+		Arg(XLL_BOOL, L"_reset", L"is an optional boolean to zero all counters. Default is FALSE."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Enable or disable root solver call site statistics and return the previous setting.")
+);
+BOOL WINAPI xll_root1d_telemetry_enable(BOOL enable, BOOL reset)
+{
+#pragma XLLEXPORT
+	if (reset) {
+		root1d::telemetry::reset();
+	}
+
+	return root1d::telemetry::enabled.exchange(enable != FALSE);
+}
+
+AddIn xai_root1d_telemetry(
+	Function(XLL_LPOPER, L"?xll_root1d_telemetry", L"ROOT1D.TELEMETRY")
+	.Arguments({})
+	.Volatile()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a table of calls, iterations per call, evaluations per call, failures, NaN residuals, "
+		L"and microseconds per call for each root solver call site.")
+);
+LPOPER WINAPI xll_root1d_telemetry()
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		// Snapshot the list since sites can register while the table is filled.
+		std::vector<const root1d::telemetry*> ps;
+		for (auto p = root1d::telemetry::first(); p; p = p->next()) {
+			ps.push_back(p);
+		}
+		o = OPER(static_cast<int>(ps.size()) + 1, 7);
+		o(0, 0) = "site";
+		o(0, 1) = "calls";
+		o(0, 2) = "iter/call";
+		o(0, 3) = "eval/call";
+		o(0, 4) = "failures";
+		o(0, 5) = "nans";
+		o(0, 6) = "us/call";
+		int i = 1;
+		for (auto p : ps) {
+			const double calls = static_cast<double>(p->calls.load());
+			o(i, 0) = p->name;
+			o(i, 1) = calls;
+			o(i, 2) = calls ? p->iterations.load() / calls : 0.;
+			o(i, 3) = calls ? p->evaluations.load() / calls : 0.;
+			o(i, 4) = static_cast<double>(p->failures.load());
+			o(i, 5) = static_cast<double>(p->nans.load());
+			o(i, 6) = calls ? p->nanoseconds.load() / calls / 1000 : 0.;
+			++i;
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+		o = ErrNA;
+	}
+
+	return &o;
+}
+
 AddIn xai_fsl_bootstrap0_(
 	Function(XLL_HANDLEX, L"?xll_fsl_bootstrap_", L"\\BOOTSTRAP")
 	.Arguments({
@@ -39,4 +124,89 @@ HANDLEX WINAPI xll_fsl_bootstrap_(const _FP12* ph)
 	}
 
 	return h;
-}
\ No newline at end of file
+}
+
+AddIn xai_fsl_bootstrap_batch_(
+	Function(XLL_FP, L"?xll_fsl_bootstrap_batch_", L"\\BOOTSTRAP.BATCH")
+	.Arguments({
+		Arg(XLL_FP, L"instruments", L"is a two dimensional array with one row of instrument handles per curve, padded with 0."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Bootstrap each row concurrently and return a column of curve handles. Failed curves have invalid handles.")
+);
+_FP12* WINAPI xll_fsl_bootstrap_batch_(const _FP12* ph)
+{
+#pragma XLLEXPORT
+	static FPX h;
+
+	try {
+		const int r = ph->rows, c = ph->columns;
+		std::vector<std::vector<const instrument<>*>> uc(r);
+		for (int i = 0; i < r; ++i) {
+			for (int j = 0; j < c && ph->array[i * c + j] != 0; ++j) {
+				handle<instrument<>> i_(ph->array[i * c + j]);
+				ensure(i_);
+				uc[i].push_back(i_.ptr());
+			}
+		}
+		curve_batch<> cb(uc);
+		h.resize(r, 1);
+		for (int i = 0; i < r; ++i) {
+			h[i] = INVALID_HANDLEX;
+			if (cb.error(i).empty()) {
+				auto f = cb[i];
+				handle<pwflat::curve<>> h_(new pwflat::curve<>(f.size(), f.time(), f.rate()));
+				ensure(h_);
+				h[i] = h_.get();
+			}
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return h.get();
+}
+
+AddIn xai_fsl_curve_fit_(
+	Function(XLL_HANDLEX, L"?xll_fsl_curve_fit_", L"\\CURVE.FIT")
+	.Arguments({
+		Arg(XLL_FP, L"instruments", L"is an array of instrument handles."),
+		Arg(XLL_FP, L"t", L"is an array of increasing curve knots."),
+		Arg(XLL_FP, L"_w", L"is an optional array of instrument weights. Default is all 1."),
+		Arg(XLL_DOUBLE, L"_smooth", L"is an optional smoothness penalty. Default is 0."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a handle to a piecewise flat forward curve with knots t minimizing weighted squared instrument present values.")
+);
+HANDLEX WINAPI xll_fsl_curve_fit_(const _FP12* ph, const _FP12* pt, const _FP12* pw, double smooth)
+{
+#pragma XLLEXPORT
+	HANDLEX h = INVALID_HANDLEX;
+
+	try {
+		std::vector<const instrument<>*> is(size(*ph));
+		for (int i = 0; i < size(*ph); ++i) {
+			handle<instrument<>> i_(ph->array[i]);
+			ensure(i_);
+			is[i] = i_.ptr();
+		}
+		std::vector<double> w;
+		if (!(size(*pw) == 1 && pw->array[0] == 0)) {
+			w.assign(pw->array, pw->array + size(*pw));
+		}
+		curve_fit<> cf(std::vector<double>(pt->array, pt->array + size(*pt)), smooth);
+		handle<pwflat::curve<>> h_(new pwflat::curve<>(cf.fit(is, w)));
+		ensure(h_);
+		h = h_.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return h;
+}
@@ -115,3 +115,88 @@ double WINAPI xll_bsm_put_implied(double r, double s0, double p, double t, doubl
 
     return result;
 }
+
+AddIn xai_bsm_put_greeks(
+	Function(XLL_FP, L"?xll_bsm_put_greeks", L"BSM.PUT.GREEKS")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"r", L"is interest rate.", .05),
+		Arg(XLL_DOUBLE, L"s0", L"is spot stock price.", 100),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility of the stock.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to maturity in years.", 1),
+		Arg(XLL_DOUBLE, L"k", L"is the strike price of the option.", 100),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of put value, rho, delta, vega, derivative with respect to t, derivative with respect to k, gamma, vanna, and volga.")
+);
+_FP12* WINAPI xll_bsm_put_greeks(double r, double s0, double sigma, double t, double k)
+{
+#pragma XLLEXPORT
+	static FPX g;
+
+	try {
+		auto h = fsl::bsm_put_hessian(r, s0, sigma, t, k);
+		g.resize(9, 1);
+		g[0] = h.v.v;
+		for (int i = 0; i < 5; ++i) {
+			g[1 + i] = h.v.d[i];
+		}
+		g[6] = h.d[1].d[1];
+		g[7] = h.d[1].d[2];
+		g[8] = h.d[2].d[2];
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return g.get();
+}
+
+AddIn xai_bsm_put_curve(
+	Function(XLL_FP, L"?xll_bsm_put_curve", L"BSM.PUT.CURVE")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"curve", L"is a handle to a piecewise flat forward rate curve."),
+		Arg(XLL_DOUBLE, L"s0", L"is spot stock price.", 100),
+		Arg(XLL_DOUBLE, L"t", L"is the time to maturity in years.", 1),
+		Arg(XLL_FP, L"sigma", L"is an array of volatilities."),
+		Arg(XLL_FP, L"k", L"is an array of strike prices."),
+		Arg(XLL_HANDLEX, L"_dividend", L"is an optional handle to a piecewise flat dividend or borrow curve."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return Black-Scholes/Merton put values for all strikes of one expiry using rate and dividend curves.")
+);
+_FP12* WINAPI xll_bsm_put_curve(HANDLEX r, double s0, double t, const _FP12* psigma, const _FP12* pk, HANDLEX q)
+{
+#pragma XLLEXPORT
+	static FPX p;
+
+	try {
+		ensure(size(*psigma) == size(*pk) || size(*psigma) == 1);
+		handle<fsl::pwflat::curve<>> r_(r);
+		ensure(r_);
+		fsl::pwflat::curve_view<> q_(0.);
+		if (q) {
+			handle<fsl::pwflat::curve<>> h_(q);
+			ensure(h_);
+			q_ = *h_.ptr();
+		}
+		fsl::bsm_expiry<> e(s0, t, *r_.ptr(), q_);
+		p.resize(pk->rows, pk->columns);
+		if (size(*psigma) == 1) {
+			for (int i = 0; i < size(*pk); ++i) {
+				p[i] = e.put_value(psigma->array[0], pk->array[i]);
+			}
+		}
+		else {
+			e.put_value(size(*pk), psigma->array, pk->array, p.array());
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return p.get();
+}
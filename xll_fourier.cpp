@@ -0,0 +1,106 @@
+// xll_fourier.cpp - Characteristic function pricing
+#include "fsl_fourier.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_fourier_test([] {
+
+	fourier::test_fourier();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+// Put values for a strip of strikes by COS or Carr-Madan.
+template<class M>
+inline void fourier_put(const M& phi, double f, double D, double t, const _FP12* pk, FPX& p, bool fft)
+{
+	const size_t n = size(*pk);
+	p.resize(pk->rows, pk->columns);
+	if (fft) {
+		fourier::carr_madan<>(phi, t).put(f, D, n, pk->array, p.array());
+	}
+	else {
+		double xmax = 1;
+		for (size_t i = 0; i < n; ++i) {
+			xmax = std::max(xmax, std::fabs(std::log(f / pk->array[i])));
+		}
+		fourier::cos_expiry<>(phi, t, 512, 10, xmax).put(f, D, n, pk->array, p.array());
+	}
+}
+
+AddIn xai_bates_put(
+	Function(XLL_FP, L"?xll_bates_put", L"BATES.PUT")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward.", 100),
+		Arg(XLL_DOUBLE, L"D", L"is the discount to expiry.", 1),
+		Arg(XLL_DOUBLE, L"t", L"is the time to expiry in years.", 1),
+		Arg(XLL_FP, L"k", L"is an array of strikes."),
+		Arg(XLL_DOUBLE, L"v0", L"is the initial variance.", .04),
+		Arg(XLL_DOUBLE, L"kappa", L"is the variance mean reversion rate.", 1.5),
+		Arg(XLL_DOUBLE, L"theta", L"is the long run variance.", .04),
+		Arg(XLL_DOUBLE, L"xi", L"is the vol of variance.", .5),
+		Arg(XLL_DOUBLE, L"rho", L"is the correlation of spot and variance.", -.5),
+		Arg(XLL_DOUBLE, L"_lambda", L"is the optional jump intensity. Default is 0 for Heston."),
+		Arg(XLL_DOUBLE, L"_mu", L"is the optional mean log jump size. Default is 0."),
+		Arg(XLL_DOUBLE, L"_delta", L"is the optional log jump size standard deviation. Default is 0."),
+		Arg(XLL_BOOL, L"_fft", L"is an optional boolean to use Carr-Madan FFT instead of COS. Default is FALSE."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return Heston or Bates put values for each strike.")
+);
+_FP12* WINAPI xll_bates_put(double f, double D, double t, const _FP12* pk,
+	double v0, double kappa, double theta, double xi, double rho, double lambda, double mu, double delta, BOOL fft)
+{
+#pragma XLLEXPORT
+	static FPX p;
+
+	try {
+		const fourier::bates<> phi{ { v0, kappa, theta, xi, rho }, lambda, mu, delta };
+		fourier_put(phi, f, D, t, pk, p, fft != 0);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return p.get();
+}
+
+AddIn xai_merton_put(
+	Function(XLL_FP, L"?xll_merton_put", L"MERTON.PUT")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward.", 100),
+		Arg(XLL_DOUBLE, L"D", L"is the discount to expiry.", 1),
+		Arg(XLL_DOUBLE, L"t", L"is the time to expiry in years.", 1),
+		Arg(XLL_FP, L"k", L"is an array of strikes."),
+		Arg(XLL_DOUBLE, L"sigma", L"is the diffusion volatility.", .2),
+		Arg(XLL_DOUBLE, L"lambda", L"is the jump intensity.", .5),
+		Arg(XLL_DOUBLE, L"mu", L"is the mean log jump size.", -.1),
+		Arg(XLL_DOUBLE, L"delta", L"is the log jump size standard deviation.", .15),
+		Arg(XLL_BOOL, L"_fft", L"is an optional boolean to use Carr-Madan FFT instead of COS. Default is FALSE."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return Merton jump diffusion put values for each strike.")
+);
+_FP12* WINAPI xll_merton_put(double f, double D, double t, const _FP12* pk,
+	double sigma, double lambda, double mu, double delta, BOOL fft)
+{
+#pragma XLLEXPORT
+	static FPX p;
+
+	try {
+		fourier_put(fourier::merton<>{ sigma, lambda, mu, delta }, f, D, t, pk, p, fft != 0);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return p.get();
+}
@@ -0,0 +1,195 @@
+// xll_monte.cpp - Monte Carlo with variance reduction
+#include "fsl_lognormal.h"
+#include "fsl_quantile.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_monte_test([] {
+
+	test_monte_reduction();
+	test_monte_target();
+	test_lognormal_monte();
+	test_moments();
+	test_histogram();
+	test_kll_sketch();
+	test_t_digest();
+	test_distribution_sketch();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_monte_asian_put(
+	Function(XLL_FP, L"?xll_monte_asian_put", L"MONTE.ASIAN.PUT")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward.", 100),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to expiry in years.", 1),
+		Arg(XLL_WORD, L"steps", L"is the number of equally spaced fixings.", 12),
+		Arg(XLL_DOUBLE, L"k", L"is the strike.", 100),
+		Arg(XLL_DOUBLE, L"paths", L"is the number of simulated paths.", 10000),
+		Arg(XLL_BOOL, L"_antithetic", L"is an optional boolean to average each path with its reflection. Default is FALSE."),
+		Arg(XLL_BOOL, L"_control", L"is an optional boolean to use the Black put at expiry as a control variate. Default is FALSE."),
+		Arg(XLL_WORD, L"_strata", L"is the optional number of strata for the terminal value. Default is 1."),
+		Arg(XLL_DOUBLE, L"_seed", L"is the optional random number generator seed. Default is 0."),
+		Arg(XLL_DOUBLE, L"_tolerance", L"is the optional standard error at which to stop early. Default is 0."),
+		Arg(XLL_DOUBLE, L"_seconds", L"is the optional time budget in seconds. Default is no limit."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of the undiscounted arithmetic Asian put value, standard error, control coefficient, and number of paths.")
+);
+_FP12* WINAPI xll_monte_asian_put(double f, double sigma, double t, WORD steps, double k, double paths,
+	BOOL antithetic, BOOL control, WORD strata, double seed, double tolerance, double seconds)
+{
+#pragma XLLEXPORT
+	static FPX r;
+
+	try {
+		lognormal_monte m;
+		m.f = f;
+		m.sigma = sigma;
+		m.t = t;
+		m.steps = steps;
+		m.k = k;
+		m.antithetic = antithetic != 0;
+		m.control = control != 0;
+		m.strata = strata ? strata : 1;
+		m.tolerance = tolerance;
+		if (seconds > 0) {
+			m.seconds = seconds;
+		}
+		auto res = m.simulate([k](size_t n, const double* F) {
+			double a = 0;
+			for (size_t j = 0; j < n; ++j) {
+				a += F[j];
+			}
+			return std::max(k - a / n, 0.);
+		}, static_cast<size_t>(paths), static_cast<uint64_t>(seed));
+		r.resize(4, 1);
+		r[0] = res.mean;
+		r[1] = res.error();
+		r[2] = res.beta;
+		r[3] = static_cast<double>(res.n);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_monte_asian_put_greeks(
+	Function(XLL_FP, L"?xll_monte_asian_put_greeks", L"MONTE.ASIAN.PUT.GREEKS")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward.", 100),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to expiry in years.", 1),
+		Arg(XLL_WORD, L"steps", L"is the number of equally spaced fixings.", 12),
+		Arg(XLL_DOUBLE, L"k", L"is the strike.", 100),
+		Arg(XLL_DOUBLE, L"paths", L"is the number of simulated paths.", 10000),
+		Arg(XLL_BOOL, L"_antithetic", L"is an optional boolean to average each path with its reflection. Default is FALSE."),
+		Arg(XLL_WORD, L"_strata", L"is the optional number of strata for the terminal value. Default is 1."),
+		Arg(XLL_DOUBLE, L"_p", L"is the optional confidence interval coverage. Default is 0.95."),
+		Arg(XLL_DOUBLE, L"_seed", L"is the optional random number generator seed. Default is 0."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return rows of value, delta, gamma, and vega with columns of estimate and confidence interval bounds.")
+);
+_FP12* WINAPI xll_monte_asian_put_greeks(double f, double sigma, double t, WORD steps, double k, double paths,
+	BOOL antithetic, WORD strata, double p, double seed)
+{
+#pragma XLLEXPORT
+	static FPX r;
+
+	try {
+		ensure(0 <= p && p < 1);
+		if (p == 0) {
+			p = 0.95;
+		}
+		lognormal_monte m;
+		m.f = f;
+		m.sigma = sigma;
+		m.t = t;
+		m.steps = steps;
+		m.antithetic = antithetic != 0;
+		m.strata = strata ? strata : 1;
+		auto g = m.simulate([k](size_t n, const double* F, double* dF) {
+			double a = 0;
+			for (size_t j = 0; j < n; ++j) {
+				a += F[j];
+			}
+			for (size_t j = 0; j < n; ++j) {
+				dF[j] = a < k * n ? -1. / n : 0;
+			}
+			return std::max(k - a / n, 0.);
+		}, static_cast<size_t>(paths), static_cast<uint64_t>(seed));
+		r.resize(4, 3);
+		int i = 0;
+		for (const auto& gi : { g.value, g.delta, g.gamma, g.vega }) {
+			auto [lo, hi] = gi.interval(p);
+			r[i] = gi.mean;
+			r[i + 1] = lo;
+			r[i + 2] = hi;
+			i += 3;
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_monte_put_pnl(
+	Function(XLL_FP, L"?xll_monte_put_pnl", L"MONTE.PUT.PNL")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward.", 100),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to expiry in years.", 1),
+		Arg(XLL_DOUBLE, L"k", L"is the strike.", 100),
+		Arg(XLL_DOUBLE, L"premium", L"is the premium received for the put.", 8),
+		Arg(XLL_DOUBLE, L"paths", L"is the number of simulated paths.", 1000000),
+		Arg(XLL_DOUBLE, L"alpha", L"is the VaR and ES confidence level.", .99),
+		Arg(XLL_DOUBLE, L"_seed", L"is the optional random number generator seed. Default is 0."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of the mean, standard deviation, skewness, excess kurtosis, VaR, and ES of short put P&L at expiry.")
+);
+_FP12* WINAPI xll_monte_put_pnl(double f, double sigma, double t, double k, double premium, double paths, double alpha, double seed)
+{
+#pragma XLLEXPORT
+	static FPX r;
+
+	try {
+		ensure(f > 0 && sigma > 0 && t > 0 && k > 0);
+		ensure(0 < alpha && alpha < 1);
+		monte_target m;
+		m.samples = static_cast<size_t>(paths);
+		const double s = sigma * std::sqrt(t);
+		auto d = m.accumulate([=](std::mt19937_64& g) {
+			const double F = f * std::exp(s * std::normal_distribution<double>{}(g) - s * s / 2);
+			return premium - std::max(k - F, 0.);
+		}, distribution_sketch<>(premium - k, premium + k / 100), static_cast<uint64_t>(seed));
+		r.resize(6, 1);
+		r[0] = d.mean();
+		r[1] = std::sqrt(d.moments.variance());
+		r[2] = d.moments.skewness();
+		r[3] = d.moments.kurtosis();
+		r[4] = value_at_risk(d.quantiles, alpha);
+		r[5] = expected_shortfall(d.quantiles, alpha);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
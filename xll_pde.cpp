@@ -0,0 +1,131 @@
+// xll_pde.cpp - Finite difference and lattice option pricing
+#include "fsl_pde.h"
+#include "fsl_tree.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_pde_test([] {
+
+	pde::test_crank_nicolson();
+	tree::test_lattice();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_bsm_pde(
+	Function(XLL_FP, L"?xll_bsm_pde", L"BSM.PDE")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"s", L"is spot stock price.", 100),
+		Arg(XLL_FP, L"k", L"is an array of strikes."),
+		Arg(XLL_DOUBLE, L"r", L"is interest rate.", .05),
+		Arg(XLL_DOUBLE, L"q", L"is dividend yield.", 0),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility of the stock.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to maturity in years.", 1),
+		Arg(XLL_BOOL, L"_call", L"is an optional boolean for calls. Default is FALSE for puts."),
+		Arg(XLL_BOOL, L"_american", L"is an optional boolean for early exercise. Default is FALSE."),
+		Arg(XLL_DOUBLE, L"_lower", L"is an optional knock out barrier below spot. Default is 0 for none."),
+		Arg(XLL_DOUBLE, L"_upper", L"is an optional knock out barrier above spot. Default is 0 for none."),
+		Arg(XLL_WORD, L"_n", L"is the optional number of space nodes. Default is 200."),
+		Arg(XLL_WORD, L"_steps", L"is the optional number of time steps. Default is 100."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return value, delta, gamma, and theta for each strike using Crank-Nicolson finite differences.")
+);
+_FP12* WINAPI xll_bsm_pde(double s, const _FP12* pk, double r, double q, double sigma, double t,
+	BOOL call, BOOL american, double lower, double upper, WORD n, WORD steps)
+{
+#pragma XLLEXPORT
+	static FPX v;
+
+	try {
+		const size_t m = size(*pk);
+		std::vector<pde::option<>> o(m);
+		for (size_t j = 0; j < m; ++j) {
+			o[j] = pde::option<>{ s, pk->array[j], r, q, sigma, t, call != 0, american != 0, lower,
+				upper ? upper : infinity<double> };
+		}
+		pde::crank_nicolson<> cn;
+		if (n) {
+			cn.n = n;
+		}
+		if (steps) {
+			cn.steps = steps;
+		}
+		std::vector<pde::result<>> res(m);
+		cn.price(m, o.data(), res.data());
+		v.resize(static_cast<int>(m), 4);
+		for (size_t j = 0; j < m; ++j) {
+			const int i = static_cast<int>(4 * j);
+			v[i] = res[j].value;
+			v[i + 1] = res[j].delta;
+			v[i + 2] = res[j].gamma;
+			v[i + 3] = res[j].theta;
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return v.get();
+}
+
+AddIn xai_bsm_tree(
+	Function(XLL_FP, L"?xll_bsm_tree", L"BSM.TREE")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"s", L"is spot stock price.", 100),
+		Arg(XLL_FP, L"k", L"is an array of strikes."),
+		Arg(XLL_DOUBLE, L"r", L"is interest rate.", .05),
+		Arg(XLL_DOUBLE, L"q", L"is dividend yield.", 0),
+		Arg(XLL_DOUBLE, L"sigma", L"is the volatility of the stock.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time to maturity in years.", 1),
+		Arg(XLL_BOOL, L"_call", L"is an optional boolean for calls. Default is FALSE for puts."),
+		Arg(XLL_BOOL, L"_american", L"is an optional boolean for early exercise. Default is FALSE."),
+		Arg(XLL_WORD, L"_method", L"is an optional tree type: 0 for Leisen-Reimer, 1 for CRR, 2 for trinomial. Default is 0."),
+		Arg(XLL_WORD, L"_n", L"is the optional number of steps. Default is 101."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return value, delta, gamma, and theta for each strike using a recombining tree.")
+);
+_FP12* WINAPI xll_bsm_tree(double s, const _FP12* pk, double r, double q, double sigma, double t,
+	BOOL call, BOOL american, WORD method, WORD n)
+{
+#pragma XLLEXPORT
+	static FPX v;
+
+	try {
+		ensure(method <= 2);
+		const size_t m = size(*pk);
+		std::vector<pde::option<>> o(m);
+		for (size_t j = 0; j < m; ++j) {
+			o[j] = pde::option<>{ s, pk->array[j], r, q, sigma, t, call != 0, american != 0 };
+		}
+		tree::lattice<> l;
+		l.type = method == 0 ? tree::method::leisen_reimer : method == 1 ? tree::method::crr : tree::method::trinomial;
+		if (n) {
+			l.n = n;
+		}
+		std::vector<pde::result<>> res(m);
+		l.price(m, o.data(), res.data());
+		v.resize(static_cast<int>(m), 4);
+		for (size_t j = 0; j < m; ++j) {
+			const int i = static_cast<int>(4 * j);
+			v[i] = res[j].value;
+			v[i + 1] = res[j].delta;
+			v[i + 2] = res[j].gamma;
+			v[i + 3] = res[j].theta;
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return v.get();
+}
@@ -0,0 +1,117 @@
+// xll_risk.cpp - Portfolio risk ladder
+#include "fsl_adjoint.h"
+#include "fsl_risk.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_risk_test([] {
+
+	test_portfolio_risk();
+	test_adjoint();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_portfolio_risk(
+	Function(XLL_FP, L"?xll_portfolio_risk", L"PORTFOLIO.RISK")
+	.Arguments({
+		Arg(XLL_FP, L"instruments", L"is an array of instrument handles."),
+		Arg(XLL_FP, L"notionals", L"is an array of notionals, one per instrument."),
+		Arg(XLL_HANDLEX, L"curve", L"is a handle to a piecewise flat forward curve."),
+		Arg(XLL_BOOL, L"_parallel", L"is an optional boolean to use all cores. Default is FALSE."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of present value, DV01, convexity, and the 1bp key rate ladder for each forward segment.")
+);
+_FP12* WINAPI xll_portfolio_risk(const _FP12* ph, const _FP12* pn, HANDLEX f, BOOL parallel)
+{
+#pragma XLLEXPORT
+	static FPX r;
+
+	try {
+		ensure(size(*ph) == size(*pn));
+		handle<pwflat::curve<>> f_(f);
+		ensure(f_);
+		portfolio<> p;
+		for (int i = 0; i < size(*ph); ++i) {
+			handle<instrument<>> i_(ph->array[i]);
+			ensure(i_);
+			p.add(*i_.ptr(), pn->array[i]);
+		}
+		auto res = p.risk(*f_.ptr(), parallel != FALSE);
+		r.resize(3 + static_cast<int>(res.key_rate.size()), 1);
+		r[0] = res.pv;
+		r[1] = res.dv01;
+		r[2] = res.convexity;
+		for (size_t j = 0; j < res.key_rate.size(); ++j) {
+			r[3 + static_cast<int>(j)] = res.key_rate[j];
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_portfolio_quote_risk(
+	Function(XLL_FP, L"?xll_portfolio_quote_risk", L"PORTFOLIO.QUOTE.RISK")
+	.Arguments({
+		Arg(XLL_FP, L"curve", L"is an array of instrument handles to bootstrap."),
+		Arg(XLL_FP, L"instruments", L"is an array of instrument handles."),
+		Arg(XLL_FP, L"notionals", L"is an array of notionals, one per instrument."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of present value and its derivative with respect to the price of each curve instrument.")
+);
+_FP12* WINAPI xll_portfolio_quote_risk(const _FP12* pc, const _FP12* ph, const _FP12* pn)
+{
+#pragma XLLEXPORT
+	static FPX r;
+
+	try {
+		ensure(size(*ph) == size(*pn));
+		// The price of a curve instrument is minus its first cash flow.
+		tape<> tp;
+		std::vector<var<>> p(size(*pc));
+		std::vector<instrument<double, var<>>> uc(size(*pc));
+		std::vector<const instrument<double, var<>>*> is(size(*pc));
+		for (int i = 0; i < size(*pc); ++i) {
+			handle<instrument<>> i_(pc->array[i]);
+			ensure(i_);
+			ensure(!i_->empty());
+			for (const auto& [u, c] : *i_.ptr()) {
+				uc[i].emplace_back(u, c);
+			}
+			p[i] = var<>(tp, -uc[i][0].second.v);
+			uc[i][0].second = -p[i];
+			is[i] = &uc[i];
+		}
+		auto f = fsl::bootstrap(is);
+		var<> pv = 0;
+		for (int i = 0; i < size(*ph); ++i) {
+			handle<instrument<>> i_(ph->array[i]);
+			ensure(i_);
+			pv += pn->array[i] * present_value(*i_.ptr(), f);
+		}
+		auto a = gradient(pv);
+		r.resize(1 + size(*pc), 1);
+		r[0] = pv.v;
+		for (int i = 0; i < size(*pc); ++i) {
+			r[1 + i] = derivative(a, p[i]);
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
@@ -0,0 +1,125 @@
+// xll_svi.cpp - Option chains and implied volatility surface
+#include "fsl_svi.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_svi_test([] {
+
+	test_option_chain();
+	test_vol_surface();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_vol_surface_(
+	Function(XLL_HANDLEX, L"?xll_vol_surface_", L"\\VOL.SURFACE")
+	.Arguments({
+		Arg(XLL_FP, L"t", L"is an array of increasing expiries in years."),
+		Arg(XLL_FP, L"f", L"is an array of forwards for each expiry."),
+		Arg(XLL_FP, L"k", L"is a matrix of strikes with one row per expiry."),
+		Arg(XLL_FP, L"p", L"is a matrix of undiscounted put prices with one row per expiry."),
+		})
+		.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a handle to a volatility surface with an SVI slice calibrated to put prices at each expiry.")
+);
+HANDLEX WINAPI xll_vol_surface_(const _FP12* pt, const _FP12* pf, const _FP12* pk, const _FP12* pp)
+{
+#pragma XLLEXPORT
+	HANDLEX h = INVALID_HANDLEX;
+
+	try {
+		const size_t n = size(*pt);
+		ensure(size(*pf) == n);
+		ensure(pk->rows == n && pp->rows == n && pk->columns == pp->columns);
+		const size_t m = pk->columns;
+		std::vector<svi_quotes<>> q(n);
+		for (size_t i = 0; i < n; ++i) {
+			q[i].t = pt->array[i];
+			q[i].f = pf->array[i];
+			q[i].k.assign(pk->array + i * m, pk->array + (i + 1) * m);
+			q[i].p.assign(pp->array + i * m, pp->array + (i + 1) * m);
+		}
+		handle<vol_surface<>> h_(new vol_surface<>(q));
+		ensure(h_);
+		h = h_.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return h;
+}
+
+AddIn xai_vol_surface_vol(
+	Function(XLL_FP, L"?xll_vol_surface_vol", L"VOL.SURFACE.VOL")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"surface", L"is a handle returned by \\VOL.SURFACE."),
+		Arg(XLL_FP, L"t", L"is an array of expiries in years."),
+		Arg(XLL_FP, L"k", L"is an array of strikes."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return the Black-Scholes/Merton implied vol for each expiry and strike.")
+);
+_FP12* WINAPI xll_vol_surface_vol(HANDLEX h, const _FP12* pt, const _FP12* pk)
+{
+#pragma XLLEXPORT
+	static FPX s;
+
+	try {
+		handle<vol_surface<>> h_(h);
+		ensure(h_);
+		ensure(size(*pt) == size(*pk));
+		s.resize(pt->rows, pt->columns);
+		h_->vol(size(*pt), pt->array, pk->array, s.array());
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return s.get();
+}
+
+AddIn xai_option_chain_mask(
+	Function(XLL_FP, L"?xll_option_chain_mask", L"OPTION.CHAIN.MASK")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"f", L"is the forward."),
+		Arg(XLL_DOUBLE, L"D", L"is the discount to expiry."),
+		Arg(XLL_FP, L"k", L"is an array of increasing strikes."),
+		Arg(XLL_FP, L"p", L"is an array of put prices."),
+		Arg(XLL_FP, L"c", L"is an array of call prices."),
+		Arg(XLL_DOUBLE, L"_tol", L"is the optional put-call parity tolerance. Default is 0."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return 1 for quotes that pass the no arbitrage filters and 0 otherwise.")
+);
+_FP12* WINAPI xll_option_chain_mask(double f, double D, const _FP12* pk, const _FP12* pp, const _FP12* pc, double tol)
+{
+#pragma XLLEXPORT
+	static FPX m;
+
+	try {
+		const size_t n = size(*pk);
+		ensure(size(*pp) == n && size(*pc) == n);
+		option_chain<> oc;
+		oc.add(0, f, D, n, pk->array, pp->array, pc->array).clean(tol, false);
+		const auto v = oc[0];
+		m.resize(pk->rows, pk->columns);
+		for (size_t i = 0; i < n; ++i) {
+			m[static_cast<int>(i)] = v.mask[i];
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return m.get();
+}
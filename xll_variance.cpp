@@ -0,0 +1,72 @@
+// xll_variance.cpp - Forward variance term structure
+#include "fsl_variance.h"
+#include "xll_fsl.h"
+
+using namespace xll;
+using namespace fsl;
+
+#ifdef _DEBUG
+Auto<Open> xao_variance_test([] {
+
+	test_forward_variance();
+
+	return TRUE;
+});
+#endif // _DEBUG
+
+AddIn xai_forward_variance_(
+	Function(XLL_HANDLEX, L"?xll_forward_variance_", L"\\VARIANCE.BOOTSTRAP")
+	.Arguments({
+		Arg(XLL_FP, L"t", L"is an array of increasing variance swap maturities in years."),
+		Arg(XLL_FP, L"s2", L"is an array of annualized par variances."),
+		})
+		.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a handle to a piecewise flat forward variance curve bootstrapped from variance swap quotes.")
+);
+HANDLEX WINAPI xll_forward_variance_(const _FP12* pt, const _FP12* ps2)
+{
+#pragma XLLEXPORT
+	HANDLEX h = INVALID_HANDLEX;
+
+	try {
+		ensure(size(*pt) == size(*ps2));
+		handle<forward_variance<>> h_(new forward_variance<>(bootstrap_variance(size(*pt), pt->array, ps2->array)));
+		ensure(h_);
+		h = h_.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return h;
+}
+
+AddIn xai_forward_variance_stdev(
+	Function(XLL_FP, L"?xll_forward_variance_stdev", L"VARIANCE.STDEV")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"curve", L"is a handle returned by \\VARIANCE.BOOTSTRAP."),
+		Arg(XLL_FP, L"t", L"is an array of increasing expiries in years."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return the Black vol sqrt(V(t)) for each expiry where V is total variance.")
+);
+_FP12* WINAPI xll_forward_variance_stdev(HANDLEX h, const _FP12* pt)
+{
+#pragma XLLEXPORT
+	static FPX s;
+
+	try {
+		handle<forward_variance<>> h_(h);
+		ensure(h_);
+		s.resize(pt->rows, pt->columns);
+		h_->stdev(size(*pt), pt->array, s.array());
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return s.get();
+}
@@ -1,5 +1,7 @@
 ﻿// xll_vswap.cpp - Variance swap implementation
-#include "fsl_vswap.h"
+#include "fsl_dispersion.h"
+#include "fsl_tick.h"
+#include "fsl_vswap_hedge.h"
 #include "xll_fsl.h"
 
 using namespace fsl;
@@ -9,6 +11,12 @@ using namespace xll;
 Auto<Open> xao_vswap_test([] {
 
 	test_difference_quotient();
+	test_vswap_realized();
+	test_tick_file();
+	test_p2_quantile();
+	test_vswap_hedge();
+	test_implied_correlation();
+	test_dispersion();
 	
 	return TRUE; // Indicate successful test
 });
@@ -110,4 +118,289 @@ double WINAPI xll_vswap_pnl(_FP12* pt, _FP12* pX)
 	}
 
 	return result;
-}
\ No newline at end of file
+}
+
+AddIn xai_vswap_realized(
+	Function(XLL_FP, L"?xll_vswap_realized", L"VSWAP.REALIZED")
+	.Arguments({
+		Arg(XLL_FP, L"t", L"is an array of observation times."),
+		Arg(XLL_FP, L"X", L"is an array of underlying value at each observation time."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a two element array of realized variance and variance swap PnL.")
+);
+_FP12* WINAPI xll_vswap_realized(_FP12* pt, _FP12* pX)
+{
+#pragma XLLEXPORT
+	static xll::FPX r(1, 2);
+
+	try {
+		ensure(size(*pt) == size(*pX));
+		auto r_ = vswap_realized<>{}.add(size(*pt), pt->array, pX->array);
+		r[0] = r_.variance();
+		r[1] = r_.pnl();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_tick_csv(
+	Function(XLL_DOUBLE, L"?xll_tick_csv", L"TICK.CSV")
+	.Arguments({
+		Arg(XLL_CSTRING, L"csv", L"is the path of a file with lines id,t,X."),
+		Arg(XLL_CSTRING, L"file", L"is the path of the tick file to write."),
+	})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Convert a CSV file of ticks to a tick file and return the number of ticks.")
+);
+double WINAPI xll_tick_csv(const XCHAR* csv, const XCHAR* file)
+{
+#pragma XLLEXPORT
+	double result = NaN<double>;
+
+	try {
+		result = static_cast<double>(fsl::tick_csv(csv, file));
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return result;
+}
+
+AddIn xai_tick_file_(
+	Function(XLL_HANDLEX, L"?xll_tick_file_", L"\\TICK.FILE")
+	.Arguments({
+		Arg(XLL_CSTRING, L"file", L"is the path of a tick file."),
+	})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a handle to a memory mapped tick file.")
+);
+HANDLEX WINAPI xll_tick_file_(const XCHAR* file)
+{
+#pragma XLLEXPORT
+	HANDLEX h = INVALID_HANDLEX;
+
+	try {
+		handle<tick_file> h_(new tick_file(file));
+		ensure(h_);
+		h = h_.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return h;
+}
+
+AddIn xai_tick_file(
+	Function(XLL_FP, L"?xll_tick_file", L"TICK.FILE")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"h", L"is a handle to a tick file."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one row array of the underlying ids in a tick file.")
+);
+_FP12* WINAPI xll_tick_file(HANDLEX h)
+{
+#pragma XLLEXPORT
+	static xll::FPX ids;
+
+	try {
+		handle<tick_file> h_(h);
+		ensure(h_);
+		ids.resize(1, static_cast<int>(h_->size()));
+		for (size_t i = 0; i < h_->size(); ++i) {
+			ids[static_cast<int>(i)] = static_cast<double>((*h_)[i].id);
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return ids.get();
+}
+
+AddIn xai_tick_realized(
+	Function(XLL_FP, L"?xll_tick_realized", L"TICK.REALIZED")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"h", L"is a handle to a tick file."),
+		Arg(XLL_WORD, L"i", L"is the index of the underlying in the tick file."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a two element array of realized variance and variance swap PnL streamed from a tick file.")
+);
+_FP12* WINAPI xll_tick_realized(HANDLEX h, WORD i)
+{
+#pragma XLLEXPORT
+	static xll::FPX r(1, 2);
+
+	try {
+		handle<tick_file> h_(h);
+		ensure(h_);
+		auto r_ = h_->realized(i);
+		r[0] = r_.variance();
+		r[1] = r_.pnl();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_vswap_hedge(
+	Function(XLL_FP, L"?xll_vswap_hedge", L"VSWAP.HEDGE")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"x0", L"is the initial futures price.", 100),
+		Arg(XLL_DOUBLE, L"sigma", L"is the futures volatility.", .2),
+		Arg(XLL_DOUBLE, L"t", L"is the time period of the variance swap in years.", 1),
+		Arg(XLL_WORD, L"steps", L"is the number of observations.", 252),
+		Arg(XLL_WORD, L"rebalance", L"is the number of observations between dynamic hedge rebalances.", 1),
+		Arg(XLL_DOUBLE, L"z", L"is the put/call separator.", 100),
+		Arg(XLL_FP, L"k", L"is an array of static hedge strikes."),
+		Arg(XLL_DOUBLE, L"paths", L"is the number of simulated paths.", 10000),
+		Arg(XLL_FP, L"p", L"is an array of probabilities for replication error quantiles."),
+		Arg(XLL_DOUBLE, L"_lambda", L"is the optional jump intensity. Default is 0."),
+		Arg(XLL_DOUBLE, L"_mu", L"is the optional mean log jump size. Default is 0."),
+		Arg(XLL_DOUBLE, L"_varsigma", L"is the optional log jump size standard deviation. Default is 0."),
+		Arg(XLL_DOUBLE, L"_seed", L"is the optional random number generator seed. Default is 0."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of the mean, standard deviation, and quantiles of the variance swap replication error.")
+);
+_FP12* WINAPI xll_vswap_hedge(double x0, double sigma, double t, WORD steps, WORD rebalance, double z,
+	_FP12* pk, double paths, _FP12* pp, double lambda, double mu, double varsigma, double seed)
+{
+#pragma XLLEXPORT
+	static xll::FPX r;
+
+	try {
+		vswap_hedge h;
+		h.x0 = x0;
+		h.sigma = sigma;
+		h.t = t;
+		h.steps = steps;
+		h.rebalance = rebalance ? rebalance : 1;
+		h.z = z;
+		h.k.assign(pk->array, pk->array + size(*pk));
+		h.lambda = lambda;
+		h.mu = mu;
+		h.varsigma = varsigma;
+
+		std::vector<double> p;
+		if (!(size(*pp) == 1 && pp->array[0] == 0)) {
+			p.assign(pp->array, pp->array + size(*pp));
+		}
+		auto res = h.simulate(static_cast<size_t>(paths), p, static_cast<uint64_t>(seed));
+		r.resize(2 + static_cast<int>(p.size()), 1);
+		r[0] = res.mean;
+		r[1] = std::sqrt(res.variance);
+		for (size_t i = 0; i < p.size(); ++i) {
+			r[2 + static_cast<int>(i)] = res.quantile[i].value();
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}
+
+AddIn xai_vswap_implied_correlation(
+	Function(XLL_DOUBLE, L"?xll_vswap_implied_correlation", L"VSWAP.IMPLIED_CORRELATION")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"s2", L"is the index par variance."),
+		Arg(XLL_FP, L"w", L"is an array of constituent weights."),
+		Arg(XLL_FP, L"s2i", L"is an array of constituent par variances."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return the implied correlation of index constituents.")
+);
+double WINAPI xll_vswap_implied_correlation(double s2, _FP12* pw, _FP12* ps2)
+{
+#pragma XLLEXPORT
+	double result = NaN<double>;
+
+	try {
+		ensure(size(*pw) == size(*ps2));
+		result = fsl::implied_correlation(s2, size(*pw), pw->array, ps2->array);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return result;
+}
+
+AddIn xai_vswap_dispersion(
+	Function(XLL_FP, L"?xll_vswap_dispersion", L"VSWAP.DISPERSION")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"dt", L"is the time period of the variance swaps in years."),
+		Arg(XLL_FP, L"x0", L"is an array of initial prices of the index followed by the constituents."),
+		Arg(XLL_DOUBLE, L"z", L"is the put/call separator as a fraction of initial price."),
+		Arg(XLL_FP, L"k", L"is a one row array of strikes as a fraction of initial price."),
+		Arg(XLL_FP, L"p", L"is an array of put prices with one row for the index and each constituent."),
+		Arg(XLL_FP, L"c", L"is an array of call prices with one row for the index and each constituent."),
+		Arg(XLL_FP, L"w", L"is an array of constituent weights."),
+	})
+	.Category(CATEGORY)
+	.FunctionHelp(L"Return a one column array of implied correlation, index par variance, and constituent par variances.")
+);
+_FP12* WINAPI xll_vswap_dispersion(double dt, _FP12* px0, double z, _FP12* pk, _FP12* pp, _FP12* pc, _FP12* pw)
+{
+#pragma XLLEXPORT
+	static xll::FPX r;
+
+	try {
+		const int m = size(*px0);
+		const int n = size(*pk);
+		ensure(m == 1 + size(*pw));
+		ensure(pp->rows == m && pp->columns == n);
+		ensure(pc->rows == m && pc->columns == n);
+
+		// Scale moneyness strikes, puts, and calls by initial price so all rows share one grid.
+		std::vector<double> p(pp->array, pp->array + m * n);
+		std::vector<double> c(pc->array, pc->array + m * n);
+		std::vector<vswap_chain<>> S(m);
+		for (int i = 0; i < m; ++i) {
+			double x0 = px0->array[i];
+			for (int j = 0; j < n; ++j) {
+				p[i * n + j] /= x0;
+				c[i * n + j] /= x0;
+			}
+			S[i] = { 1, z, static_cast<size_t>(n), pk->array, p.data() + i * n, c.data() + i * n };
+		}
+		vswap_chain<> I = S[0];
+		S.erase(S.begin());
+
+		dispersion<> d;
+		d.price(dt, I, S, std::vector<double>(pw->array, pw->array + size(*pw)));
+		r.resize(m + 1, 1);
+		r[0] = d.correlation;
+		r[1] = d.index;
+		for (int i = 1; i < m; ++i) {
+			r[i + 1] = d.constituent[i - 1];
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		return nullptr;
+	}
+
+	return r.get();
+}